@@ -2,29 +2,48 @@
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 #include "riscv_sim_framework.h"
 #include "riscv_pipeline_registers.h"
 #include "riscv_pipeline_registers_vars.h"
 
-extern struct stage_reg_d  new_d_reg;
-extern struct stage_reg_x  new_x_reg;
-extern struct stage_reg_m  new_m_reg;
-extern struct stage_reg_w  new_w_reg;
+extern HART_LOCAL struct stage_reg_d  new_d_reg;
+extern HART_LOCAL struct stage_reg_x  new_x_reg;
+extern HART_LOCAL struct stage_reg_m  new_m_reg;
+extern HART_LOCAL struct stage_reg_w  new_w_reg;
 
-extern struct stage_reg_d cur_d_reg;
-extern struct stage_reg_x cur_x_reg;
-extern struct stage_reg_m cur_m_reg;
-extern struct stage_reg_w cur_w_reg;
+extern HART_LOCAL struct stage_reg_d cur_d_reg;
+extern HART_LOCAL struct stage_reg_x cur_x_reg;
+extern HART_LOCAL struct stage_reg_m cur_m_reg;
+extern HART_LOCAL struct stage_reg_w cur_w_reg;
 
 extern bool memory_read (uint64_t address, void * value, uint64_t size_in_bytes);
 extern bool memory_write (uint64_t address, uint64_t value, uint64_t size_in_bytes);
 extern bool memory_status (uint64_t address, void *value);
+extern bool memory_write_status (uint64_t address);
 
 extern void register_read (uint64_t register_a, uint64_t register_b, uint64_t * value_a, uint64_t * value_b);
 extern void register_write (uint64_t register_d, uint64_t value_d);
 
 extern void     set_pc (uint64_t pc);
 extern uint64_t get_pc (void);
+extern uint64_t get_cycle_counter (void);
+extern uint64_t get_hart_id (void);
+
+// victim caches and L2 cache (defined after the L1 caches)
+void insert_victim_cache(uint64_t address, const void *data, uint64_t size_in_bytes);
+void insert_l2_victim(uint64_t address, const void *data, uint64_t size_in_bytes);
+
+// coherence between the d-caches of the harts (defined after the L2 cache)
+int  coherence_fill(uint64_t address);
+void coherence_write(uint64_t address, uint64_t value, uint64_t size_in_bytes);
+
+// vector unit (defined after the multiply/divide unit)
+uint64_t vector_rs1(uint32_t instr);
+uint64_t vector_rs2(uint32_t instr);
+int      vector_funct(uint32_t instr);
 
 /*
 	Define a block for i-cache
@@ -40,7 +59,7 @@ struct model_i_cache{
 };
 
 // declare the global array for I-cache
-struct model_i_cache i_cache[512];
+HART_LOCAL struct model_i_cache i_cache[512];
 
 /*
 	check_i_cache mainly look for the instruction by the tag and index
@@ -68,6 +87,12 @@ uint32_t* check_i_cache(struct model_i_cache i_cache[512], uint64_t pc, uint32_t
 				result[1] = i_cache[index].instr3;
 			}else if(offset == 0xc){
 				result[1] = i_cache[index].instr4;
+			}else{ // halfword aligned (C extension), at 0xE the upper half is in the next line
+				uint32_t words[4] = {i_cache[index].instr1, i_cache[index].instr2, i_cache[index].instr3, i_cache[index].instr4};
+				result[1] = words[offset >> 2] >> 16;
+				if(offset < 0xE){
+					result[1] |= words[(offset >> 2) + 1] << 16;
+				}
 			}
 			return result;
 		}else{ // needs to update 
@@ -90,6 +115,12 @@ void update_i_cache(struct model_i_cache i_cache[512], uint64_t pc, uint32_t ins
 	int tag          = (pc & 0xFFFFE000) >> 13;
 	int index        = (pc & 0x1FF0) >> 4;
 	
+	// the old line goes to the victim cache or down to an exclusive L2
+	if(i_cache[index].valid_bit == 1 && i_cache[index].tag != tag){
+		uint32_t old_instr[4] = {i_cache[index].instr1, i_cache[index].instr2, i_cache[index].instr3, i_cache[index].instr4};
+		insert_victim_cache(((uint64_t)i_cache[index].tag << 13) | ((uint64_t)index << 4), old_instr, 16);
+	}
+	
 	// update both tag, data and valid_bit in d-cache
 	i_cache[index].tag       = tag;
 	i_cache[index].instr1    = instr[0];
@@ -101,33 +132,187 @@ void update_i_cache(struct model_i_cache i_cache[512], uint64_t pc, uint32_t ins
 	i_cache[index].valid_bit = 1;
 }
 
+/*
+	Compressed instructions (setopt rvc 1)
+		-instructions start on any halfword; one whose lowest two bits are
+		 not 11 is a 16-bit RVC instruction and the next one starts at
+		 pc + 2 (seq_pc in the stage registers)
+		-fetch stage expands a 16-bit instruction into the 32-bit one it
+		 stands for, so the predictors and decode stage only see 32-bit
+		 instructions; the F and D extension forms are not supported
+		-a 32-bit instruction at offset 0xE of a line has its upper half
+		 in the next line: fetch stage needs a second i-cache access for
+		 it (one bubble) and has to wait if that line misses
+		-simstats compares code density and i-cache traffic, run the same
+		 program built with and without RVC to compare the footprint
+*/
+HART_LOCAL bool     rvc_enabled = false;
+HART_LOCAL uint64_t straddle_pc = UINT64_MAX; // 32-bit instruction whose first line access is done
+HART_LOCAL uint64_t rvc_compressed = 0, rvc_full = 0, rvc_straddles = 0;
+HART_LOCAL uint64_t i_cache_accesses = 0, i_cache_misses = 0;
+
+uint32_t encode_i(uint32_t imm, uint32_t rs1, uint32_t funct3, uint32_t rd, uint32_t opcode){
+	return ((imm & 0xFFF) << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+}
+
+uint32_t encode_r(uint32_t funct7, uint32_t rs2, uint32_t rs1, uint32_t funct3, uint32_t rd, uint32_t opcode){
+	return (funct7 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+}
+
+uint32_t encode_s(uint32_t imm, uint32_t rs2, uint32_t rs1, uint32_t funct3){
+	return ((imm & 0xFE0) << 20) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | ((imm & 0x1F) << 7) | 0x23;
+}
+
+uint32_t encode_b(uint32_t imm, uint32_t rs2, uint32_t rs1, uint32_t funct3){
+	return ((imm & 0x1000) << 19) | ((imm & 0x7E0) << 20) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) |
+	       ((imm & 0x1E) << 7) | ((imm & 0x800) >> 4) | 0x63;
+}
+
+uint32_t encode_j(uint32_t imm, uint32_t rd){
+	return ((imm & 0x100000) << 11) | ((imm & 0x7FE) << 20) | ((imm & 0x800) << 9) | (imm & 0xFF000) | (rd << 7) | 0x6F;
+}
+
+// sign-extends the lowest bits bits of value
+uint32_t sext_bits(uint32_t value, int bits){
+	return (uint32_t)((int32_t)(value << (32 - bits)) >> (32 - bits));
+}
+
+/*
+	expand_compressed mainly turns a 16-bit RV64C instruction into the
+	32-bit instruction it stands for
+	return 0 (illegal) for reserved and floating-point encodings
+*/
+uint32_t expand_compressed(uint32_t c){
+	uint32_t rd     = (c >> 7) & 0x1F; // also rs1
+	uint32_t rs2    = (c >> 2) & 0x1F;
+	uint32_t rs1_p  = ((c >> 7) & 0x7) + 8; // rs1'/rd'
+	uint32_t rs2_p  = ((c >> 2) & 0x7) + 8; // rs2'/rd'
+	uint32_t imm6   = ((c >> 7) & 0x20) | ((c >> 2) & 0x1F);
+	uint32_t simm6  = sext_bits(imm6, 6);
+	uint32_t w_off  = ((c >> 7) & 0x38) | ((c << 1) & 0x40) | ((c >> 4) & 0x4); // c.lw/c.sw
+	uint32_t d_off  = ((c >> 7) & 0x38) | ((c << 1) & 0xC0);                     // c.ld/c.sd
+	uint32_t imm;
+	
+	switch(((c & 0x3) << 3) | ((c >> 13) & 0x7)){ // quadrant, funct3
+		case 0x00: // c.addi4spn
+			imm = ((c >> 7) & 0x30) | ((c >> 1) & 0x3C0) | ((c >> 4) & 0x4) | ((c >> 2) & 0x8);
+			return imm == 0 ? 0 : encode_i(imm, 2, 0, rs2_p, 0x13);
+		case 0x02: return encode_i(w_off, rs1_p, 2, rs2_p, 0x03); // c.lw
+		case 0x03: return encode_i(d_off, rs1_p, 3, rs2_p, 0x03); // c.ld
+		case 0x06: return encode_s(w_off, rs2_p, rs1_p, 2);       // c.sw
+		case 0x07: return encode_s(d_off, rs2_p, rs1_p, 3);       // c.sd
+		
+		case 0x08: return encode_i(simm6, rd, 0, rd, 0x13); // c.addi, c.nop
+		case 0x09: return rd == 0 ? 0 : encode_i(simm6, rd, 0, rd, 0x1B); // c.addiw
+		case 0x0A: return encode_i(simm6, 0, 0, rd, 0x13);  // c.li
+		case 0x0B:
+			if(rd == 2){ // c.addi16sp
+				imm = ((c >> 3) & 0x200) | ((c >> 2) & 0x10) | ((c << 1) & 0x40) | ((c << 4) & 0x180) | ((c << 3) & 0x20);
+				return imm == 0 ? 0 : encode_i(sext_bits(imm, 10), 2, 0, 2, 0x13);
+			}
+			return imm6 == 0 ? 0 : (simm6 << 12) | (rd << 7) | 0x37; // c.lui
+		case 0x0C:
+			switch((c >> 10) & 0x3){
+				case 0x0: return encode_i(imm6, rs1_p, 5, rs1_p, 0x13);         // c.srli
+				case 0x1: return encode_i(0x400 | imm6, rs1_p, 5, rs1_p, 0x13); // c.srai
+				case 0x2: return encode_i(simm6, rs1_p, 7, rs1_p, 0x13);        // c.andi
+			}
+			switch(((c >> 10) & 0x4) | ((c >> 5) & 0x3)){
+				case 0x0: return encode_r(0x20, rs2_p, rs1_p, 0, rs1_p, 0x33); // c.sub
+				case 0x1: return encode_r(0, rs2_p, rs1_p, 4, rs1_p, 0x33);    // c.xor
+				case 0x2: return encode_r(0, rs2_p, rs1_p, 6, rs1_p, 0x33);    // c.or
+				case 0x3: return encode_r(0, rs2_p, rs1_p, 7, rs1_p, 0x33);    // c.and
+				case 0x4: return encode_r(0x20, rs2_p, rs1_p, 0, rs1_p, 0x3B); // c.subw
+				case 0x5: return encode_r(0, rs2_p, rs1_p, 0, rs1_p, 0x3B);    // c.addw
+			}
+			return 0;
+		case 0x0D: // c.j
+			imm = ((c >> 1) & 0x800) | ((c >> 7) & 0x10) | ((c >> 1) & 0x300) | ((c << 2) & 0x400) |
+			      ((c >> 1) & 0x40) | ((c << 1) & 0x80) | ((c >> 2) & 0xE) | ((c << 3) & 0x20);
+			return encode_j(sext_bits(imm, 12), 0);
+		case 0x0E: // c.beqz
+		case 0x0F: // c.bnez
+			imm = ((c >> 4) & 0x100) | ((c >> 7) & 0x18) | ((c << 1) & 0xC0) | ((c >> 2) & 0x6) | ((c << 3) & 0x20);
+			return encode_b(sext_bits(imm, 9), 0, rs1_p, (c >> 13) & 0x1);
+		
+		case 0x10: return encode_i(imm6, rd, 1, rd, 0x13); // c.slli
+		case 0x12: // c.lwsp
+			imm = ((c >> 7) & 0x20) | ((c >> 2) & 0x1C) | ((c << 4) & 0xC0);
+			return rd == 0 ? 0 : encode_i(imm, 2, 2, rd, 0x03);
+		case 0x13: // c.ldsp
+			imm = ((c >> 7) & 0x20) | ((c >> 2) & 0x18) | ((c << 4) & 0x1C0);
+			return rd == 0 ? 0 : encode_i(imm, 2, 3, rd, 0x03);
+		case 0x14:
+			if(!(c & 0x1000)){
+				if(rs2 == 0){ // c.jr
+					return rd == 0 ? 0 : encode_i(0, rd, 0, 0, 0x67);
+				}
+				return encode_r(0, rs2, 0, 0, rd, 0x33); // c.mv
+			}
+			if(rd == 0 && rs2 == 0){
+				return 0x00100073; // c.ebreak
+			}
+			if(rs2 == 0){
+				return encode_i(0, rd, 0, 1, 0x67); // c.jalr
+			}
+			return encode_r(0, rs2, rd, 0, rd, 0x33); // c.add
+		case 0x16: return encode_s(((c >> 7) & 0x3C) | ((c >> 1) & 0xC0), rs2, 2, 2);  // c.swsp
+		case 0x17: return encode_s(((c >> 7) & 0x38) | ((c >> 1) & 0x1C0), rs2, 2, 3); // c.sdsp
+	}
+	return 0;
+}
+
+void print_rvc_stats(void){
+	uint64_t fetched = rvc_compressed + rvc_full;
+	if(!rvc_enabled || fetched == 0){
+		return;
+	}
+	printf("Compressed instructions:\n");
+	printf("  16-bit/32-bit instructions fetched: %" PRIu64 "/%" PRIu64 " (%.2f%% compressed)\n",
+	       rvc_compressed, rvc_full, 100.0 * rvc_compressed / fetched);
+	printf("  Average instruction size: %.2f bytes\n", (2.0 * rvc_compressed + 4.0 * rvc_full) / fetched);
+	printf("  32-bit instructions across a line: %" PRIu64 "\n", rvc_straddles);
+	printf("  I-cache accesses/misses: %" PRIu64 "/%" PRIu64 "\n", i_cache_accesses, i_cache_misses);
+}
+
 /*
 	Define a block for d-cache
 	will be used in a global struct array
 */
+#define MESI_SHARED            1 // a valid line is in one of these states, invalid is valid_bit 0
+#define MESI_EXCLUSIVE         2
+#define MESI_MODIFIED          3
+
 struct model_d_cache{
 	int      valid_bit;
 	uint32_t tag; // actually this tag is in length of 19 bits
 	uint64_t data;
+	int      mesi_state;
+	int      prefetch_bit; // filled by the prefetcher and not yet used by a load
+	int      wrong_path_bit; // filled by a wrong-path load and not yet used by a load
 };
 
 // declare the global array for D-cache
-struct model_d_cache d_cache[2048];
+HART_LOCAL struct model_d_cache d_cache[2048];
 
 /*
 	check_d_cache mainly look for the data by the tag and index
 	return an array containing status and data
 */
-uint64_t* check_d_cache(struct model_d_cache d_cache[2048], uint32_t address, uint64_t offset, uint64_t result[]){
+uint64_t* check_d_cache(struct model_d_cache d_cache[2048], uint32_t address, uint64_t size_in_bytes, uint64_t result[]){
 	// divide address into parts of a block
 	int tag          = (address & 0xFFFFC000) >> 14;
 	int index        = (address & 0x3FF8) >> 3;
+	int offset       = (address & 0x7);
 	
 	// compare the tag in d-cache with the address's tag
 	if(d_cache[index].tag == tag){
 		if(d_cache[index].valid_bit == 1){
 			result[0] = 1;
-			result[1] = d_cache[index].data & offset;
+			result[1] = d_cache[index].data >> (offset * 8);
+			if(size_in_bytes < 8){
+				result[1] = result[1] & ((1ULL << (size_in_bytes * 8)) - 1);
+			}
 			return result;
 		}else{ // needs to update 
 			result[0] = 0;
@@ -149,25 +334,34 @@ void update_d_cache(struct model_d_cache d_cache[2048], uint32_t address, uint64
 	int tag          = (address & 0xFFFFC000) >> 14;
 	int index        = (address & 0x3FF8) >> 3;
 	
+	// the old line goes to the victim cache or down to an exclusive L2
+	if(d_cache[index].valid_bit == 1 && d_cache[index].tag != tag){
+		insert_victim_cache(((uint64_t)d_cache[index].tag << 14) | ((uint64_t)index << 3), &d_cache[index].data, 8);
+	}
+	
 	// update both tag, data and valid_bit in d-cache
 	d_cache[index].tag       = tag;
 	d_cache[index].data      = data;
 	d_cache[index].valid_bit = 1;
+	d_cache[index].mesi_state = coherence_fill(address);
+	d_cache[index].prefetch_bit = 0;
+	d_cache[index].wrong_path_bit = 0;
 }
 
 /*
 	write_d_cache mainly check write hit or miss.
-	1. If it's write hit, then update the value in the d-cache
+	1. If it's write hit, then update the written bytes in the d-cache
 	2. If it's write miss, then leave the d-cache unmodified
 */
-void write_d_cache(struct model_d_cache d_cache[2048], uint32_t address, uint64_t data){
+void write_d_cache(struct model_d_cache d_cache[2048], uint32_t address, uint64_t data, uint64_t size_in_bytes){
 	// divide address into parts of a block
 	int tag          = (address & 0xFFFFC000) >> 14;
 	int index        = (address & 0x3FF8) >> 3;
+	int offset       = (address & 0x7);
 	
 	if(d_cache[index].tag == tag){
 		if(d_cache[index].valid_bit == 1){ // write hit
-			d_cache[index].data = data;
+			memcpy((uint8_t *)&d_cache[index].data + offset, &data, size_in_bytes);
 		}else{ // write miss - not valid
 			return;
 		}
@@ -176,89 +370,4989 @@ void write_d_cache(struct model_d_cache d_cache[2048], uint32_t address, uint64_
 	}
 }
 
-// To do the sign-extended
-uint64_t converter(uint64_t i, uint64_t most_significant, uint64_t bitwiseNum){
-	if(( i & most_significant ) == most_significant)
-	{
-		i = i | bitwiseNum;
+/*
+	Victim caches beside the direct-mapped L1 caches
+		-Small and fully associative with LRU replacement
+		-Catch the lines the i-cache/d-cache evict
+		-On an L1 miss that hits here, the line is swapped back into the L1
+		 after VICTIM_LATENCY cycle and the L1 line it replaces takes its slot
+	Lines pushed out of a victim cache go down to an exclusive L2.
+*/
+#define VICTIM_MAX_ENTRIES     32
+#define VICTIM_LATENCY         1
+
+struct model_victim_cache{
+	int      valid_bit;
+	uint64_t address; // line address
+	uint64_t data[2];
+	uint64_t last_use;
+};
+
+HART_LOCAL struct model_victim_cache i_victim_cache[VICTIM_MAX_ENTRIES];
+HART_LOCAL struct model_victim_cache d_victim_cache[VICTIM_MAX_ENTRIES];
+
+HART_LOCAL int      victim_enabled = 0;
+HART_LOCAL int      victim_entries = 8;
+HART_LOCAL uint64_t victim_lru_clock = 0;
+
+HART_LOCAL uint64_t i_victim_lookups = 0, i_victim_hits = 0, i_victim_inserts = 0;
+HART_LOCAL uint64_t d_victim_lookups = 0, d_victim_hits = 0, d_victim_inserts = 0;
+
+/*
+	insert_victim_cache mainly keeps a line evicted from an L1 cache,
+	size_in_bytes tells which one: 16 for the i-cache, 8 for the d-cache
+*/
+void insert_victim_cache(uint64_t address, const void *data, uint64_t size_in_bytes){
+	if(!victim_enabled){
+		insert_l2_victim(address, data, size_in_bytes);
+		return;
 	}
-	return i;
+	struct model_victim_cache *victim = (size_in_bytes == 16) ? i_victim_cache : d_victim_cache;
+	struct model_victim_cache *entry  = &victim[0];
+	for(int i = 0; i < victim_entries; i++){
+		if(!victim[i].valid_bit){
+			entry = &victim[i];
+			break;
+		}
+		if(victim[i].last_use < entry->last_use){
+			entry = &victim[i];
+		}
+	}
+	if(entry->valid_bit){
+		insert_l2_victim(entry->address, entry->data, size_in_bytes);
+	}
+	if(size_in_bytes == 16){
+		i_victim_inserts++;
+	}else{
+		d_victim_inserts++;
+	}
+	entry->valid_bit = 1;
+	entry->address   = address;
+	entry->last_use  = ++victim_lru_clock;
+	memcpy(entry->data, data, size_in_bytes);
 }
 
-/*  Branch Target Buffer - global variable
-	BTB[Tag][Target]
-		-Tag: current pc address
-		-Target: target pc address
+/*
+	check_victim_cache mainly looks for an L1 miss in the victim cache
+	return true and take the line out of the victim cache on a hit
 */
-uint64_t BTB[32][2];
+bool check_victim_cache(uint64_t address, void *value, uint64_t size_in_bytes){
+	if(!victim_enabled){
+		return false;
+	}
+	struct model_victim_cache *victim = (size_in_bytes == 16) ? i_victim_cache : d_victim_cache;
+	if(size_in_bytes == 16){
+		i_victim_lookups++;
+	}else{
+		d_victim_lookups++;
+	}
+	for(int i = 0; i < victim_entries; i++){
+		if(victim[i].valid_bit && victim[i].address == address){
+			memcpy(value, victim[i].data, size_in_bytes);
+			victim[i].valid_bit = 0;
+			if(size_in_bytes == 16){
+				i_victim_hits++;
+			}else{
+				d_victim_hits++;
+			}
+			return true;
+		}
+	}
+	return false;
+}
 
-/*  Branch Prediction
-	Goals: 
-		1. look over the BTB to see if there is a Tag that equals to the branch and give the target
-		2. if there is no record, then add Tag in fetch stage, and add Target in execute stage
-*/ 
-int branchPrediction(uint64_t btb[32][2], uint64_t pc, uint32_t instr){
-	
-	// forwarding not taken, depending on immediate is positve or negative
-	uint64_t tem = (instr & 0x80000000) >> 20;
-	tem  += (instr & 0x80) << 3;
-	tem  += (instr & 0x7E000000) >> 21;
-	tem  += (instr & 0xF00) >> 8;
-	tem   = tem & 0xFFF;
-	tem   = converter(tem,0x800,0xFFFFFFFFFFFFF000);
-	if(tem > 0){ // positive immediate means forwarding: no prediction, not taken
-		return 33;
+/*
+	invalidate_victim_cache mainly drops any victim copy of the bytes
+	[address, address + size_in_bytes)
+*/
+void invalidate_victim_cache(uint64_t address, uint64_t size_in_bytes){
+	for(int i = 0; i < victim_entries; i++){
+		if(i_victim_cache[i].valid_bit && i_victim_cache[i].address < address + size_in_bytes && address < i_victim_cache[i].address + 16){
+			i_victim_cache[i].valid_bit = 0;
+		}
+		if(d_victim_cache[i].valid_bit && d_victim_cache[i].address < address + size_in_bytes && address < d_victim_cache[i].address + 8){
+			d_victim_cache[i].valid_bit = 0;
+		}
 	}
-	
-	int i;
-	for(i = 0; i < 32; i++){
-		// if BTB reads the null values, break and store this pc into address
-		if( (btb[i][0] == 0) & (btb[i][1] == 0) ){
+}
+
+/*
+	write_victim_cache mainly updates the victim copy of stored bytes,
+	like write_d_cache it never allocates
+*/
+void write_victim_cache(uint64_t address, uint64_t value, uint64_t size_in_bytes){
+	for(int i = 0; victim_enabled && i < victim_entries; i++){
+		if(d_victim_cache[i].valid_bit && d_victim_cache[i].address == (address & ~0x7ULL)){
+			memcpy((uint8_t *)d_victim_cache[i].data + (address & 0x7), &value, size_in_bytes);
+		}
+	}
+}
+
+void print_victim_stats(void){
+	if(!victim_enabled){
+		printf("Victim caches: disabled\n");
+		return;
+	}
+	printf("Victim caches (%d entries each):\n", victim_entries);
+	printf("  I-side lookups/hits/inserts: %" PRIu64 "/%" PRIu64 "/%" PRIu64 "\n", i_victim_lookups, i_victim_hits, i_victim_inserts);
+	if(i_victim_lookups > 0){
+		printf("  I-side hit rate: %.2f%%\n", 100.0 * i_victim_hits / i_victim_lookups);
+	}
+	printf("  D-side lookups/hits/inserts: %" PRIu64 "/%" PRIu64 "/%" PRIu64 "\n", d_victim_lookups, d_victim_hits, d_victim_inserts);
+	if(d_victim_lookups > 0){
+		printf("  D-side hit rate: %.2f%%\n", 100.0 * d_victim_hits / d_victim_lookups);
+	}
+}
+
+/*
+	Unified L2 cache between the L1 caches and memory
+		-Lines are 16 bytes (one i-cache line) split into two 8-byte
+		 sectors (one d-cache line each), every sector has its own valid bit
+		-Set-associative with LRU replacement, sets are spread over banks
+		-Stores write through the L2 without allocating, like the d-cache
+	The L1 miss paths call memory_read_l2/memory_status_l2 in place of
+	memory_read/memory_status, these look in the victim caches first.
+	An L2 hit is answered after l2_latency
+	cycles (plus any wait for a busy bank), an L2 miss goes to memory with
+	the tag lookup overlapped with the memory access.
+*/
+#define L2_NINE                0 // non-inclusive non-exclusive
+#define L2_INCLUSIVE           1
+#define L2_EXCLUSIVE           2
+
+#define L2_LINE_SIZE           16
+#define L2_MAX_PENDING         4
+#define L2_MAX_BANKS           16
+
+struct model_l2_cache{
+	int      valid_bit[2];
+	uint64_t tag;
+	uint64_t data[2];
+	uint64_t last_use;
+};
+
+/*
+	L2 accesses in flight
+		-hit:  data is kept here until ready_cycle
+		-miss: waits on memory_status and fills the L2 when it completes
+*/
+struct model_l2_pending{
+	int      valid_bit;
+	int      done;       // answered once already, keep returning true like memory_status does
+	int      hit;
+	uint64_t address;
+	uint64_t size;
+	uint64_t ready_cycle;
+	uint64_t data[2];
+};
+
+HART_LOCAL struct model_l2_cache   *l2_cache = NULL;
+HART_LOCAL struct model_l2_pending l2_pending[L2_MAX_PENDING];
+HART_LOCAL uint64_t l2_bank_free[L2_MAX_BANKS];
+
+HART_LOCAL int      l2_enabled = 0;
+HART_LOCAL uint64_t l2_size    = 256 * 1024;
+HART_LOCAL uint64_t l2_ways    = 8;
+HART_LOCAL uint64_t l2_latency = 8;
+HART_LOCAL uint64_t l2_banks   = 4;
+HART_LOCAL int      l2_policy  = L2_NINE;
+HART_LOCAL uint64_t l2_sets    = 0;
+HART_LOCAL uint64_t l2_lru_clock = 0;
+
+HART_LOCAL uint64_t l2_i_hits = 0, l2_i_misses = 0, l2_d_hits = 0, l2_d_misses = 0;
+HART_LOCAL uint64_t l2_write_hits = 0, l2_evictions = 0, l2_back_invalidations = 0;
+HART_LOCAL uint64_t l2_victim_inserts = 0, l2_bank_conflicts = 0, l2_bank_wait_cycles = 0;
+
+/*
+	configure_l2_cache mainly (re)allocates the L2 for the current settings,
+	the L2 starts out empty
+*/
+void configure_l2_cache(void){
+	free(l2_cache);
+	l2_sets  = l2_size / (L2_LINE_SIZE * l2_ways);
+	l2_cache = calloc(l2_sets * l2_ways, sizeof(struct model_l2_cache));
+	memset(l2_pending, 0, sizeof(l2_pending));
+	memset(l2_bank_free, 0, sizeof(l2_bank_free));
+	if(l2_cache == NULL){
+		fprintf(stderr, "L2: failed to allocate %" PRIu64 " bytes, L2 disabled\n", l2_size);
+		l2_enabled = 0;
+	}
+}
+
+/*
+	find_l2_line mainly looks for the line holding address
+	return NULL if no way of the set has the tag
+*/
+struct model_l2_cache* find_l2_line(uint64_t address){
+	uint64_t line = address / L2_LINE_SIZE;
+	struct model_l2_cache *set = &l2_cache[(line % l2_sets) * l2_ways];
+	for(uint64_t i = 0; i < l2_ways; i++){
+		if((set[i].valid_bit[0] || set[i].valid_bit[1]) && set[i].tag == line / l2_sets){
+			return &set[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+	invalidate_l1_lines mainly removes the L1 copies of an L2 line
+	so that an inclusive L2 stays a superset of the L1 caches
+*/
+void invalidate_l1_lines(uint64_t line_address){
+	invalidate_victim_cache(line_address, L2_LINE_SIZE);
+
+	int i_tag   = (line_address & 0xFFFFE000) >> 13;
+	int i_index = (line_address & 0x1FF0) >> 4;
+	if(i_cache[i_index].valid_bit == 1 && i_cache[i_index].tag == i_tag){
+		i_cache[i_index].valid_bit = 0;
+		l2_back_invalidations++;
+	}
+	for(uint64_t address = line_address; address < line_address + L2_LINE_SIZE; address += 8){
+		int d_tag   = (address & 0xFFFFC000) >> 14;
+		int d_index = (address & 0x3FF8) >> 3;
+		if(d_cache[d_index].valid_bit == 1 && d_cache[d_index].tag == d_tag){
+			d_cache[d_index].valid_bit = 0;
+			l2_back_invalidations++;
+		}
+	}
+}
+
+/*
+	allocate_l2_line mainly finds the line for address, or evicts the LRU
+	way of its set to make room for it
+*/
+struct model_l2_cache* allocate_l2_line(uint64_t address){
+	struct model_l2_cache *entry = find_l2_line(address);
+	if(entry != NULL){
+		return entry;
+	}
+	uint64_t line = address / L2_LINE_SIZE;
+	struct model_l2_cache *set = &l2_cache[(line % l2_sets) * l2_ways];
+	entry = &set[0];
+	for(uint64_t i = 0; i < l2_ways; i++){
+		if(!set[i].valid_bit[0] && !set[i].valid_bit[1]){
+			entry = &set[i];
 			break;
 		}
-		// if BTB reads the exact tag has the same value of pc, then setpc with stored target 
-		if(btb[i][0] == pc){
-			set_pc(btb[i][1]);
-			return i;
+		if(set[i].last_use < entry->last_use){
+			entry = &set[i];
+		}
+	}
+	if(entry->valid_bit[0] || entry->valid_bit[1]){
+		l2_evictions++;
+		if(l2_policy == L2_INCLUSIVE){
+			invalidate_l1_lines((entry->tag * l2_sets + (line % l2_sets)) * L2_LINE_SIZE);
 		}
 	}
-	btb[i][0] = pc; // add a new Tag
-	return 33;
+	entry->valid_bit[0] = 0;
+	entry->valid_bit[1] = 0;
+	entry->tag = line / l2_sets;
+	return entry;
 }
 
-void stage_fetch (struct stage_reg_d *new_d_reg){
-	//printf(">>>>> FETCH STAGE <<<<<\n");
+/*
+	fill_l2_cache mainly copies size_in_bytes (8 or 16) of data into the L2
+*/
+void fill_l2_cache(uint64_t address, const void *data, uint64_t size_in_bytes){
+	struct model_l2_cache *entry = allocate_l2_line(address);
+	int sector = (address >> 3) & 1;
+	memcpy(&entry->data[sector], data, size_in_bytes);
+	entry->valid_bit[sector] = 1;
+	if(size_in_bytes == L2_LINE_SIZE){
+		entry->valid_bit[1] = 1;
+	}
+	entry->last_use = ++l2_lru_clock;
+}
+
+/*
+	insert_l2_victim mainly catches lines evicted from the L1 caches,
+	only an exclusive L2 is filled this way
+*/
+void insert_l2_victim(uint64_t address, const void *data, uint64_t size_in_bytes){
+	if(!l2_enabled || l2_policy != L2_EXCLUSIVE){
+		return;
+	}
+	l2_victim_inserts++;
+	fill_l2_cache(address, data, size_in_bytes);
+}
+
+/*
+	memory_read_l2 mainly works like memory_read but looks in the L2 first
+*/
+bool memory_read_l2(uint64_t address, void *value, uint64_t size_in_bytes){
+	if((size_in_bytes != 8 && size_in_bytes != L2_LINE_SIZE) || address % size_in_bytes != 0){
+		return memory_read(address, value, size_in_bytes);
+	}
 	
-	uint32_t inst;
-	uint32_t full_inst[4];
-	full_inst[0]=0; full_inst[1]=0; full_inst[2]=0; full_inst[3]=0; 
-	uint32_t result_array[2]; // result[1] contains success status of cache, result[2] contains exact result
+	bool victim_hit = check_victim_cache(address, value, size_in_bytes);
+	if(!victim_hit && !l2_enabled){
+		return memory_read(address, value, size_in_bytes);
+	}
 	
-	if(cur_d_reg.i_cache_stall){
-		//printf("> ????pc is: 0x%016lx\n",cur_d_reg.pc);
-		if(memory_status(cur_d_reg.pc, &full_inst) || cur_d_reg.first_cache_stall){
-			//printf("> READ in x1\n");
-			if(cur_d_reg.first_cache_stall){
-				new_d_reg->first_cache_stall = false;
-				new_d_reg->i_cache_stall = false;
-				//printf("> READ in x2\n");
-			}else{
-				update_i_cache(i_cache, cur_d_reg.pc, full_inst);
-				//printf("0x%016lx\n",cur_d_reg.pc);
-				new_d_reg->i_cache_stall     = true;
-				new_d_reg->first_cache_stall = true;
-				//printf("> READ in x3\n");
-				return;
+	int sector = (address >> 3) & 1;
+	struct model_l2_cache *entry = victim_hit ? NULL : find_l2_line(address);
+	bool hit = victim_hit || ((entry != NULL) && entry->valid_bit[sector] && (size_in_bytes == 8 || entry->valid_bit[1]));
+	
+	// reuse the slot of this address, or any free or answered slot
+	struct model_l2_pending *pnd = NULL;
+	for(int i = 0; i < L2_MAX_PENDING; i++){
+		if(l2_pending[i].valid_bit && l2_pending[i].address == address){
+			pnd = &l2_pending[i];
+			break;
+		}
+	}
+	for(int i = 0; i < L2_MAX_PENDING && pnd == NULL; i++){
+		if(!l2_pending[i].valid_bit || l2_pending[i].done){
+			pnd = &l2_pending[i];
+		}
+	}
+	
+	if(!hit){
+		if(size_in_bytes == 8){
+			l2_d_misses++;
+		}else{
+			l2_i_misses++;
+		}
+		bool status = memory_read(address, value, size_in_bytes);
+		if(status){ // no memory latency
+			if(l2_policy != L2_EXCLUSIVE){
+				fill_l2_cache(address, value, size_in_bytes);
 			}
+		}else if(pnd != NULL){
+			memset(pnd, 0, sizeof(*pnd));
+			pnd->valid_bit = 1;
+			pnd->address   = address;
+			pnd->size      = size_in_bytes;
+		}
+		return status;
+	}
+	
+	uint64_t now   = get_cycle_counter();
+	uint64_t ready = now + VICTIM_LATENCY;
+	if(!victim_hit){
+		if(size_in_bytes == 8){
+			l2_d_hits++;
 		}else{
-			new_d_reg->i_cache_stall = true;
-			return;
+			l2_i_hits++;
+		}
+		memcpy(value, &entry->data[sector], size_in_bytes);
+		entry->last_use = ++l2_lru_clock;
+		if(l2_policy == L2_EXCLUSIVE){ // the line moves up into the L1
+			entry->valid_bit[sector] = 0;
+			if(size_in_bytes == L2_LINE_SIZE){
+				entry->valid_bit[1] = 0;
+			}
 		}
+		
+		// wait for the bank to be free, each bank starts one access per cycle
+		uint64_t bank  = (address / L2_LINE_SIZE) % l2_banks;
+		uint64_t start = now;
+		if(l2_bank_free[bank] > now){
+			start = l2_bank_free[bank];
+			l2_bank_conflicts++;
+			l2_bank_wait_cycles += start - now;
+		}
+		l2_bank_free[bank] = start + 1;
+		ready = start + l2_latency;
+	}
+	if(ready <= now || pnd == NULL){
+		return true;
 	}
 	
-	if(cur_w_reg.d_cache_stall){
+	memset(pnd, 0, sizeof(*pnd));
+	pnd->valid_bit   = 1;
+	pnd->hit         = 1;
+	pnd->address     = address;
+	pnd->size        = size_in_bytes;
+	pnd->ready_cycle = ready;
+	memcpy(pnd->data, value, size_in_bytes);
+	memset(value, 0, size_in_bytes);
+	return false;
+}
+
+/*
+	memory_status_l2 mainly works like memory_status for reads started
+	with memory_read_l2
+*/
+bool memory_status_l2(uint64_t address, void *value){
+	for(int i = 0; i < L2_MAX_PENDING; i++){
+		struct model_l2_pending *pnd = &l2_pending[i];
+		if(!pnd->valid_bit || pnd->address != address){
+			continue;
+		}
+		if(pnd->done){
+			return true;
+		}
+		if(pnd->hit){
+			if(get_cycle_counter() < pnd->ready_cycle){
+				return false;
+			}
+			memcpy(value, pnd->data, pnd->size);
+			pnd->done = 1;
+			return true;
+		}
+		if(!memory_status(address, value)){
+			return false;
+		}
+		if(l2_enabled && l2_policy != L2_EXCLUSIVE){
+			fill_l2_cache(address, value, pnd->size);
+		}
+		pnd->valid_bit = 0;
+		return true;
+	}
+	return memory_status(address, value);
+}
+
+/*
+	write_l2_copies mainly updates the copies of stored bytes below the
+	L1 caches: the victim cache, the L2 and L2 hits still in flight
+	return true on an L2 write hit
+*/
+bool write_l2_copies(uint64_t address, uint64_t value, uint64_t size_in_bytes){
+	write_victim_cache(address, value, size_in_bytes);
+	for(int i = 0; i < L2_MAX_PENDING; i++){
+		struct model_l2_pending *pnd = &l2_pending[i];
+		if(pnd->valid_bit && pnd->hit && !pnd->done && pnd->address <= address && address + size_in_bytes <= pnd->address + pnd->size){
+			memcpy((uint8_t *)pnd->data + (address - pnd->address), &value, size_in_bytes);
+		}
+	}
+	if(l2_enabled && size_in_bytes <= 8 && address % size_in_bytes == 0){
+		int sector = (address >> 3) & 1;
+		struct model_l2_cache *entry = find_l2_line(address);
+		if(entry != NULL && entry->valid_bit[sector]){
+			memcpy((uint8_t *)&entry->data[sector] + (address & 0x7), &value, size_in_bytes);
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+	memory_write_l2 mainly works like memory_write and updates the copies
+	of the written bytes in the L2, and in the d-caches of the other harts
+*/
+bool memory_write_l2(uint64_t address, uint64_t value, uint64_t size_in_bytes){
+	if(write_l2_copies(address, value, size_in_bytes)){
+		l2_write_hits++;
+	}
+	coherence_write(address, value, size_in_bytes);
+	return memory_write(address, value, size_in_bytes);
+}
+
+void print_l2_stats(void){
+	static const char *policy_name[] = {"NINE", "inclusive", "exclusive"};
+	if(!l2_enabled){
+		printf("L2 cache: disabled\n");
 		return;
 	}
+	printf("L2 cache (%" PRIu64 " KB, %" PRIu64 "-way, %" PRIu64 " banks, %" PRIu64 " cycles, %s):\n",
+		l2_size / 1024, l2_ways, l2_banks, l2_latency, policy_name[l2_policy]);
+	printf("  Instruction hits/misses: %" PRIu64 "/%" PRIu64 "\n", l2_i_hits, l2_i_misses);
+	printf("  Data hits/misses: %" PRIu64 "/%" PRIu64 "\n", l2_d_hits, l2_d_misses);
+	if(l2_i_hits + l2_i_misses + l2_d_hits + l2_d_misses > 0){
+		printf("  Hit rate: %.2f%%\n", 100.0 * (l2_i_hits + l2_d_hits) / (l2_i_hits + l2_i_misses + l2_d_hits + l2_d_misses));
+	}
+	printf("  Write hits: %" PRIu64 "\n", l2_write_hits);
+	printf("  Evictions: %" PRIu64 "\n", l2_evictions);
+	printf("  L1 back-invalidations: %" PRIu64 "\n", l2_back_invalidations);
+	printf("  L1 victims inserted: %" PRIu64 "\n", l2_victim_inserts);
+	printf("  Bank conflicts: %" PRIu64 " (%" PRIu64 " cycles)\n", l2_bank_conflicts, l2_bank_wait_cycles);
+}
+
+/*
+	Coherence between the d-caches of the harts (MESI)
+		-a valid d-cache line is Modified, Exclusive or Shared, Invalid is
+		 valid_bit 0; with one hart every fill is Exclusive and no other
+		 hart is ever looked at
+		-the memory stages of the harts take turns (the framework holds a
+		 lock around them), so a hart looks at and changes the d-cache lines
+		 of the others directly, like a bus every d-cache snoops at once
+		-a fill (BusRd) is Shared if another d-cache has the line, whose copy
+		 drops to Shared too (an intervention if it was Modified/Exclusive),
+		 else Exclusive
+		-a store to a Shared line (BusUpgr) or to a line the d-cache does not
+		 have (BusWr, the d-cache still does not allocate) invalidates the
+		 other copies; a store to an Exclusive line turns it Modified quietly
+		-the d-cache stays write-through, memory always has the data and
+		 Modified only means no other hart has a copy
+		-a miss that needs an intervention, and a store or atomic that needs
+		 to invalidate copies, holds memory stage coherence_latency cycles
+		 first (setopt coherence_latency); requests no other d-cache has to
+		 answer cost nothing extra, as if a directory filtered them
+		-the victim cache and L2 of a hart are private and get the stores of
+		 the other harts written into them at the start of its next memory
+		 stage, which also covers L2 hits still in flight
+	A load miss on a line whose copy was invalidated since the hart last had
+	it is a coherence miss: true sharing if it loads a byte the other harts
+	wrote in the meantime, false sharing if not. These counts are kept per
+	line in a table all harts share, hart 0 prints its busiest lines.
+*/
+#define COHERENCE_MAX_LINES    4096
+#define COHERENCE_REPORT_LINES 8
+
+// a store of another hart to apply to the victim cache and L2
+struct model_coherence_update{
+	uint64_t address;
+	uint64_t value;
+	uint64_t size;
+};
+
+struct model_coherence_line{
+	int      valid_bit;
+	uint64_t address;           // d-cache line address
+	uint64_t invalidations;
+	uint64_t true_sharing;      // coherence misses that load bytes another hart wrote
+	uint64_t false_sharing;     // coherence misses that only load other bytes
+	uint8_t  harts;             // bit mask of the harts that wrote it or lost a copy
+	bool     lost[HART_MAX];    // the hart's copy was invalidated and it has not missed since
+	uint8_t  written[HART_MAX]; // bytes other harts wrote since then
+};
+
+// shared by all harts, only used in memory stage
+struct model_d_cache *coherence_d_cache[HART_MAX];
+bool     coherence_posts[HART_MAX]; // the hart has a victim cache or L2 to keep up to date
+struct model_coherence_update *coherence_updates[HART_MAX];
+uint64_t coherence_update_count[HART_MAX], coherence_update_room[HART_MAX];
+uint64_t coherence_invalidations_received[HART_MAX];
+int      coherence_harts = 0;
+struct model_coherence_line coherence_lines[COHERENCE_MAX_LINES];
+uint64_t coherence_untracked = 0;
+
+// a memory access held until the other d-caches answer
+struct model_coherence_wait{
+	bool     waiting;
+	uint64_t line;
+	uint64_t ready_cycle;
+};
+
+HART_LOCAL uint64_t coherence_latency = 4;
+HART_LOCAL struct model_coherence_wait coherence_demand; // the access of memory stage
+HART_LOCAL struct model_coherence_wait coherence_drain;  // the store buffer
+
+HART_LOCAL uint64_t coherence_bus_reads = 0, coherence_bus_upgrades = 0, coherence_bus_writes = 0;
+HART_LOCAL uint64_t coherence_invalidations = 0, coherence_interventions = 0, coherence_stall_cycles = 0;
+HART_LOCAL uint64_t coherence_true_misses = 0, coherence_false_misses = 0;
+
+/*
+	coherence_copy mainly looks for the line holding address in the d-cache
+	of a hart
+	return NULL if that d-cache does not have it
+*/
+struct model_d_cache* coherence_copy(int hart, uint64_t address){
+	struct model_d_cache *cache = coherence_d_cache[hart];
+	uint32_t tag   = (address & 0xFFFFC000) >> 14;
+	int      index = (address & 0x3FF8) >> 3;
+	if(cache == NULL || cache[index].valid_bit != 1 || cache[index].tag != tag){
+		return NULL;
+	}
+	return &cache[index];
+}
+
+/*
+	coherence_find_line mainly looks for the table entry of a d-cache line,
+	or takes a free one if allocate is set
+	return NULL if the line is not tracked
+*/
+struct model_coherence_line* coherence_find_line(uint64_t line_address, bool allocate){
+	uint64_t slot = ((line_address >> 3) * 0x9E3779B97F4A7C15ULL) >> 52; // 4096 slots
+	for(int i = 0; i < COHERENCE_MAX_LINES; i++){
+		struct model_coherence_line *line = &coherence_lines[(slot + i) % COHERENCE_MAX_LINES];
+		if(line->valid_bit && line->address == line_address){
+			return line;
+		}
+		if(!line->valid_bit){
+			if(!allocate){
+				return NULL;
+			}
+			memset(line, 0, sizeof(*line));
+			line->valid_bit = 1;
+			line->address   = line_address;
+			return line;
+		}
+	}
+	if(allocate){
+		coherence_untracked++;
+	}
+	return NULL;
+}
+
+/*
+	coherence_start mainly runs at the start of memory stage, it makes the
+	d-cache of this hart known to the others and applies the stores they
+	posted for its victim cache and L2
+*/
+void coherence_start(void){
+	int me = get_hart_id();
+	if(coherence_d_cache[me] == NULL){
+		coherence_d_cache[me] = d_cache;
+		coherence_harts++;
+	}
+	coherence_posts[me] = victim_enabled || l2_enabled;
+	for(uint64_t i = 0; i < coherence_update_count[me]; i++){
+		struct model_coherence_update *update = &coherence_updates[me][i];
+		write_l2_copies(update->address, update->value, update->size);
+	}
+	coherence_update_count[me] = 0;
+}
+
+/*
+	coherence_fill mainly does the bus read of a line coming into the d-cache
+	return the state of the new line
+*/
+int coherence_fill(uint64_t address){
+	int  me     = get_hart_id();
+	bool shared = false;
+	if(coherence_harts < 2){
+		return MESI_EXCLUSIVE;
+	}
+	coherence_bus_reads++;
+	for(int h = 0; h < HART_MAX; h++){
+		struct model_d_cache *copy = (h == me) ? NULL : coherence_copy(h, address);
+		if(copy != NULL){
+			shared = true;
+			if(copy->mesi_state != MESI_SHARED){
+				copy->mesi_state = MESI_SHARED;
+				coherence_interventions++;
+			}
+		}
+	}
+	struct model_coherence_line *line = coherence_find_line(address & ~0x7ULL, false);
+	if(line != NULL){
+		line->lost[me] = false;
+	}
+	return shared ? MESI_SHARED : MESI_EXCLUSIVE;
+}
+
+/*
+	coherence_write mainly does the bus side of a store that goes to memory:
+	the other copies are invalidated and this hart's copy becomes Modified
+*/
+void coherence_write(uint64_t address, uint64_t value, uint64_t size_in_bytes){
+	int      me   = get_hart_id();
+	uint8_t  mask = ((1 << size_in_bytes) - 1) << (address & 0x7);
+	struct model_d_cache *own = coherence_copy(me, address);
+	if(coherence_harts < 2){
+		if(own != NULL){
+			own->mesi_state = MESI_MODIFIED;
+		}
+		return;
+	}
+	if(own == NULL){
+		coherence_bus_writes++;
+	}else if(own->mesi_state == MESI_SHARED){
+		coherence_bus_upgrades++;
+	}
+	
+	struct model_coherence_line *line = coherence_find_line(address & ~0x7ULL, false);
+	for(int h = 0; h < HART_MAX; h++){
+		if(h == me || coherence_d_cache[h] == NULL){
+			continue;
+		}
+		if(coherence_posts[h]){
+			if(coherence_update_count[h] == coherence_update_room[h]){
+				coherence_update_room[h] = coherence_update_room[h] ? 2 * coherence_update_room[h] : 64;
+				coherence_updates[h] = realloc(coherence_updates[h], coherence_update_room[h] * sizeof(struct model_coherence_update));
+			}
+			struct model_coherence_update *update = &coherence_updates[h][coherence_update_count[h]++];
+			update->address = address;
+			update->value   = value;
+			update->size    = size_in_bytes;
+		}
+		struct model_d_cache *copy = coherence_copy(h, address);
+		if(copy != NULL){
+			copy->valid_bit = 0;
+			coherence_invalidations++;
+			coherence_invalidations_received[h]++;
+			if(line == NULL){
+				line = coherence_find_line(address & ~0x7ULL, true);
+			}
+			if(line != NULL){
+				line->invalidations++;
+				line->harts     |= (1 << h) | (1 << me);
+				line->lost[h]    = true;
+				line->written[h] = mask;
+			}
+		}else if(line != NULL && line->lost[h]){
+			line->written[h] |= mask;
+		}
+	}
+	if(own != NULL){
+		own->mesi_state = MESI_MODIFIED;
+	}
+}
+
+/*
+	coherence_miss mainly sorts a load miss of size_in_bytes, a line this hart
+	lost to another hart's store makes it a true or false sharing miss
+*/
+void coherence_miss(uint64_t address, uint64_t size_in_bytes){
+	int me = get_hart_id();
+	struct model_coherence_line *line = coherence_find_line(address & ~0x7ULL, false);
+	if(line == NULL || !line->lost[me]){
+		return;
+	}
+	line->lost[me] = false;
+	if(line->written[me] & (((1 << size_in_bytes) - 1) << (address & 0x7))){
+		line->true_sharing++;
+		coherence_true_misses++;
+	}else{
+		line->false_sharing++;
+		coherence_false_misses++;
+	}
+}
+
+/*
+	coherence_access mainly holds a load that missed in the d-cache, or a
+	store on its way to memory, until the other d-caches answer: an
+	intervention for the load, the invalidations for the store
+	return true while the access has to wait
+*/
+bool coherence_access(struct model_coherence_wait *wait, uint64_t address, uint64_t size_in_bytes, bool write){
+	int      me   = get_hart_id();
+	uint64_t line = address & ~0x7ULL;
+	uint64_t now  = get_cycle_counter();
+	
+	if(coherence_harts < 2){
+		return false;
+	}
+	if(wait->waiting && wait->line == line){
+		if(now < wait->ready_cycle){
+			coherence_stall_cycles++;
+			return true;
+		}
+		wait->waiting = false;
+		return false;
+	}
+	wait->waiting = false;
+	if(!write){
+		coherence_miss(address, size_in_bytes);
+	}
+	
+	struct model_d_cache *own = coherence_copy(me, address);
+	bool answer = false;
+	if(own == NULL || (write && own->mesi_state == MESI_SHARED)){
+		for(int h = 0; h < HART_MAX; h++){
+			struct model_d_cache *copy = (h == me) ? NULL : coherence_copy(h, address);
+			if(copy != NULL && (write || copy->mesi_state != MESI_SHARED)){
+				answer = true;
+			}
+		}
+	}
+	if(!answer || coherence_latency == 0){
+		return false;
+	}
+	wait->waiting     = true;
+	wait->line        = line;
+	wait->ready_cycle = now + coherence_latency;
+	coherence_stall_cycles++;
+	return true;
+}
+
+void print_coherence_stats(void){
+	if(coherence_harts < 2){
+		return;
+	}
+	printf("Coherence (MESI, %" PRIu64 " cycles to invalidate or intervene):\n", coherence_latency);
+	printf("  Bus reads/upgrades/writes: %" PRIu64 "/%" PRIu64 "/%" PRIu64 "\n", coherence_bus_reads, coherence_bus_upgrades, coherence_bus_writes);
+	printf("  Invalidations sent/received: %" PRIu64 "/%" PRIu64 "\n", coherence_invalidations, coherence_invalidations_received[get_hart_id()]);
+	printf("  Interventions: %" PRIu64 "\n", coherence_interventions);
+	printf("  Coherence misses (true/false sharing): %" PRIu64 "/%" PRIu64 "\n", coherence_true_misses, coherence_false_misses);
+	printf("  Memory stage stall cycles: %" PRIu64 "\n", coherence_stall_cycles);
+	if(get_hart_id() != 0){
+		return;
+	}
+	
+	// the lines with the most invalidations over all harts
+	struct model_coherence_line *shown[COHERENCE_REPORT_LINES];
+	int n;
+	for(n = 0; n < COHERENCE_REPORT_LINES; n++){
+		struct model_coherence_line *best = NULL;
+		for(int i = 0; i < COHERENCE_MAX_LINES; i++){
+			struct model_coherence_line *line = &coherence_lines[i];
+			bool taken = false;
+			for(int j = 0; j < n; j++){
+				taken = taken || shown[j] == line;
+			}
+			if(line->valid_bit && !taken && (best == NULL || line->invalidations > best->invalidations)){
+				best = line;
+			}
+		}
+		if(best == NULL){
+			break;
+		}
+		shown[n] = best;
+	}
+	if(n > 0){
+		printf("  Lines with the most invalidations (all harts):\n");
+	}
+	for(int i = 0; i < n; i++){
+		printf("    0x%08" PRIx64 ": %" PRIu64 " invalidations, misses %" PRIu64 " true/%" PRIu64 " false sharing, harts",
+		       shown[i]->address, shown[i]->invalidations, shown[i]->true_sharing, shown[i]->false_sharing);
+		for(int h = 0; h < HART_MAX; h++){
+			if(shown[i]->harts & (1 << h)){
+				printf(" %d", h);
+			}
+		}
+		printf("%s\n", shown[i]->false_sharing > shown[i]->true_sharing ? " (false sharing)" : "");
+	}
+	if(coherence_untracked > 0){
+		printf("  Invalidations on lines not tracked (table full): %" PRIu64 "\n", coherence_untracked);
+	}
+}
+
+/*
+	Store buffer in front of memory_write
+		-Stores leave stage_memory into the buffer instead of writing memory
+		-Each entry holds one 8-byte d-cache line and a byte mask, stores to a
+		 line that is already buffered are combined into its entry
+		-Loads take buffered bytes over the bytes from the d-cache, a load
+		 fully covered by the buffer does not touch the d-cache at all
+		-Entries retire in order when the M stage leaves its memory access
+		 unused, one naturally aligned piece of an entry per write
+		-Writes do not wait for each other, as many are in flight as the
+		 data slots of the framework left over by the prefetcher allow
+		-A full buffer, or a fence with stores still buffered, stalls the M stage
+	Retiring a piece updates memory, the victim caches, the L2 and the d-cache.
+*/
+#define STORE_BUFFER_MAX_DEPTH 32
+#define MEMORY_DATA_SLOTS      2    // framework only has 2 data slots in memory_pending
+
+struct model_store_buffer{
+	uint64_t address; // line address
+	uint64_t data;
+	uint8_t  mask;    // bytes of data still to be written
+};
+
+HART_LOCAL struct model_store_buffer store_buffer[STORE_BUFFER_MAX_DEPTH];
+HART_LOCAL int store_buffer_enabled = 0;
+HART_LOCAL int store_buffer_depth   = 8;
+HART_LOCAL int store_buffer_count   = 0;
+
+// writes sent to memory and waiting on memory_write_status
+HART_LOCAL int      store_buffer_inflight = 0;
+HART_LOCAL uint64_t store_buffer_inflight_address[MEMORY_DATA_SLOTS];
+
+HART_LOCAL uint64_t sb_stores = 0, sb_combined = 0, sb_writes = 0, sb_forward_full = 0, sb_forward_partial = 0;
+HART_LOCAL uint64_t sb_full_stall_cycles = 0, sb_fence_stall_cycles = 0, sb_max_count = 0;
+
+/*
+	find_store_buffer mainly looks for the entry of a line
+	return -1 if the line is not buffered
+*/
+int find_store_buffer(uint64_t line_address){
+	for(int i = 0; i < store_buffer_count; i++){
+		if(store_buffer[i].address == line_address){
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+	insert_store_buffer mainly buffers a store of size_in_bytes
+	return false if the buffer is full and the M stage needs to stall
+*/
+bool insert_store_buffer(uint64_t address, uint64_t value, uint64_t size_in_bytes){
+	uint64_t line   = address & ~0x7ULL;
+	int      offset = address & 0x7;
+	uint8_t  mask   = ((1 << size_in_bytes) - 1) << offset;
+	int      i      = find_store_buffer(line);
+	
+	if(i < 0){
+		if(store_buffer_count == store_buffer_depth){
+			return false;
+		}
+		i = store_buffer_count++;
+		store_buffer[i].address = line;
+		store_buffer[i].data    = 0;
+		store_buffer[i].mask    = 0;
+	}else{
+		sb_combined++;
+	}
+	memcpy((uint8_t *)&store_buffer[i].data + offset, &value, size_in_bytes);
+	store_buffer[i].mask |= mask;
+	sb_stores++;
+	if(store_buffer_count > sb_max_count){
+		sb_max_count = store_buffer_count;
+	}
+	return true;
+}
+
+/*
+	forward_store_buffer mainly lays the buffered bytes of a load over value,
+	which holds the load's bytes as read from the d-cache
+	return SB_FORWARD_NONE, SB_FORWARD_PARTIAL or SB_FORWARD_FULL
+*/
+#define SB_FORWARD_NONE        0
+#define SB_FORWARD_PARTIAL     1
+#define SB_FORWARD_FULL        2
+
+int forward_store_buffer(uint64_t address, uint64_t size_in_bytes, uint64_t *value){
+	int i = find_store_buffer(address & ~0x7ULL);
+	if(!store_buffer_enabled || i < 0){
+		return SB_FORWARD_NONE;
+	}
+	int     offset = address & 0x7;
+	uint8_t mask   = ((1 << size_in_bytes) - 1) << offset;
+	uint8_t hit    = store_buffer[i].mask & mask;
+	for(uint64_t b = 0; b < size_in_bytes; b++){
+		if(hit & (1 << (offset + b))){
+			((uint8_t *)value)[b] = ((uint8_t *)&store_buffer[i].data)[offset + b];
+		}
+	}
+	if(hit == 0){
+		return SB_FORWARD_NONE;
+	}
+	return (hit == mask) ? SB_FORWARD_FULL : SB_FORWARD_PARTIAL;
+}
+
+/*
+	drain_store_buffer mainly retires the oldest entry piece by piece,
+	only call it when the M stage has not done a memory access this cycle,
+	free_slots is the number of data slots the prefetcher does not use
+	return true if it used the memory access
+*/
+bool drain_store_buffer(int free_slots){
+	for(int i = 0; i < store_buffer_inflight; ){
+		if(memory_write_status(store_buffer_inflight_address[i])){
+			store_buffer_inflight_address[i] = store_buffer_inflight_address[--store_buffer_inflight];
+		}else{
+			i++;
+		}
+	}
+	if(store_buffer_count == 0 || store_buffer_inflight >= free_slots){
+		return false;
+	}
+	
+	// largest naturally aligned piece starting at the lowest buffered byte
+	struct model_store_buffer *entry = &store_buffer[0];
+	int offset = __builtin_ctz(entry->mask);
+	uint64_t size = 8;
+	while(offset % size != 0 || (entry->mask & (((1 << size) - 1) << offset)) != (((1 << size) - 1) << offset)){
+		size = size / 2;
+	}
+	uint64_t value = 0;
+	memcpy(&value, (uint8_t *)&entry->data + offset, size);
+	if(coherence_access(&coherence_drain, entry->address + offset, size, true)){
+		return false;
+	}
+	
+	sb_writes++;
+	if(!memory_write_l2(entry->address + offset, value, size)){
+		store_buffer_inflight_address[store_buffer_inflight++] = entry->address + offset;
+	}
+	write_d_cache(d_cache, entry->address + offset, value, size);
+	entry->mask &= ~(((1 << size) - 1) << offset);
+	if(entry->mask == 0){
+		memmove(&store_buffer[0], &store_buffer[1], sizeof(store_buffer[0]) * (store_buffer_count - 1));
+		store_buffer_count--;
+	}
+	return true;
+}
+
+void print_store_buffer_stats(void){
+	if(!store_buffer_enabled){
+		printf("Store buffer: disabled\n");
+		return;
+	}
+	printf("Store buffer (%d entries):\n", store_buffer_depth);
+	printf("  Stores buffered: %" PRIu64 " (combined: %" PRIu64 ")\n", sb_stores, sb_combined);
+	printf("  Memory writes: %" PRIu64 "\n", sb_writes);
+	printf("  Loads forwarded fully/partially: %" PRIu64 "/%" PRIu64 "\n", sb_forward_full, sb_forward_partial);
+	printf("  Full stall cycles: %" PRIu64 "\n", sb_full_stall_cycles);
+	printf("  Fence drain cycles: %" PRIu64 "\n", sb_fence_stall_cycles);
+	printf("  Maximum occupancy: %" PRIu64 "\n", sb_max_count);
+}
+
+/*
+	D-cache prefetcher
+		-Stride: Reference Prediction Table (RPT) indexed by the pc of the load,
+		         predicts addr + stride once the same stride is seen twice
+		-Stream: detects misses to consecutive lines and runs ahead of them
+	Prefetches are issued in stage_memory through memory_read_l2 when the
+	M stage has not used its memory access for this cycle.
+*/
+#define PREFETCH_NONE          0
+#define PREFETCH_STRIDE        1
+#define PREFETCH_STREAM        2
+#define PREFETCH_BOTH          3
+
+#define RPT_SIZE               64
+#define STREAM_SIZE            8
+#define PREFETCH_QUEUE_SIZE    16
+#define PREFETCH_MAX_INFLIGHT  MEMORY_DATA_SLOTS
+#define PREFETCH_MAX_DEGREE    8
+#define PREFETCH_TIMEOUT       4096 // drop a prefetch whose memory_pending slot was never granted
+#define PREFETCH_INTERVAL      64   // prefetches evaluated before the throttle is adjusted
+
+// RPT states
+#define RPT_INITIAL            0
+#define RPT_TRANSIENT          1
+#define RPT_STEADY             2
+#define RPT_NO_PRED            3
+
+struct model_rpt{
+	int      valid_bit;
+	uint64_t tag; // pc of the load
+	uint64_t prev_addr;
+	int64_t  stride;
+	int      state;
+};
+
+struct model_stream{
+	int      valid_bit;
+	uint64_t next_line; // next line address expected from this stream
+	uint64_t last_use;
+	int      confidence;
+};
+
+struct model_prefetch{
+	uint64_t address;
+	uint64_t issue_cycle;
+	bool     wrong_path; // a fill for a wrong-path load, not a prefetch
+};
+
+HART_LOCAL struct model_rpt      rpt[RPT_SIZE];
+HART_LOCAL struct model_stream   stream_table[STREAM_SIZE];
+HART_LOCAL struct model_prefetch prefetch_queue[PREFETCH_QUEUE_SIZE];
+HART_LOCAL struct model_prefetch prefetch_inflight[PREFETCH_MAX_INFLIGHT];
+HART_LOCAL int prefetch_queue_count    = 0;
+HART_LOCAL int prefetch_inflight_count = 0;
+
+HART_LOCAL int prefetch_mode   = PREFETCH_NONE;
+HART_LOCAL int prefetch_degree = 2;
+
+// tag evicted by a prefetch fill in each d-cache index, used to count pollution
+HART_LOCAL uint32_t prefetch_victim_tag[2048];
+HART_LOCAL int      prefetch_victim_valid[2048];
+
+HART_LOCAL uint64_t pf_issued = 0, pf_useful = 0, pf_useless = 0, pf_late = 0, pf_dropped = 0;
+HART_LOCAL uint64_t pf_pollution = 0, pf_demand_misses = 0, pf_demand_loads = 0;
+HART_LOCAL uint64_t pf_window_useful = 0, pf_window_total = 0, pf_throttle_down = 0, pf_throttle_up = 0;
+
+// wrong-path execution, see wrong_path_execute()
+HART_LOCAL bool     wrong_path_enabled = false;
+HART_LOCAL uint32_t wrong_path_victim_tag[2048];
+HART_LOCAL int      wrong_path_victim_valid[2048];
+HART_LOCAL uint64_t wp_instructions = 0, wp_loads = 0, wp_hits = 0, wp_fills = 0, wp_i_fills = 0;
+HART_LOCAL uint64_t wp_useful = 0, wp_useless = 0, wp_pollution = 0;
+
+/*
+	prefetch_evaluate mainly adjusts the degree from the accuracy of the
+	last PREFETCH_INTERVAL prefetches that were either used or evicted
+*/
+void prefetch_evaluate(bool useful){
+	pf_window_total++;
+	if(useful){
+		pf_window_useful++;
+	}
+	if(pf_window_total < PREFETCH_INTERVAL){
+		return;
+	}
+	if(pf_window_useful * 4 < pf_window_total){ // accuracy below 25%
+		if(prefetch_degree > 1){ // keep one prefetch going so accuracy can still be measured
+			prefetch_degree--;
+			pf_throttle_down++;
+		}
+	}else if(pf_window_useful * 4 >= pf_window_total * 3){ // accuracy at least 75%
+		if(prefetch_degree > 0 && prefetch_degree < PREFETCH_MAX_DEGREE){
+			prefetch_degree++;
+			pf_throttle_up++;
+		}
+	}
+	pf_window_useful = 0;
+	pf_window_total  = 0;
+}
+
+/*
+	prefetch_enqueue mainly puts a line address into the prefetch queue
+	unless it is already cached, queued or in flight
+*/
+void prefetch_enqueue(uint64_t address, bool wrong_path){
+	address = address & 0xFFFFFFF8;
+	int tag   = (address & 0xFFFFC000) >> 14;
+	int index = (address & 0x3FF8) >> 3;
+	
+	if(d_cache[index].valid_bit == 1 && d_cache[index].tag == tag){
+		return;
+	}
+	for(int i = 0; i < prefetch_queue_count; i++){
+		if(prefetch_queue[i].address == address){
+			return;
+		}
+	}
+	for(int i = 0; i < prefetch_inflight_count; i++){
+		if(prefetch_inflight[i].address == address){
+			return;
+		}
+	}
+	if(prefetch_queue_count == PREFETCH_QUEUE_SIZE){ // queue full: drop the oldest request
+		memmove(&prefetch_queue[0], &prefetch_queue[1], sizeof(prefetch_queue[0]) * (PREFETCH_QUEUE_SIZE - 1));
+		prefetch_queue_count--;
+		pf_dropped++;
+	}
+	prefetch_queue[prefetch_queue_count].address    = address;
+	prefetch_queue[prefetch_queue_count].wrong_path = wrong_path;
+	prefetch_queue_count++;
+}
+
+/*
+	prefetch_fill mainly puts a prefetched line into the d-cache,
+	remembering the line it evicted so that pollution can be counted
+*/
+void prefetch_fill(uint64_t address, uint64_t data, bool wrong_path){
+	int tag   = (address & 0xFFFFC000) >> 14;
+	int index = (address & 0x3FF8) >> 3;
+	
+	if(d_cache[index].valid_bit == 1){
+		if(d_cache[index].tag == tag){ // a demand fill beat the prefetch
+			return;
+		}
+		if(d_cache[index].prefetch_bit){ // previous prefetch was never used
+			pf_useless++;
+			prefetch_evaluate(false);
+			prefetch_victim_valid[index] = 0;
+		}else if(d_cache[index].wrong_path_bit){
+			wp_useless++;
+			wrong_path_victim_valid[index] = 0;
+		}else if(wrong_path){
+			wrong_path_victim_tag[index]   = d_cache[index].tag;
+			wrong_path_victim_valid[index] = 1;
+		}else{
+			prefetch_victim_tag[index]   = d_cache[index].tag;
+			prefetch_victim_valid[index] = 1;
+		}
+	}
+	update_d_cache(d_cache, address, data);
+	if(wrong_path){
+		d_cache[index].wrong_path_bit = 1;
+	}else{
+		d_cache[index].prefetch_bit = 1;
+	}
+}
+
+/*
+	prefetch_train mainly updates the RPT and stream table with a load
+	executed in stage_memory and queues the predicted addresses,
+	once per load: not again when the load replays after its miss
+*/
+void prefetch_train(uint64_t pc, uint64_t address, bool hit){
+	if(prefetch_mode == PREFETCH_NONE){
+		return;
+	}
+	int tag   = (address & 0xFFFFC000) >> 14;
+	int index = (address & 0x3FF8) >> 3;
+	bool first_use = false;
+	
+	pf_demand_loads++;
+	if(hit){
+		if(d_cache[index].prefetch_bit){ // first use of a prefetched line
+			first_use = true;
+			d_cache[index].prefetch_bit = 0;
+			pf_useful++;
+			prefetch_evaluate(true);
+		}
+	}else{
+		pf_demand_misses++;
+		if(prefetch_victim_valid[index] && prefetch_victim_tag[index] == tag){
+			pf_pollution++;
+		}
+		prefetch_victim_valid[index] = 0;
+		if(d_cache[index].valid_bit == 1 && d_cache[index].prefetch_bit){ // the demand fill evicts an unused prefetch
+			d_cache[index].prefetch_bit = 0;
+			pf_useless++;
+			prefetch_evaluate(false);
+		}
+	}
+	
+	if(prefetch_mode & PREFETCH_STRIDE){
+		struct model_rpt *entry = &rpt[(pc >> 2) % RPT_SIZE];
+		if(!entry->valid_bit || entry->tag != pc){
+			entry->valid_bit = 1;
+			entry->tag       = pc;
+			entry->prev_addr = address;
+			entry->stride    = 0;
+			entry->state     = RPT_INITIAL;
+		}else{
+			int64_t stride  = (int64_t)(address - entry->prev_addr);
+			bool    correct = (stride == entry->stride);
+			switch(entry->state){
+				case RPT_INITIAL:
+					entry->state = correct ? RPT_STEADY : RPT_TRANSIENT;
+					break;
+				case RPT_TRANSIENT:
+					entry->state = correct ? RPT_STEADY : RPT_NO_PRED;
+					break;
+				case RPT_STEADY:
+					entry->state = correct ? RPT_STEADY : RPT_INITIAL;
+					break;
+				case RPT_NO_PRED:
+					entry->state = correct ? RPT_TRANSIENT : RPT_NO_PRED;
+					break;
+			}
+			if(!correct && entry->state != RPT_INITIAL){
+				entry->stride = stride;
+			}
+			entry->prev_addr = address;
+			if(entry->state == RPT_STEADY && entry->stride != 0){
+				for(int i = 1; i <= prefetch_degree; i++){
+					prefetch_enqueue(address + entry->stride * i, false);
+				}
+			}
+		}
+	}
+	
+	// a stream moves on with every miss and with the first use of a line it
+	// prefetched, otherwise it would fall behind as soon as it is on time
+	if((prefetch_mode & PREFETCH_STREAM) && (!hit || first_use)){
+		uint64_t line = address & 0xFFFFFFF8;
+		int victim = 0;
+		for(int i = 0; i < STREAM_SIZE; i++){
+			if(stream_table[i].valid_bit && stream_table[i].next_line == line){
+				stream_table[i].next_line  = line + 8;
+				stream_table[i].last_use   = get_cycle_counter();
+				if(stream_table[i].confidence < 2){
+					stream_table[i].confidence++;
+				}
+				if(stream_table[i].confidence >= 2){
+					for(int j = 1; j <= prefetch_degree; j++){
+						prefetch_enqueue(line + 8 * j, false);
+					}
+				}
+				return;
+			}
+			if(!stream_table[i].valid_bit){
+				victim = i;
+			}else if(stream_table[victim].valid_bit && stream_table[i].last_use < stream_table[victim].last_use){
+				victim = i;
+			}
+		}
+		if(hit){ // a prefetch from the RPT, not the start of a stream
+			return;
+		}
+		// no stream follows this miss: start a new one
+		stream_table[victim].valid_bit  = 1;
+		stream_table[victim].next_line  = line + 8;
+		stream_table[victim].last_use   = get_cycle_counter();
+		stream_table[victim].confidence = 0;
+	}
+}
+
+/*
+	prefetch_poll mainly collects prefetches that have come back from memory,
+	it needs to run every cycle so that finished memory_pending slots are freed
+*/
+void prefetch_poll(void){
+	uint64_t data;
+	int i = 0;
+	while(i < prefetch_inflight_count){
+		data = 0;
+		if(memory_status_l2(prefetch_inflight[i].address, &data)){
+			prefetch_fill(prefetch_inflight[i].address, data, prefetch_inflight[i].wrong_path);
+		}else if(get_cycle_counter() - prefetch_inflight[i].issue_cycle < PREFETCH_TIMEOUT){
+			i++;
+			continue;
+		}else{
+			pf_dropped++;
+		}
+		prefetch_inflight[i] = prefetch_inflight[prefetch_inflight_count - 1];
+		prefetch_inflight_count--;
+	}
+}
+
+/*
+	prefetch_issue mainly sends the oldest queued prefetch to memory,
+	only call it when the M stage has not done a memory access this cycle
+*/
+void prefetch_issue(void){
+	uint64_t data = 0;
+	if(prefetch_queue_count == 0 || prefetch_inflight_count + store_buffer_inflight >= PREFETCH_MAX_INFLIGHT ||
+	   (prefetch_degree == 0 && !prefetch_queue[0].wrong_path)){
+		return;
+	}
+	uint64_t address    = prefetch_queue[0].address;
+	bool     wrong_path = prefetch_queue[0].wrong_path;
+	memmove(&prefetch_queue[0], &prefetch_queue[1], sizeof(prefetch_queue[0]) * (PREFETCH_QUEUE_SIZE - 1));
+	prefetch_queue_count--;
+	
+	if(wrong_path){
+		wp_fills++;
+	}else{
+		pf_issued++;
+	}
+	if(memory_read_l2(address, &data, 8)){ // no read latency
+		prefetch_fill(address, data, wrong_path);
+	}else{
+		prefetch_inflight[prefetch_inflight_count].address     = address;
+		prefetch_inflight[prefetch_inflight_count].issue_cycle = get_cycle_counter();
+		prefetch_inflight[prefetch_inflight_count].wrong_path  = wrong_path;
+		prefetch_inflight_count++;
+	}
+}
+
+/*
+	prefetch_claim mainly hands an in-flight prefetch over to a demand miss
+	to the same line, so the load waits for it instead of reading again
+*/
+bool prefetch_claim(uint64_t address){
+	for(int i = 0; i < prefetch_inflight_count; i++){
+		if(prefetch_inflight[i].address == address){
+			if(prefetch_inflight[i].wrong_path){ // the wrong path started the miss early
+				wp_useful++;
+			}else{
+				pf_late++;
+				pf_useful++;
+				prefetch_evaluate(true);
+			}
+			prefetch_inflight[i] = prefetch_inflight[prefetch_inflight_count - 1];
+			prefetch_inflight_count--;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+	memory_port_idle mainly gives an unused M stage memory access to the
+	store buffer first and to the prefetcher otherwise
+*/
+void memory_port_idle(void){
+	if(!drain_store_buffer(MEMORY_DATA_SLOTS - prefetch_inflight_count)){
+		prefetch_issue();
+	}
+}
+
+void print_prefetch_stats(void){
+	printf("D-cache prefetcher (mode %d, degree %d):\n", prefetch_mode, prefetch_degree);
+	printf("  Prefetches issued: %" PRIu64 "\n", pf_issued);
+	printf("  Useful: %" PRIu64 " (late: %" PRIu64 ")\n", pf_useful, pf_late);
+	printf("  Useless (evicted unused): %" PRIu64 "\n", pf_useless);
+	printf("  Dropped: %" PRIu64 "\n", pf_dropped);
+	printf("  Pollution misses: %" PRIu64 "\n", pf_pollution);
+	printf("  Throttle down/up: %" PRIu64 "/%" PRIu64 "\n", pf_throttle_down, pf_throttle_up);
+	if(pf_issued > 0){
+		printf("  Accuracy: %.2f%%\n", 100.0 * pf_useful / pf_issued);
+	}
+	if(pf_useful - pf_late + pf_demand_misses > 0){ // late prefetches still show up as demand misses
+		printf("  Coverage: %.2f%%\n", 100.0 * (pf_useful - pf_late) / (pf_useful - pf_late + pf_demand_misses));
+	}
+}
+
+/*
+	Sv39 virtual memory
+		-translation is on once "setptbr" points at a root page table
+		-ITLB for fetch stage and DTLB for memory stage, fully associative
+		 with LRU replacement
+		-each TLB has its own hardware page-table walker, reading one PTE
+		 per access through memory_read_l2 from the stage that missed, so
+		 walks see the real memory (and L2) latency
+		-fetch stage sends bubbles down the pipeline while the ITLB walks,
+		 memory stage holds the pipeline while the DTLB walks
+		-a leaf PTE above level 0 maps a 2 MB or 1 GB superpage with a single
+		 TLB entry; superpages share the TLB with 4 KB pages, or get their own
+		 small array when tlb_superpage_entries is set
+		-a shared L2 TLB behind the ITLB and DTLB is looked up before walking,
+		 a page-walk cache of upper-level PTEs lets a walk start at level 1
+		 or 0; both are off until given entries and charge their latency in
+		 cycles before the L1 TLB is filled or the first PTE read goes out
+		-a TLB hit costs tlb_latency cycles before a physically indexed L1
+		 can be looked up; with vipt set the L1 set is picked from the
+		 virtual address while the TLB is read and only the physical tag
+		 compare waits for it, so a hit hides translation. One way of the
+		 I-cache (8 KB) and the D-cache (16 KB) is bigger than a page, so
+		 the index has bits above the page offset: an access whose virtual
+		 and physical page color differ could alias, it is counted, and
+		 re-indexed with the physical address at the PIPT cost
+	A/D bits are not checked or updated. There are no traps in this model,
+	so a page fault is reported and the access goes on untranslated.
+*/
+#define TLB_MAX_ENTRIES        2048
+#define PWC_MAX_ENTRIES        64
+#define PAGE_SHIFT             12
+#define SV39_LEVELS            3
+
+#define PTE_V                  0x01
+#define PTE_R                  0x02
+#define PTE_W                  0x04
+#define PTE_X                  0x08
+
+#define TLB_READ               PTE_R
+#define TLB_WRITE              PTE_W
+#define TLB_EXECUTE            PTE_X
+
+#define WALK_BUSY              0
+#define WALK_DONE              1
+#define WALK_FAULT             2
+
+#define PAGE_FAULT_REPORTS     10
+#define COLOR_REPORTS          10
+
+struct model_tlb_entry{
+	int      valid_bit;
+	uint64_t vpn;   // low 9 * level bits are zero
+	uint64_t ppn;
+	int      level; // 0: 4 KB, 1: 2 MB, 2: 1 GB
+	uint8_t  flags; // R/W/X of the leaf PTE
+	uint64_t last_use;
+};
+
+struct model_walker{
+	bool     active;
+	uint64_t vpn;      // virtual page being walked
+	int      level;    // 2 is the root table
+	uint64_t table;    // physical address of the page table at this level
+	bool     issued;   // a PTE read is waiting in memory
+	uint64_t start_cycle;
+	uint64_t read_cycle; // last cycle the walker used the stage's memory access
+	uint64_t ready_cycle; // L2 TLB / page-walk cache answer is back
+	bool     l2_tlb_hit;
+	bool     serial_hit; // L1 TLB hit waiting out tlb_latency
+	struct model_tlb_entry hit_entry; // the entry either hit found
+	bool     replay;   // walk done while its last PTE read held the access, the retry takes the result
+	int      status;   // WALK_DONE or WALK_FAULT of that walk
+	uint64_t pte;      // its leaf PTE
+};
+
+struct model_pwc_entry{
+	int      valid_bit;
+	int      level; // level of the table this entry points at, 1 or 0
+	uint64_t vpn;   // vpn bits above that level, low bits zero
+	uint64_t table;
+	uint64_t last_use;
+};
+
+struct model_tlb{
+	const char            *name;
+	struct model_tlb_entry entry[TLB_MAX_ENTRIES];
+	uint64_t               entries;
+	struct model_tlb_entry super[TLB_MAX_ENTRIES]; // superpages only, when split
+	uint64_t               super_entries;          // 0: superpages go into entry[]
+	uint64_t               lru_clock;
+	struct model_walker    walker;
+	uint64_t               lookups, hits, misses, walks, walk_cycles, pte_reads, faults;
+	uint64_t               l2_tlb_hits;
+	uint64_t               size_hits[SV39_LEVELS], size_fills[SV39_LEVELS];
+	uint64_t               cache_way_bytes; // bytes one way of the L1 behind it indexes
+	uint64_t               overlapped, color_conflicts;
+};
+
+HART_LOCAL struct model_tlb itlb = { .name = "ITLB", .entries = 16, .cache_way_bytes = 512 * 16 };
+HART_LOCAL struct model_tlb dtlb = { .name = "DTLB", .entries = 16, .cache_way_bytes = 2048 * 8 };
+HART_LOCAL struct model_tlb l2_tlb = { .name = "L2 TLB", .entries = 0 }; // shared, 0: off
+HART_LOCAL uint64_t l2_tlb_latency = 2;
+
+HART_LOCAL struct model_pwc_entry pwc[PWC_MAX_ENTRIES];
+HART_LOCAL uint64_t pwc_entries = 0; // 0: off
+HART_LOCAL uint64_t pwc_latency = 1;
+HART_LOCAL uint64_t pwc_lru_clock = 0;
+HART_LOCAL uint64_t pwc_hits[SV39_LEVELS]; // by the level the walk started at
+HART_LOCAL uint64_t pwc_misses = 0;
+
+HART_LOCAL uint64_t tlb_latency = 0; // cycles of an L1 TLB hit, 0: free
+HART_LOCAL bool     vipt = false;
+HART_LOCAL uint64_t tlb_ptbr = 0; // root table the TLB contents belong to
+HART_LOCAL uint64_t m_stage_paddr = 0; // translated address of the access held in memory stage
+HART_LOCAL bool     m_stage_trained = false; // the load held in memory stage has trained the prefetcher
+
+const char *page_size_name[SV39_LEVELS] = {"4 KB", "2 MB", "1 GB"};
+
+void flush_tlb(struct model_tlb *tlb){
+	memset(tlb->entry, 0, sizeof(tlb->entry));
+	memset(tlb->super, 0, sizeof(tlb->super));
+	memset(&tlb->walker, 0, sizeof(tlb->walker));
+}
+
+void flush_pwc(void){
+	memset(pwc, 0, sizeof(pwc));
+}
+
+// low vpn bits covered by a page of this level
+uint64_t page_vpn_mask(int level){
+	return ~((1ULL << (9 * level)) - 1);
+}
+
+uint64_t tlb_paddr(struct model_tlb_entry *entry, uint64_t va){
+	uint64_t offset_mask = (1ULL << (PAGE_SHIFT + 9 * entry->level)) - 1;
+	return ((entry->ppn << PAGE_SHIFT) & ~offset_mask) | (va & offset_mask);
+}
+
+struct model_tlb_entry* search_tlb(struct model_tlb_entry entry[], uint64_t entries, uint64_t vpn){
+	for(uint64_t i = 0; i < entries; i++){
+		if(entry[i].valid_bit == 1 && entry[i].vpn == (vpn & page_vpn_mask(entry[i].level))){
+			return &entry[i];
+		}
+	}
+	return NULL;
+}
+
+struct model_tlb_entry* find_tlb(struct model_tlb *tlb, uint64_t vpn){
+	struct model_tlb_entry *entry = search_tlb(tlb->entry, tlb->entries, vpn);
+	if(entry == NULL && tlb->super_entries > 0){
+		entry = search_tlb(tlb->super, tlb->super_entries, vpn);
+	}
+	return entry;
+}
+
+void fill_tlb(struct model_tlb *tlb, uint64_t vpn, uint64_t ppn, uint8_t flags, int level){
+	struct model_tlb_entry *entry   = tlb->entry;
+	uint64_t                entries = tlb->entries;
+	if(level > 0 && tlb->super_entries > 0){
+		entry   = tlb->super;
+		entries = tlb->super_entries;
+	}
+	
+	struct model_tlb_entry *victim = &entry[0];
+	for(uint64_t i = 0; i < entries; i++){
+		if(entry[i].valid_bit == 0){
+			victim = &entry[i];
+			break;
+		}
+		if(entry[i].last_use < victim->last_use){
+			victim = &entry[i];
+		}
+	}
+	victim->valid_bit = 1;
+	victim->vpn       = vpn & page_vpn_mask(level);
+	victim->ppn       = ppn;
+	victim->level     = level;
+	victim->flags     = flags;
+	victim->last_use  = ++tlb->lru_clock;
+	tlb->size_fills[level]++;
+}
+
+/*
+	find_pwc mainly looks for the deepest page table of vpn the page-walk
+	cache knows, return NULL if the walk has to start at the root
+*/
+struct model_pwc_entry* find_pwc(uint64_t vpn){
+	struct model_pwc_entry *best = NULL;
+	for(uint64_t i = 0; i < pwc_entries; i++){
+		if(pwc[i].valid_bit == 1 && pwc[i].vpn == (vpn & page_vpn_mask(pwc[i].level + 1))
+		&& (best == NULL || pwc[i].level < best->level)){
+			best = &pwc[i];
+		}
+	}
+	return best;
+}
+
+void fill_pwc(uint64_t vpn, int level, uint64_t table){
+	if(pwc_entries == 0){
+		return;
+	}
+	struct model_pwc_entry *victim = &pwc[0];
+	for(uint64_t i = 0; i < pwc_entries; i++){
+		if(pwc[i].valid_bit == 1 && pwc[i].level == level && pwc[i].vpn == (vpn & page_vpn_mask(level + 1))){
+			victim = &pwc[i];
+			break;
+		}
+		if(pwc[i].valid_bit == 0){
+			victim = &pwc[i];
+			break;
+		}
+		if(pwc[i].last_use < victim->last_use){
+			victim = &pwc[i];
+		}
+	}
+	victim->valid_bit = 1;
+	victim->level     = level;
+	victim->vpn       = vpn & page_vpn_mask(level + 1);
+	victim->table     = table;
+	victim->last_use  = ++pwc_lru_clock;
+}
+
+/*
+	tlb_reach mainly adds up the memory the valid entries of a TLB map
+*/
+uint64_t tlb_reach(struct model_tlb *tlb){
+	uint64_t reach = 0;
+	for(uint64_t i = 0; i < tlb->entries; i++){
+		if(tlb->entry[i].valid_bit == 1){
+			reach += 1ULL << (PAGE_SHIFT + 9 * tlb->entry[i].level);
+		}
+	}
+	for(uint64_t i = 0; i < tlb->super_entries; i++){
+		if(tlb->super[i].valid_bit == 1){
+			reach += 1ULL << (PAGE_SHIFT + 9 * tlb->super[i].level);
+		}
+	}
+	return reach;
+}
+
+/*
+	walk_step mainly advances a page-table walk by at most one PTE read
+	return WALK_DONE with the leaf PTE, WALK_FAULT, or WALK_BUSY
+*/
+int walk_step(struct model_tlb *tlb, uint64_t *pte){
+	struct model_walker *w = &tlb->walker;
+	uint64_t pte_addr = w->table + ((w->vpn >> (9 * w->level)) & 0x1FF) * 8;
+	
+	*pte = 0;
+	if(!w->issued){
+		tlb->pte_reads++;
+		w->read_cycle = get_cycle_counter();
+		if(!memory_read_l2(pte_addr, pte, 8)){
+			w->issued = true;
+			return WALK_BUSY;
+		}
+	}else if(!memory_status_l2(pte_addr, pte)){
+		return WALK_BUSY;
+	}
+	w->issued = false;
+	
+	if(!(*pte & PTE_V) || (!(*pte & PTE_R) && (*pte & PTE_W))){
+		return WALK_FAULT;
+	}
+	if(*pte & (PTE_R | PTE_X)){ // leaf, a superpage above level 0
+		if(((*pte >> 10) & ((1ULL << (9 * w->level)) - 1)) != 0){ // misaligned superpage
+			return WALK_FAULT;
+		}
+		return WALK_DONE;
+	}
+	if(w->level == 0){
+		return WALK_FAULT;
+	}
+	w->level--;
+	w->table = ((*pte >> 10) & 0xFFFFFFFFFFFULL) << PAGE_SHIFT;
+	fill_pwc(w->vpn, w->level, w->table);
+	return WALK_BUSY;
+}
+
+void report_page_fault(struct model_tlb *tlb, uint64_t va){
+	tlb->faults++;
+	if(itlb.faults + dtlb.faults <= PAGE_FAULT_REPORTS){
+		fprintf(stderr, "%s: page fault at 0x%016" PRIx64 ", access goes on untranslated\n", tlb->name, va);
+	}
+}
+
+/*
+	page_color_conflict mainly tells whether va and pa would pick different
+	sets of the L1 behind this TLB
+*/
+bool page_color_conflict(struct model_tlb *tlb, uint64_t va, uint64_t pa){
+	uint64_t color_mask = (tlb->cache_way_bytes - 1) & ~((1ULL << PAGE_SHIFT) - 1);
+	return ((va ^ pa) & color_mask) != 0;
+}
+
+HART_LOCAL uint64_t color_reports = 0;
+
+// once per page the walker maps with a conflicting color
+void report_color_conflict(struct model_tlb *tlb, uint64_t va, uint64_t pa){
+	if(++color_reports <= COLOR_REPORTS){
+		fprintf(stderr, "%s: VIPT color conflict, page va 0x%016" PRIx64 " pa 0x%016" PRIx64 " is re-indexed with the pa\n",
+		        tlb->name, va & ~(uint64_t)0xFFF, pa & ~(uint64_t)0xFFF);
+	}
+}
+
+/*
+	translate mainly turns a virtual address into a physical one
+	return false while the page-table walker is still busy, the stage
+	has to try again next cycle
+*/
+bool translate(struct model_tlb *tlb, uint64_t va, int access, uint64_t *pa){
+	uint64_t vpn = (va >> PAGE_SHIFT) & 0x7FFFFFFULL;
+	uint64_t pte;
+	struct model_tlb_entry *entry;
+	
+	*pa = va;
+	if(get_ptbr() == 0){
+		return true;
+	}
+	if(get_ptbr() != tlb_ptbr){ // new address space
+		flush_tlb(&itlb);
+		flush_tlb(&dtlb);
+		flush_tlb(&l2_tlb);
+		flush_pwc();
+		tlb_ptbr = get_ptbr();
+	}
+	
+	// the retry after a walk finished is no new lookup, it was counted as a miss
+	if(tlb->walker.replay){
+		tlb->walker.replay = false;
+		entry = find_tlb(tlb, vpn);
+		if(tlb->walker.vpn == vpn && (entry != NULL || tlb->walker.status == WALK_FAULT)){
+			if(tlb->walker.status == WALK_FAULT || !(tlb->walker.pte & access)){
+				report_page_fault(tlb, va);
+				return true;
+			}
+			*pa = tlb_paddr(entry, va);
+			return true;
+		}
+	}
+	
+	if(!tlb->walker.active){
+		tlb->lookups++;
+		entry = find_tlb(tlb, vpn);
+		if(entry != NULL){
+			tlb->hits++;
+			tlb->size_hits[entry->level]++;
+			entry->last_use = ++tlb->lru_clock;
+			if(!(entry->flags & access)){
+				report_page_fault(tlb, va);
+				return true;
+			}
+			*pa = tlb_paddr(entry, va);
+			if(vipt && !page_color_conflict(tlb, va, *pa)){
+				tlb->overlapped++;
+				return true;
+			}
+			if(vipt){
+				tlb->color_conflicts++;
+			}
+			if(tlb_latency == 0){
+				return true;
+			}
+			memset(&tlb->walker, 0, sizeof(tlb->walker));
+			tlb->walker.active      = true;
+			tlb->walker.serial_hit  = true;
+			tlb->walker.vpn         = vpn;
+			tlb->walker.hit_entry   = *entry;
+			tlb->walker.ready_cycle = get_cycle_counter() + tlb_latency;
+			return false;
+		}
+		tlb->misses++;
+		memset(&tlb->walker, 0, sizeof(tlb->walker));
+		tlb->walker.active      = true;
+		tlb->walker.vpn         = vpn;
+		tlb->walker.level       = SV39_LEVELS - 1;
+		tlb->walker.table       = get_ptbr();
+		tlb->walker.start_cycle = get_cycle_counter();
+		tlb->walker.ready_cycle = get_cycle_counter();
+		if(l2_tlb.entries > 0){
+			l2_tlb.lookups++;
+			tlb->walker.ready_cycle += l2_tlb_latency;
+			entry = find_tlb(&l2_tlb, vpn);
+			if(entry != NULL){
+				l2_tlb.hits++;
+				l2_tlb.size_hits[entry->level]++;
+				entry->last_use = ++l2_tlb.lru_clock;
+				tlb->l2_tlb_hits++;
+				tlb->walker.l2_tlb_hit   = true;
+				tlb->walker.hit_entry = *entry;
+			}else{
+				l2_tlb.misses++;
+			}
+		}
+		if(!tlb->walker.l2_tlb_hit){
+			tlb->walks++;
+			if(pwc_entries > 0){
+				tlb->walker.ready_cycle += pwc_latency;
+				struct model_pwc_entry *table = find_pwc(vpn);
+				if(table != NULL){
+					table->last_use = ++pwc_lru_clock;
+					pwc_hits[table->level]++;
+					tlb->walker.level = table->level;
+					tlb->walker.table = table->table;
+				}else{
+					pwc_misses++;
+				}
+			}
+		}
+	}
+	
+	// a redirected fetch still lets the walk it started finish
+	if(get_cycle_counter() < tlb->walker.ready_cycle){
+		return false;
+	}
+	if(tlb->walker.serial_hit){
+		tlb->walker.active = false;
+		if(tlb->walker.vpn != vpn){
+			return false;
+		}
+		*pa = tlb_paddr(&tlb->walker.hit_entry, va);
+		return true;
+	}
+	int status;
+	if(tlb->walker.l2_tlb_hit){
+		entry  = &tlb->walker.hit_entry;
+		pte    = (entry->ppn << 10) | entry->flags | PTE_V;
+		status = WALK_DONE;
+		tlb->walker.level = entry->level;
+	}else{
+		status = walk_step(tlb, &pte);
+		if(status == WALK_BUSY){
+			return false;
+		}
+		tlb->walk_cycles += get_cycle_counter() - tlb->walker.start_cycle + 1;
+	}
+	tlb->walker.active = false;
+	if(status == WALK_DONE){
+		fill_tlb(tlb, tlb->walker.vpn, (pte >> 10) & 0xFFFFFFFFFFFULL, pte & (PTE_R | PTE_W | PTE_X), tlb->walker.level);
+		if(l2_tlb.entries > 0 && !tlb->walker.l2_tlb_hit){
+			fill_tlb(&l2_tlb, tlb->walker.vpn, (pte >> 10) & 0xFFFFFFFFFFFULL, pte & (PTE_R | PTE_W | PTE_X), tlb->walker.level);
+		}
+		uint64_t page_va = tlb->walker.vpn << PAGE_SHIFT;
+		uint64_t page_pa = tlb_paddr(find_tlb(tlb, tlb->walker.vpn), page_va);
+		if(vipt && page_color_conflict(tlb, page_va, page_pa)){
+			report_color_conflict(tlb, page_va, page_pa);
+		}
+	}
+	if(tlb->walker.vpn != vpn){
+		return false;
+	}
+	// the stage's one memory access of this cycle went to the walk
+	if(tlb->walker.read_cycle == get_cycle_counter()){
+		tlb->walker.replay = true;
+		tlb->walker.status = status;
+		tlb->walker.pte    = pte;
+		return false;
+	}
+	if(status == WALK_FAULT || !(pte & access)){
+		report_page_fault(tlb, va);
+		return true;
+	}
+	*pa = tlb_paddr(find_tlb(tlb, vpn), va);
+	return true;
+}
+
+/*
+	probe_tlb mainly translates without walking or counting,
+	return false if the TLB does not hold the page
+*/
+bool probe_tlb(struct model_tlb *tlb, uint64_t va, uint64_t *pa){
+	struct model_tlb_entry *entry = find_tlb(tlb, (va >> PAGE_SHIFT) & 0x7FFFFFFULL);
+	
+	*pa = va;
+	if(get_ptbr() == 0){
+		return true;
+	}
+	if(entry == NULL){
+		return false;
+	}
+	*pa = tlb_paddr(entry, va);
+	return true;
+}
+
+void print_tlb_stats(struct model_tlb *tlb){
+	if(get_ptbr() == 0 && tlb->lookups == 0){
+		return;
+	}
+	if(tlb->super_entries > 0){
+		printf("%s (%" PRIu64 " entries, %" PRIu64 " superpage entries):\n", tlb->name, tlb->entries, tlb->super_entries);
+	}else{
+		printf("%s (%" PRIu64 " entries):\n", tlb->name, tlb->entries);
+	}
+	printf("  Lookups/hits/misses: %" PRIu64 "/%" PRIu64 "/%" PRIu64 "\n", tlb->lookups, tlb->hits, tlb->misses);
+	if(tlb->lookups > 0){
+		printf("  Hit rate: %.2f%%\n", 100.0 * tlb->hits / tlb->lookups);
+	}
+	if(l2_tlb.entries > 0){
+		printf("  Misses served by L2 TLB: %" PRIu64 "\n", tlb->l2_tlb_hits);
+	}
+	printf("  Page walks: %" PRIu64 " (PTE reads: %" PRIu64 ")\n", tlb->walks, tlb->pte_reads);
+	printf("  Walk cycles: %" PRIu64 "\n", tlb->walk_cycles);
+	if(tlb->walks > 0){
+		printf("  Average walk latency: %.2f cycles\n", (double)tlb->walk_cycles / tlb->walks);
+	}
+	printf("  Page faults: %" PRIu64 "\n", tlb->faults);
+	if(vipt){
+		printf("  VIPT hits overlapped with the L1: %" PRIu64 ", color conflicts: %" PRIu64 "\n", tlb->overlapped, tlb->color_conflicts);
+	}
+	for(int level = 0; level < SV39_LEVELS; level++){
+		printf("  %s pages: hits %" PRIu64 ", misses %" PRIu64 "\n", page_size_name[level], tlb->size_hits[level], tlb->size_fills[level]);
+	}
+	printf("  Reach: %" PRIu64 " KB\n", tlb_reach(tlb) >> 10);
+}
+
+/*
+	print_vipt_aliasing mainly flags an L1 whose way is bigger than a page,
+	its virtual index then needs page coloring to stay alias free
+*/
+void print_vipt_aliasing(struct model_tlb *tlb, const char *cache){
+	uint64_t colors = tlb->cache_way_bytes >> PAGE_SHIFT;
+	if(colors > 1){
+		fprintf(stderr, "VIPT: %s way is %" PRIu64 " KB, %" PRIu64 " page colors, pages whose virtual and physical color differ may alias\n",
+		        cache, tlb->cache_way_bytes >> 10, colors);
+	}
+}
+
+/*
+	print_walk_cache_stats mainly shows where the shared L2 TLB and the
+	page-walk cache kept a TLB miss from doing a full three-read walk
+*/
+void print_walk_cache_stats(void){
+	if(l2_tlb.entries > 0 && l2_tlb.lookups > 0){
+		printf("L2 TLB (%" PRIu64 " entries, %" PRIu64 " cycles):\n", l2_tlb.entries, l2_tlb_latency);
+		printf("  Lookups/hits/misses: %" PRIu64 "/%" PRIu64 "/%" PRIu64 "\n", l2_tlb.lookups, l2_tlb.hits, l2_tlb.misses);
+		printf("  Hit rate: %.2f%%\n", 100.0 * l2_tlb.hits / l2_tlb.lookups);
+		for(int level = 0; level < SV39_LEVELS; level++){
+			printf("  %s pages: hits %" PRIu64 ", fills %" PRIu64 "\n", page_size_name[level], l2_tlb.size_hits[level], l2_tlb.size_fills[level]);
+		}
+		printf("  Walks avoided: %" PRIu64 "\n", l2_tlb.hits);
+	}
+	if(pwc_entries > 0 && itlb.walks + dtlb.walks > 0){
+		printf("Page-walk cache (%" PRIu64 " entries, %" PRIu64 " cycles):\n", pwc_entries, pwc_latency);
+		printf("  Walks from the root: %" PRIu64 "\n", pwc_misses);
+		for(int level = SV39_LEVELS - 2; level >= 0; level--){
+			printf("  Walks from level %d: %" PRIu64 " (%d PTE reads skipped each)\n", level, pwc_hits[level], SV39_LEVELS - 1 - level);
+		}
+		printf("  PTE reads avoided: %" PRIu64 "\n", pwc_hits[1] + 2 * pwc_hits[0]);
+	}
+}
+
+// To do the sign-extended
+uint64_t converter(uint64_t i, uint64_t most_significant, uint64_t bitwiseNum){
+	if(( i & most_significant ) == most_significant)
+	{
+		i = i | bitwiseNum;
+	}
+	return i;
+}
+
+/*
+	Wrong-path execution
+		-without it the instruction behind a mispredicted branch is simply
+		 dropped in execute stage, and only its fetch touched the i-cache
+		-with it a dropped load still computes its address from the register
+		 file and probes the d-cache; a miss is sent to memory through the
+		 prefetch queue and fills the d-cache, warming or polluting it
+		-wrong-path stores never leave the pipeline, as in real hardware
+	The wrong-path window is whatever the pipeline fetched before the
+	redirect, so it grows with the front-end depth.
+*/
+void wrong_path_execute(void){
+	uint64_t result_array[2];
+	
+	if(!wrong_path_enabled || cur_x_reg.funct == 0){
+		return;
+	}
+	wp_instructions++;
+	if(cur_x_reg.i_cache_fill){
+		wp_i_fills++;
+	}
+	if(cur_x_reg.funct >= 1 && cur_x_reg.funct <= 7){ // loads
+		uint64_t address = (cur_x_reg.rs1 + converter(cur_x_reg.e[0], 0x800, 0xFFFFFFFFFFFFF000)) & 0xFFFFFFFF;
+		wp_loads++;
+		if(!probe_tlb(&dtlb, address, &address)){ // no page walks for the wrong path
+			return;
+		}
+		if(check_d_cache(d_cache, address, 1, result_array)[0] == 1){
+			wp_hits++;
+		}else{
+			prefetch_enqueue(address, true);
+		}
+	}
+}
+
+/*
+	wrong_path_train mainly tells whether a correct-path load benefits from
+	a wrong-path fill, or misses on a line that a wrong-path fill evicted
+*/
+void wrong_path_train(uint64_t address, bool hit){
+	int tag   = (address & 0xFFFFC000) >> 14;
+	int index = (address & 0x3FF8) >> 3;
+	
+	if(!wrong_path_enabled){
+		return;
+	}
+	if(hit){
+		if(d_cache[index].wrong_path_bit){
+			d_cache[index].wrong_path_bit = 0;
+			wp_useful++;
+		}
+	}else{
+		if(wrong_path_victim_valid[index] && wrong_path_victim_tag[index] == tag){
+			wp_pollution++;
+		}
+		wrong_path_victim_valid[index] = 0;
+		if(d_cache[index].valid_bit == 1 && d_cache[index].wrong_path_bit){ // the demand fill evicts an unused line
+			d_cache[index].wrong_path_bit = 0;
+			wp_useless++;
+		}
+	}
+}
+
+void print_wrong_path_stats(void){
+	if(!wrong_path_enabled){
+		return;
+	}
+	printf("Wrong-path execution:\n");
+	printf("  Wrong-path instructions: %" PRIu64 "\n", wp_instructions);
+	printf("  I-cache fills by wrong-path fetches: %" PRIu64 "\n", wp_i_fills);
+	printf("  Wrong-path loads: %" PRIu64 " (d-cache hits: %" PRIu64 ")\n", wp_loads, wp_hits);
+	printf("  D-cache fills issued: %" PRIu64 "\n", wp_fills);
+	printf("  Later used by the correct path: %" PRIu64 "\n", wp_useful);
+	printf("  Evicted unused: %" PRIu64 "\n", wp_useless);
+	printf("  Pollution misses: %" PRIu64 "\n", wp_pollution);
+}
+
+/*  Branch Target Buffer - global variable
+	Set-associative, indexed by a hash of the branch pc
+		-Tag: partial tag, btb_tag_bits of the pc above the index
+		-Target: target pc address, written in execute stage
+	Each set is btb_ways entries with LRU replacement.
+*/
+#define BTB_MAX_ENTRIES        4096
+
+struct model_btb{
+	int      valid_bit;
+	int      target_valid; // tag is added in fetch stage, target in execute stage
+	uint32_t tag;
+	uint64_t target;
+	uint64_t last_use;
+	uint64_t pc;           // full pc, only used to count partial tag aliasing
+};
+
+HART_LOCAL struct model_btb BTB[BTB_MAX_ENTRIES];
+HART_LOCAL uint64_t btb_entries  = 32;
+HART_LOCAL uint64_t btb_ways     = 4;
+HART_LOCAL uint64_t btb_tag_bits = 12;
+HART_LOCAL uint64_t btb_lru_clock = 0;
+
+HART_LOCAL uint64_t btb_lookups = 0, btb_hits = 0, btb_allocations = 0, btb_evictions = 0, btb_aliases = 0;
+
+/*
+	find_btb mainly returns the set and partial tag of a pc
+*/
+struct model_btb* find_btb(uint64_t pc, uint32_t *tag){
+	uint64_t sets  = btb_entries / btb_ways;
+	uint64_t bits  = __builtin_ctzll(sets);
+	uint64_t word  = pc >> 2;
+	uint64_t index = (word ^ (word >> bits) ^ (word >> (2 * bits))) & (sets - 1);
+	*tag = (word >> bits) & ((1ULL << btb_tag_bits) - 1);
+	return &BTB[index * btb_ways];
+}
+
+/*
+	check_btb mainly looks up the target of a branch
+	return the entry, or NULL if the pc has no entry
+*/
+struct model_btb* check_btb(uint64_t pc){
+	uint32_t tag;
+	struct model_btb *set = find_btb(pc, &tag);
+	for(uint64_t i = 0; i < btb_ways; i++){
+		if(set[i].valid_bit && set[i].tag == tag){
+			set[i].last_use = ++btb_lru_clock;
+			return &set[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+	allocate_btb mainly adds a Tag for pc, replacing the LRU way of its set
+*/
+struct model_btb* allocate_btb(uint64_t pc){
+	uint32_t tag;
+	struct model_btb *set   = find_btb(pc, &tag);
+	struct model_btb *entry = &set[0];
+	for(uint64_t i = 0; i < btb_ways; i++){
+		if(!set[i].valid_bit){
+			entry = &set[i];
+			break;
+		}
+		if(set[i].last_use < entry->last_use){
+			entry = &set[i];
+		}
+	}
+	if(entry->valid_bit){
+		btb_evictions++;
+	}
+	btb_allocations++;
+	entry->valid_bit    = 1;
+	entry->target_valid = 0;
+	entry->tag          = tag;
+	entry->pc           = pc;
+	entry->last_use     = ++btb_lru_clock;
+	return entry;
+}
+
+/*
+	update_btb mainly checks the target stored for a branch in execute stage
+	return true if a different target was predicted (wrong branch prediction)
+*/
+bool update_btb(uint64_t pc, uint64_t target){
+	struct model_btb *entry = check_btb(pc);
+	if(entry == NULL){
+		return false;
+	}
+	if(entry->target_valid && entry->target == target){
+		// same Target -> correct branch prediction, keep going
+		return false;
+	}
+	bool wrong = entry->target_valid; // no previous record for prediction, then store new Target
+	entry->pc           = pc;
+	entry->target       = target;
+	entry->target_valid = 1;
+	return wrong;
+}
+
+/*
+	Direction predictors
+		-static:  the original rule, backward branches taken, forward not taken
+		-bimodal: 2-bit saturating counters indexed by pc
+		-gshare:  2-bit saturating counters indexed by pc xor global history
+		-TAGE:    bimodal base plus tagged tables with geometric history lengths
+	Each one is a predict/update pair in bpred_table, selected with bpred_mode.
+	predict is consulted in stage_fetch and update is called when the branch
+	resolves in stage_execute. The global history is updated at resolve time,
+	so update recomputes the lookup with the history the prediction used
+	unless an older branch resolved in between.
+*/
+#define BPRED_STATIC           0
+#define BPRED_BIMODAL          1
+#define BPRED_GSHARE           2
+#define BPRED_TAGE             3
+
+#define BPRED_MAX_BITS         16
+#define GHIST_MAX              256  // bits of global history kept
+
+#define TAGE_TABLES            4
+#define TAGE_BITS              10   // 1024 entries per tagged table
+#define TAGE_TAG_BITS          9
+#define TAGE_U_RESET_PERIOD    (256 * 1024)
+
+struct direction_predictor{
+	const char *name;
+	bool (*predict)(uint64_t pc);
+	void (*update)(uint64_t pc, bool taken);
+};
+
+struct model_tage{
+	int8_t   ctr;  // 3-bit signed counter, taken when >= 0
+	uint16_t tag;
+	uint8_t  u;    // 2-bit useful counter
+};
+
+HART_LOCAL uint8_t  bpred_counters[1 << BPRED_MAX_BITS]; // bimodal/gshare tables and TAGE base
+HART_LOCAL struct model_tage tage_table[TAGE_TABLES][1 << TAGE_BITS];
+const int tage_history_length[TAGE_TABLES] = {5, 15, 44, 130};
+
+HART_LOCAL uint8_t  ghist[GHIST_MAX]; // ghist[0] is the newest outcome
+HART_LOCAL int      bpred_mode         = BPRED_STATIC;
+HART_LOCAL uint64_t bpred_bits         = 12;
+HART_LOCAL uint64_t bpred_history_bits = 12;
+HART_LOCAL uint64_t tage_branches      = 0;
+
+HART_LOCAL uint64_t instructions_executed = 0;
+HART_LOCAL uint64_t bpred_branches = 0, bpred_mispredictions = 0, bpred_target_mispredictions = 0;
+
+/*
+	fold_history mainly xors the newest length bits of history down to width bits
+*/
+uint64_t fold_history(int length, int width){
+	uint64_t folded = 0;
+	for(int i = 0; i < length; i++){
+		folded ^= (uint64_t)ghist[i] << (i % width);
+	}
+	return folded;
+}
+
+void push_history(bool taken){
+	memmove(&ghist[1], &ghist[0], GHIST_MAX - 1);
+	ghist[0] = taken;
+}
+
+// 2-bit counter helpers, 0-1 not taken and 2-3 taken
+void update_counter(uint8_t *ctr, bool taken){
+	if(taken && *ctr < 3){
+		(*ctr)++;
+	}else if(!taken && *ctr > 0){
+		(*ctr)--;
+	}
+}
+
+uint64_t bimodal_index(uint64_t pc){
+	return (pc >> 2) & ((1ULL << bpred_bits) - 1);
+}
+
+bool predict_static(uint64_t pc){
+	return true; // forward branches are filtered out in branchPrediction
+}
+
+void update_static(uint64_t pc, bool taken){
+}
+
+bool predict_bimodal(uint64_t pc){
+	return bpred_counters[bimodal_index(pc)] >= 2;
+}
+
+void update_bimodal(uint64_t pc, bool taken){
+	update_counter(&bpred_counters[bimodal_index(pc)], taken);
+}
+
+uint64_t gshare_index(uint64_t pc){
+	return ((pc >> 2) ^ fold_history(bpred_history_bits, bpred_bits)) & ((1ULL << bpred_bits) - 1);
+}
+
+bool predict_gshare(uint64_t pc){
+	return bpred_counters[gshare_index(pc)] >= 2;
+}
+
+void update_gshare(uint64_t pc, bool taken){
+	update_counter(&bpred_counters[gshare_index(pc)], taken);
+	push_history(taken);
+}
+
+uint64_t tage_index(uint64_t pc, int t){
+	return ((pc >> 2) ^ (pc >> (2 + TAGE_BITS)) ^ fold_history(tage_history_length[t], TAGE_BITS)) & ((1 << TAGE_BITS) - 1);
+}
+
+uint16_t tage_tag(uint64_t pc, int t){
+	return ((pc >> 2) ^ fold_history(tage_history_length[t], TAGE_TAG_BITS) ^ (fold_history(tage_history_length[t], TAGE_TAG_BITS - 1) << 1)) & ((1 << TAGE_TAG_BITS) - 1);
+}
+
+/*
+	tage_lookup mainly finds the provider (longest matching table) and the
+	alternate prediction, -1 as a table number means the bimodal base
+*/
+bool tage_lookup(uint64_t pc, int *provider, uint64_t index[], uint16_t tag[], bool *alt_taken){
+	bool base = bpred_counters[bimodal_index(pc)] >= 2;
+	int  alt  = -1;
+	*provider = -1;
+	for(int t = 0; t < TAGE_TABLES; t++){
+		index[t] = tage_index(pc, t);
+		tag[t]   = tage_tag(pc, t);
+	}
+	for(int t = TAGE_TABLES - 1; t >= 0; t--){
+		if(tage_table[t][index[t]].tag == tag[t]){
+			if(*provider < 0){
+				*provider = t;
+			}else{
+				alt = t;
+				break;
+			}
+		}
+	}
+	*alt_taken = (alt < 0) ? base : tage_table[alt][index[alt]].ctr >= 0;
+	if(*provider < 0){
+		return base;
+	}
+	return tage_table[*provider][index[*provider]].ctr >= 0;
+}
+
+bool predict_tage(uint64_t pc){
+	int      provider;
+	uint64_t index[TAGE_TABLES];
+	uint16_t tag[TAGE_TABLES];
+	bool     alt_taken;
+	return tage_lookup(pc, &provider, index, tag, &alt_taken);
+}
+
+void update_tage(uint64_t pc, bool taken){
+	int      provider;
+	uint64_t index[TAGE_TABLES];
+	uint16_t tag[TAGE_TABLES];
+	bool     alt_taken;
+	bool     predicted = tage_lookup(pc, &provider, index, tag, &alt_taken);
+	
+	if(provider < 0){
+		update_counter(&bpred_counters[bimodal_index(pc)], taken);
+	}else{
+		struct model_tage *entry = &tage_table[provider][index[provider]];
+		if(predicted != alt_taken){ // the provider made the difference
+			if(predicted == taken && entry->u < 3){
+				entry->u++;
+			}else if(predicted != taken && entry->u > 0){
+				entry->u--;
+			}
+		}
+		if(taken && entry->ctr < 3){
+			entry->ctr++;
+		}else if(!taken && entry->ctr > -4){
+			entry->ctr--;
+		}
+	}
+	
+	// on a misprediction, allocate an entry in a table with longer history
+	if(predicted != taken){
+		bool allocated = false;
+		for(int t = provider + 1; t < TAGE_TABLES; t++){
+			if(tage_table[t][index[t]].u == 0){
+				tage_table[t][index[t]].tag = tag[t];
+				tage_table[t][index[t]].ctr = taken ? 0 : -1;
+				allocated = true;
+				break;
+			}
+		}
+		for(int t = provider + 1; t < TAGE_TABLES && !allocated; t++){
+			tage_table[t][index[t]].u--;
+		}
+	}
+	
+	// age the useful counters now and then
+	tage_branches++;
+	if(tage_branches % TAGE_U_RESET_PERIOD == 0){
+		for(int t = 0; t < TAGE_TABLES; t++){
+			for(int i = 0; i < (1 << TAGE_BITS); i++){
+				tage_table[t][i].u >>= 1;
+			}
+		}
+	}
+	push_history(taken);
+}
+
+const struct direction_predictor bpred_table[] = {
+	{"static",  predict_static,  update_static},
+	{"bimodal", predict_bimodal, update_bimodal},
+	{"gshare",  predict_gshare,  update_gshare},
+	{"TAGE",    predict_tage,    update_tage},
+};
+
+/*
+	reset_direction_predictor mainly clears the tables when the predictor changes
+*/
+void reset_direction_predictor(void){
+	memset(bpred_counters, 1, sizeof(bpred_counters)); // weakly not taken
+	memset(tage_table, 0, sizeof(tage_table));
+	for(int t = 0; t < TAGE_TABLES; t++){
+		for(int i = 0; i < (1 << TAGE_BITS); i++){
+			tage_table[t][i].tag = 0xFFFF; // never matches a 9-bit tag
+		}
+	}
+	memset(ghist, 0, sizeof(ghist));
+	tage_branches = 0;
+}
+
+void print_bpred_stats(void){
+	printf("Branch predictor (%s):\n", bpred_table[bpred_mode].name);
+	printf("  Instructions executed: %" PRIu64 "\n", instructions_executed);
+	printf("  Conditional branches: %" PRIu64 "\n", bpred_branches);
+	printf("  Mispredictions: %" PRIu64 " (wrong target: %" PRIu64 ")\n", bpred_mispredictions, bpred_target_mispredictions);
+	if(bpred_branches > 0){
+		printf("  Accuracy: %.2f%%\n", 100.0 * (bpred_branches - bpred_mispredictions) / bpred_branches);
+	}
+	if(instructions_executed > 0){
+		printf("  MPKI: %.3f\n", 1000.0 * bpred_mispredictions / instructions_executed);
+	}
+}
+
+/*
+	Return Address Stack
+		-pushed in fetch stage by jal/jalr with a link register (x1 or x5) as rd
+		-popped in fetch stage by jalr with a link register as rs1, which then
+		 predicts the return target
+	Following the RISC-V hints, a jalr with link rd and link rs1 pops and
+	pushes (a coroutine swap) unless rd == rs1, which only pushes.
+	Every fetched instruction carries the stack pointer and top entry as a
+	checkpoint, execute stage restores them when it redirects the pc.
+*/
+#define RAS_MAX_DEPTH          64
+
+HART_LOCAL uint64_t ras[RAS_MAX_DEPTH];
+HART_LOCAL bool     ras_enabled = false;
+HART_LOCAL int      ras_depth = 16;
+HART_LOCAL int      ras_top   = 0; // number of pushes minus pops, wraps around the stack
+
+HART_LOCAL uint64_t ras_pushes = 0, ras_pops = 0, ras_hits = 0, ras_misses = 0, ras_repairs = 0;
+
+bool is_link_register(uint64_t reg){
+	return reg == 1 || reg == 5;
+}
+
+void push_ras(uint64_t return_address){
+	ras[((ras_top % ras_depth) + ras_depth) % ras_depth] = return_address;
+	ras_top++;
+	ras_pushes++;
+}
+
+uint64_t pop_ras(void){
+	ras_top--;
+	ras_pops++;
+	return ras[((ras_top % ras_depth) + ras_depth) % ras_depth];
+}
+
+/*
+	ras_checkpoint mainly saves the stack pointer and top entry
+	in the stage register of the fetched instruction
+*/
+void ras_checkpoint(struct stage_reg_d *new_d_reg){
+	new_d_reg->ras_top       = ras_top;
+	new_d_reg->ras_top_value = ras[(((ras_top - 1) % ras_depth) + ras_depth) % ras_depth];
+}
+
+void repair_ras(int top, uint64_t top_value){
+	if(ras_top != top){
+		ras_repairs++;
+	}
+	ras_top = top;
+	ras[(((ras_top - 1) % ras_depth) + ras_depth) % ras_depth] = top_value;
+}
+
+/*
+	predictReturn mainly does the RAS operation of a jal/jalr in fetch stage,
+	seq_pc is the return address a call pushes
+	return true and the target if a return address was popped
+*/
+bool predictReturn(uint64_t seq_pc, uint32_t instr, uint64_t *target){
+	uint64_t rd  = (instr & 0xF80) >> 7;
+	uint64_t rs1 = (instr & 0xF8000) >> 15;
+	bool     pop = false;
+	
+	if(!ras_enabled){
+		return false;
+	}
+	if((instr & 0x7F) == 0x67 && is_link_register(rs1) && !(is_link_register(rd) && rd == rs1)){
+		*target = pop_ras();
+		pop = true;
+	}
+	if(is_link_register(rd)){
+		push_ras(seq_pc);
+	}
+	return pop;
+}
+
+void print_ras_stats(void){
+	if(!ras_enabled){
+		return;
+	}
+	printf("Return address stack (%d entries):\n", ras_depth);
+	printf("  Pushes/pops: %" PRIu64 "/%" PRIu64 "\n", ras_pushes, ras_pops);
+	printf("  Return hits/misses: %" PRIu64 "/%" PRIu64 "\n", ras_hits, ras_misses);
+	if(ras_hits + ras_misses > 0){
+		printf("  Hit rate: %.2f%%\n", 100.0 * ras_hits / (ras_hits + ras_misses));
+	}
+	printf("  Repairs: %" PRIu64 "\n", ras_repairs);
+}
+
+/*
+	Indirect target predictor
+		-a tagged target cache for jalr that the RAS does not predict
+		 (switch tables, function pointers, interpreter dispatch)
+		-indexed by pc xor the targets of the last few indirect jumps, so one
+		 jalr can keep a different target for every path leading to it
+		-looked up in fetch stage, trained in execute stage, the path history
+		 is only updated with resolved targets
+*/
+#define INDIRECT_MAX_ENTRIES   4096
+#define INDIRECT_MAX_HISTORY   8
+
+struct model_indirect{
+	int      valid_bit;
+	uint16_t tag;
+	uint64_t target;
+	uint8_t  confidence; // 2-bit, the target is replaced once it reaches 0
+};
+
+HART_LOCAL struct model_indirect indirect_table[INDIRECT_MAX_ENTRIES];
+HART_LOCAL bool     indirect_enabled = false;
+HART_LOCAL uint64_t indirect_entries = 512;
+HART_LOCAL int      indirect_history = 2; // number of previous indirect targets hashed into the index
+HART_LOCAL uint64_t indirect_path[INDIRECT_MAX_HISTORY]; // indirect_path[0] is the newest target
+
+HART_LOCAL uint64_t indirect_jumps = 0, indirect_predictions = 0, indirect_mispredictions = 0, indirect_no_prediction = 0;
+
+uint64_t indirect_hash(uint64_t pc){
+	uint64_t hash = pc >> 2;
+	for(int i = 0; i < indirect_history; i++){
+		hash ^= (indirect_path[i] >> 2) << (i + 1);
+	}
+	return hash;
+}
+
+uint64_t indirect_index(uint64_t pc){
+	return indirect_hash(pc) & (indirect_entries - 1);
+}
+
+uint16_t indirect_tag(uint64_t pc){
+	return (pc >> 2) ^ (indirect_hash(pc) >> 12);
+}
+
+/*
+	predictIndirect mainly looks up the target of a jalr in fetch stage
+	return true and the target if the target cache has one for this path
+*/
+bool predictIndirect(uint64_t pc, uint64_t *target){
+	struct model_indirect *entry = &indirect_table[indirect_index(pc)];
+	
+	if(!indirect_enabled){
+		return false;
+	}
+	if(entry->valid_bit == 1 && entry->tag == indirect_tag(pc)){
+		*target = entry->target;
+		return true;
+	}
+	return false;
+}
+
+/*
+	update_indirect mainly trains the target cache with the resolved target
+	of a jalr and shifts the target into the path history
+*/
+void update_indirect(uint64_t pc, uint64_t target, uint64_t predicted_pc){
+	struct model_indirect *entry = &indirect_table[indirect_index(pc)];
+	uint16_t tag = indirect_tag(pc);
+	
+	if(!indirect_enabled){
+		return;
+	}
+	indirect_jumps++;
+	if(entry->valid_bit == 1 && entry->tag == tag){
+		indirect_predictions++;
+		if(entry->target == target){
+			if(entry->confidence < 3){
+				entry->confidence++;
+			}
+		}else{
+			if(predicted_pc != target){
+				indirect_mispredictions++;
+			}
+			if(entry->confidence > 0){
+				entry->confidence--;
+			}else{
+				entry->target = target;
+			}
+		}
+	}else{
+		indirect_no_prediction++;
+		if(entry->valid_bit == 0 || entry->confidence == 0){
+			entry->valid_bit  = 1;
+			entry->tag        = tag;
+			entry->target     = target;
+			entry->confidence = 1;
+		}else{
+			entry->confidence--;
+		}
+	}
+	memmove(&indirect_path[1], &indirect_path[0], (INDIRECT_MAX_HISTORY - 1) * sizeof(uint64_t));
+	indirect_path[0] = target;
+}
+
+void reset_indirect_predictor(void){
+	memset(indirect_table, 0, sizeof(indirect_table));
+	memset(indirect_path, 0, sizeof(indirect_path));
+}
+
+void print_indirect_stats(void){
+	if(!indirect_enabled){
+		return;
+	}
+	printf("Indirect target predictor (%" PRIu64 " entries, %d targets of path history):\n", indirect_entries, indirect_history);
+	printf("  Indirect jumps: %" PRIu64 "\n", indirect_jumps);
+	printf("  Predicted/no prediction: %" PRIu64 "/%" PRIu64 "\n", indirect_predictions, indirect_no_prediction);
+	printf("  Mispredictions: %" PRIu64 "\n", indirect_mispredictions);
+	if(indirect_jumps > 0){
+		printf("  Accuracy: %.2f%%\n", 100.0 * (indirect_predictions - indirect_mispredictions) / indirect_jumps);
+	}
+	if(instructions_executed > 0){
+		printf("  MPKI: %.3f\n", 1000.0 * (indirect_mispredictions + indirect_no_prediction) / instructions_executed);
+	}
+}
+
+/*  Branch Prediction
+	Goals: 
+		1. look up the BTB to see if there is a Tag that equals to the branch and give the target
+		2. if there is no record, then add Tag in fetch stage, and add Target in execute stage
+		3. the direction predictor in bpred_table decides taken or not taken
+	return true and the target if the branch is predicted taken
+*/ 
+bool branchPrediction(uint64_t pc, uint32_t instr, uint64_t *target){
+	
+	if(bpred_mode == BPRED_STATIC){
+		// forwarding not taken, depending on immediate is positve or negative
+		uint64_t tem = (instr & 0x80000000) >> 20;
+		tem  += (instr & 0x80) << 3;
+		tem  += (instr & 0x7E000000) >> 21;
+		tem  += (instr & 0xF00) >> 8;
+		tem   = tem & 0xFFF;
+		tem   = converter(tem,0x800,0xFFFFFFFFFFFFF000);
+		if((int64_t)tem > 0){ // positive immediate means forwarding: no prediction, not taken
+			return false;
+		}
+	}
+	bool taken = bpred_table[bpred_mode].predict(pc);
+	
+	btb_lookups++;
+	struct model_btb *entry = check_btb(pc);
+	if(entry == NULL){
+		allocate_btb(pc); // add a new Tag
+		return false;
+	}
+	btb_hits++;
+	if(entry->pc != pc){
+		btb_aliases++;
+	}
+	if(!taken || !entry->target_valid){
+		return false;
+	}
+	// if BTB has the target for this pc, then setpc with stored target 
+	*target = entry->target;
+	set_pc(entry->target);
+	return true;
+}
+
+/*
+	Pipeline depth (setopt fetch_stages/execute_stages/memory_stages)
+		-the stage functions stay the same; the options say over how many
+		 cycles the i-cache access, the ALU and the d-cache access are
+		 spread, each of them pipelined so that one instruction can enter
+		 every cycle
+		-a result can be bypassed to an instruction that leaves decode
+		 stage execute_stages slots after its producer, or execute_stages
+		 + memory_stages slots after a load; decode stage sends bubbles
+		 until then, which is the one-cycle load-use interlock of the
+		 five-stage pipeline
+		-after a redirect from execute stage fetch stage sends
+		 fetch_stages - 1 + execute_stages - 1 bubbles more than the
+		 five-stage pipeline, fetch_stages - 1 after a redirect from decode
+		 stage or a taken prediction in fetch stage
+		-so a jal redirected from decode stage saves execute_stages bubbles
+		 over the execute stage redirect, which is what the jal stats count
+*/
+#define MAX_STAGES             8
+
+HART_LOCAL uint64_t fetch_stages = 1, execute_stages = 1, memory_stages = 1;
+HART_LOCAL uint64_t operand_distance[32]; // slots before decode stage lets a reader of the register go
+HART_LOCAL bool     operand_load[32];     // that writer is a load
+HART_LOCAL uint64_t refill_bubbles = 0;
+HART_LOCAL uint64_t refill_cycles = 0, load_use_stalls = 0, latency_stalls = 0, pair_interlock_cycles = 0;
+
+uint64_t instr_rs1(uint32_t instr){
+	uint32_t opcode = instr & 0x7F;
+	if(opcode == 0x57 || opcode == 0x07 || opcode == 0x27){
+		return vector_rs1(instr);
+	}
+	if(opcode == 0x37 || opcode == 0x17 || opcode == 0x6F || opcode == 0x0F || opcode == 0x73){
+		return 0;
+	}
+	return (instr >> 15) & 0x1F;
+}
+
+uint64_t instr_rs2(uint32_t instr){
+	uint32_t opcode = instr & 0x7F;
+	if(opcode == 0x33 || opcode == 0x3B || opcode == 0x23 || opcode == 0x63 || opcode == 0x2F){
+		return (instr >> 20) & 0x1F;
+	}
+	if(opcode == 0x57 || opcode == 0x07 || opcode == 0x27){
+		return vector_rs2(instr);
+	}
+	return 0;
+}
+
+bool instr_reads(uint32_t instr, uint64_t reg){
+	return reg != 0 && (instr_rs1(instr) == reg || instr_rs2(instr) == reg);
+}
+
+// destination register of instr, 0 if it writes none
+uint64_t instr_rd(uint32_t instr){
+	uint32_t opcode = instr & 0x7F;
+	if(opcode == 0x23 || opcode == 0x63 || opcode == 0x0F || opcode == 0x07 || opcode == 0x27){
+		return 0;
+	}
+	if(opcode == 0x73 && ((instr >> 12) & 0x7) == 0x0){ // ecall, ebreak; csr* write rd
+		return 0;
+	}
+	if(opcode == 0x57 && vector_funct(instr) != 63 && vector_funct(instr) != 67){ // vd is a vector register
+		return 0;
+	}
+	return (instr >> 7) & 0x1F;
+}
+
+void refill(uint64_t bubbles){
+	refill_bubbles = bubbles;
+}
+
+// one slot goes down from decode stage to execute stage
+void operand_distance_step(void){
+	for(int i = 0; i < 32; i++){
+		if(operand_distance[i] > 0){
+			operand_distance[i]--;
+		}
+	}
+}
+
+// instr leaves decode stage, its readers wait distance slots for the result
+void operand_distance_set(uint32_t instr, uint64_t distance, bool load){
+	uint64_t rd = instr_rd(instr);
+	if(rd == 0){
+		return;
+	}
+	operand_distance[rd] = distance;
+	operand_load[rd]     = load;
+}
+
+bool operand_waits(uint64_t reg){
+	return reg != 0 && operand_distance[reg] > 0;
+}
+
+/*
+	depth_interlock mainly tells decode stage to hold the group in it
+	until the results it reads can be bypassed, and counts why
+*/
+bool depth_interlock(void){
+	uint64_t rs[4] = {instr_rs1(cur_d_reg.instruction), instr_rs2(cur_d_reg.instruction), 0, 0};
+	if(cur_d_reg.pair){
+		rs[2] = instr_rs1(cur_d_reg.pair_instruction);
+		rs[3] = instr_rs2(cur_d_reg.pair_instruction);
+	}
+	for(int i = 0; i < 4; i++){
+		if(!operand_waits(rs[i])){
+			continue;
+		}
+		if(i >= 2 && !operand_waits(rs[0]) && !operand_waits(rs[1])){
+			pair_interlock_cycles++; // lane 0 alone could have gone
+		}
+		if(operand_load[rs[i]]){
+			load_use_stalls++;
+		}else{
+			latency_stalls++;
+		}
+		return true;
+	}
+	return false;
+}
+
+void print_depth_stats(void){
+	uint64_t cycles = get_cycle_counter();
+	printf("Pipeline depth: %" PRIu64 " stages (F %" PRIu64 ", D 1, X %" PRIu64 ", M %" PRIu64 ", W 1)\n",
+	       fetch_stages + execute_stages + memory_stages + 2, fetch_stages, execute_stages, memory_stages);
+	if(instructions_executed > 0){
+		printf("  CPI: %.3f\n", (double)cycles / instructions_executed);
+	}
+	printf("  Load-use stall cycles: %" PRIu64 "\n", load_use_stalls);
+	printf("  Execute latency stall cycles: %" PRIu64 "\n", latency_stalls);
+	printf("  Refill bubbles after redirects: %" PRIu64 "\n", refill_cycles);
+}
+
+/*
+	redirect mainly flushes the wrong path behind the instruction in execute
+	stage and restarts fetch at the correct pc
+*/
+HART_LOCAL bool execute_redirect = false; // execute stage redirected the pc in this cycle
+
+void redirect(struct stage_reg_m *new_m_reg, uint64_t pc){
+	new_m_reg->branch = true;
+	set_pc(pc);
+	repair_ras(cur_x_reg.ras_top, cur_x_reg.ras_top_value);
+	execute_redirect = true;
+	refill(fetch_stages - 1 + execute_stages - 1);
+}
+
+/*
+	train_branch mainly trains the direction predictor and the BTB with
+	the outcome of a conditional branch
+	return true if fetch stage went down the wrong way
+*/
+bool train_branch(uint64_t pc, uint64_t seq_pc, bool taken, uint64_t target, bool predicted, uint64_t predicted_pc){
+	uint64_t next_pc = taken ? target : seq_pc;
+	
+	bpred_branches++;
+	bpred_table[bpred_mode].update(pc, taken);
+	update_btb(pc, target);
+	
+	if(next_pc != predicted_pc){
+		bpred_mispredictions++;
+		if(taken && predicted){
+			bpred_target_mispredictions++;
+		}
+		return true;
+	}
+	return false;
+}
+
+/*
+	train_jump mainly trains the RAS or indirect predictor stats with the
+	target of a jal/jalr, return true if fetch stage went elsewhere
+*/
+bool train_jump(uint64_t pc, bool jalr, bool ras_predicted, uint64_t target, uint64_t predicted_pc){
+	if(ras_predicted){
+		if(target == predicted_pc){
+			ras_hits++;
+		}else{
+			ras_misses++;
+		}
+	}else if(jalr){
+		update_indirect(pc, target, predicted_pc);
+	}
+	return target != predicted_pc;
+}
+
+/*
+	resolve_branch mainly checks the outcome of a conditional branch in
+	execute stage against what fetch stage predicted for it
+		1. train the direction predictor and the BTB
+		2. if fetch went down the wrong way, redirect the pc and flush
+*/
+void resolve_branch(struct stage_reg_m *new_m_reg, bool taken, uint64_t target){
+	uint64_t predicted_pc = cur_x_reg.branch_prediction ? cur_x_reg.new_pc : cur_x_reg.seq_pc;
+	
+	if(cur_x_reg.early_resolved){ // decode stage resolved it already
+		return;
+	}
+	if(train_branch(cur_x_reg.pc, cur_x_reg.seq_pc, taken, target, cur_x_reg.branch_prediction, predicted_pc)){
+		redirect(new_m_reg, taken ? target : cur_x_reg.seq_pc);
+	}
+}
+
+/*
+	resolve_jump mainly checks the target of a jal/jalr in execute stage
+	against the pc fetch stage went to, and redirects if they differ
+*/
+void resolve_jump(struct stage_reg_m *new_m_reg, uint64_t target){
+	uint64_t predicted_pc = cur_x_reg.branch_prediction ? cur_x_reg.new_pc : cur_x_reg.seq_pc;
+	
+	if(train_jump(cur_x_reg.pc, cur_x_reg.funct == 50, cur_x_reg.ras_predicted, target, predicted_pc)){
+		redirect(new_m_reg, target);
+	}
+}
+
+/*
+	Unconditional jal redirect in decode stage
+		-the target of jal only depends on its pc and immediate, so decode
+		 stage can send fetch there instead of waiting for execute stage
+		-decode runs before fetch in a cycle, so the instruction fetched
+		 behind the jal is never wasted; without this execute stage flushes
+		 the one in decode stage and the ones in the execute slots ahead of
+		 it, execute_stages bubbles per jal
+*/
+HART_LOCAL bool     jal_decode_redirect = false;
+HART_LOCAL uint64_t jal_redirects = 0, jal_bubbles_saved = 0;
+
+void decode_jal(struct stage_reg_x *new_x_reg){
+	uint64_t target = cur_d_reg.pc + (new_x_reg->e[4] << 1);
+	
+	// a wrong-path jal must not override the redirect execute stage just did
+	if(!jal_decode_redirect || execute_redirect || new_x_reg->branch_prediction){
+		return;
+	}
+	set_pc(target);
+	refill(fetch_stages - 1);
+	new_x_reg->new_pc = target;
+	new_x_reg->branch_prediction = true;
+	jal_redirects++;
+	jal_bubbles_saved += execute_stages;
+}
+
+/*
+	Scoreboard and bypass network
+		-the scoreboard keeps, for every register, the youngest instruction
+		 in M or W stage that writes it (lane 1 is younger than lane 0 of
+		 the same stage); it is filled at the start of execute stage
+		-execute stage takes both operands of every instruction, both lanes,
+		 from the bypass network: M->X, then W->X, then the register file,
+		 which W stage has written earlier in the same cycle
+		-load-use interlock: an instruction reading the result of a load
+		 in execute stage stays in decode stage for one cycle and a bubble
+		 goes down instead, after which the load value comes W->X (more
+		 cycles with a deeper pipeline, see depth_interlock)
+		-should a load still be in M stage anyway, execute stage holds the
+		 instruction, sends a bubble to M stage and decode and fetch stage
+		 hold with it
+*/
+#define BYPASS_NONE            0 // register file
+#define BYPASS_M_X             1
+#define BYPASS_W_X             2
+#define BYPASS_PATHS           3
+
+struct model_scoreboard{
+	int      path;   // where the value of the youngest writer is
+	bool     ready;  // false while a load is fetching it
+	uint64_t value;
+};
+
+HART_LOCAL struct model_scoreboard scoreboard[32];
+HART_LOCAL bool     execute_hold = false; // execute stage waits for an operand, decode and fetch stage hold
+HART_LOCAL uint64_t bypass_uses[BYPASS_PATHS];
+HART_LOCAL uint64_t scoreboard_stall_cycles = 0;
+const char *bypass_path_name[BYPASS_PATHS] = {"register file", "M->X", "W->X"};
+
+void scoreboard_write(uint64_t reg, int path, bool ready, uint64_t value){
+	if(reg == 0){
+		return;
+	}
+	scoreboard[reg].path  = path;
+	scoreboard[reg].ready = ready;
+	scoreboard[reg].value = value;
+}
+
+/*
+	scoreboard_update mainly records the writers in M and W stage, oldest
+	first so that the youngest one stays
+*/
+void scoreboard_update(void){
+	memset(scoreboard, 0, sizeof(scoreboard));
+	// W stage writes unless it only carries a stall or a flush
+	if(!cur_w_reg.i_cache_stall && !cur_w_reg.d_cache_stall && !cur_w_reg.branch){
+		if(cur_w_reg.run){
+			scoreboard_write(cur_w_reg.destinationRegister, BYPASS_W_X, true, cur_w_reg.unsigned_passValue);
+		}
+		if(cur_w_reg.pair){
+			scoreboard_write(cur_w_reg.pair_rd, BYPASS_W_X, true, cur_w_reg.pair_result);
+		}
+	}
+	if(!cur_m_reg.i_cache_stall && !cur_m_reg.branch){
+		if(cur_m_reg.writeRun){
+			scoreboard_write(cur_m_reg.destinationRegister, BYPASS_M_X, !cur_m_reg.memoryRead, cur_m_reg.unsigned_passValue);
+		}
+		if(cur_m_reg.pair){
+			scoreboard_write(cur_m_reg.pair_rd, BYPASS_M_X, true, cur_m_reg.pair_result);
+		}
+	}
+}
+
+bool operand_ready(uint64_t reg){
+	return scoreboard[reg].path == BYPASS_NONE || scoreboard[reg].ready;
+}
+
+/*
+	bypass_operand mainly gives execute stage the newest value of reg
+	and counts the path it took
+*/
+uint64_t bypass_operand(uint64_t reg){
+	uint64_t value = 0;
+	if(reg == 0){
+		return 0;
+	}
+	bypass_uses[scoreboard[reg].path]++;
+	if(scoreboard[reg].path != BYPASS_NONE){
+		return scoreboard[reg].value;
+	}
+	register_read(reg, reg, &value, &value);
+	return value;
+}
+
+/*
+	execute_operands_ready mainly checks both lanes in execute stage
+	return false when execute stage has to hold
+*/
+bool execute_operands_ready(void){
+	uint32_t instr = cur_x_reg.instruction;
+	if(cur_x_reg.funct != 0 && (!operand_ready(instr_rs1(instr)) || !operand_ready(instr_rs2(instr)))){
+		return false;
+	}
+	return !cur_x_reg.pair || (operand_ready(cur_x_reg.pair_rs1_reg) && operand_ready(cur_x_reg.pair_rs2_reg));
+}
+
+/*
+	load_extend mainly sign-extends what lb, lh and lw read
+*/
+uint64_t load_extend(int funct, uint64_t value){
+	switch(funct){
+		case 1: return (uint64_t)(int64_t)(int8_t)value;
+		case 2: return (uint64_t)(int64_t)(int16_t)value;
+		case 3: return (uint64_t)(int64_t)(int32_t)value;
+	}
+	return value;
+}
+
+void execute_bubble(struct stage_reg_m *new_m_reg){
+	new_m_reg->funct = 0;
+	new_m_reg->instruction = 0x13; // nop
+	new_m_reg->memoryRead = false;
+	new_m_reg->memoryWrite = false;
+	new_m_reg->writeRun = false;
+	new_m_reg->branch = false;
+	new_m_reg->pair = false;
+}
+
+void print_bypass_stats(void){
+	uint64_t total = bypass_uses[BYPASS_NONE] + bypass_uses[BYPASS_M_X] + bypass_uses[BYPASS_W_X];
+	if(total == 0){ // nothing went through execute stage, or the out-of-order back end ran
+		return;
+	}
+	printf("Bypass network:\n");
+	for(int path = 0; path < BYPASS_PATHS; path++){
+		printf("  Operands from %s: %" PRIu64 " (%.2f%%)\n", bypass_path_name[path], bypass_uses[path], 100.0 * bypass_uses[path] / total);
+	}
+	printf("  Scoreboard stall cycles: %" PRIu64 "\n", scoreboard_stall_cycles);
+}
+
+/*
+	Early resolution of beq/bne in decode stage
+		-equality only needs a comparator, no subtract, so beq/bne can be
+		 resolved in decode stage with operands forwarded from M stage or
+		 read from the register file after W stage wrote it
+		-an operand produced by the instruction in execute stage, or by a
+		 load in memory stage, is not ready: decode stage holds the branch
+		 and sends a bubble down until it is
+		-a misprediction found in decode stage redirects fetch in the same
+		 cycle, saving the execute_stages bubbles of the redirect from
+		 execute stage
+*/
+HART_LOCAL bool     early_branch = false;
+HART_LOCAL bool     decode_hold = false; // decode stage holds its instruction, fetch must not advance
+HART_LOCAL uint64_t early_branch_resolved = 0, early_branch_stall_cycles = 0, early_branch_penalty_saved = 0;
+
+bool writes_register(int funct){
+	return !(funct == 0 || funct == 8 || funct == 9 || (funct >= 24 && funct <= 27) ||
+	         (funct >= 44 && funct <= 49) || funct == 52 || funct == 53 || (funct >= 64 && funct <= 66));
+}
+
+/*
+	decode_operand mainly finds the newest value of a source register
+	return false when the producer has not computed it yet
+*/
+bool decode_operand(uint64_t reg, uint64_t *value){
+	if(reg == 0){
+		*value = 0;
+		return true;
+	}
+	// the instructions in execute stage, unless execute stage is flushing them
+	if(!cur_m_reg.branch && ((writes_register(cur_x_reg.funct) && cur_x_reg.e[9] == reg) ||
+	                         (cur_x_reg.pair && cur_x_reg.pair_rd == reg))){
+		return false;
+	}
+	if(scoreboard[reg].path != BYPASS_NONE){
+		*value = scoreboard[reg].value;
+		return scoreboard[reg].ready;
+	}
+	return true;
+}
+
+/*
+	decode_branch mainly resolves a beq/bne in decode stage, or holds it
+	return false when decode stage has to hold the branch
+*/
+bool decode_branch(struct stage_reg_x *new_x_reg, bool bne){
+	uint64_t p_rs1 = new_x_reg->rs1, p_rs2 = new_x_reg->rs2;
+	uint64_t target = cur_d_reg.pc + (new_x_reg->e[10] << 1);
+	
+	// a wrong-path branch is flushed anyway
+	if(!early_branch || execute_redirect){
+		return true;
+	}
+	if(!decode_operand(new_x_reg->e[8], &p_rs1) || !decode_operand(new_x_reg->e[7], &p_rs2)){
+		early_branch_stall_cycles++;
+		return false;
+	}
+	
+	bool     taken        = (p_rs1 == p_rs2) != bne;
+	uint64_t next_pc      = taken ? target : cur_d_reg.seq_pc;
+	uint64_t predicted_pc = cur_d_reg.branch_prediction ? cur_d_reg.new_pc : cur_d_reg.seq_pc;
+	
+	early_branch_resolved++;
+	if(train_branch(cur_d_reg.pc, cur_d_reg.seq_pc, taken, target, cur_d_reg.branch_prediction, predicted_pc)){
+		set_pc(next_pc);
+		refill(fetch_stages - 1);
+		repair_ras(cur_d_reg.ras_top, cur_d_reg.ras_top_value);
+		early_branch_penalty_saved += execute_stages;
+	}
+	// execute stage only passes it on now
+	new_x_reg->branch_prediction = true;
+	new_x_reg->new_pc = next_pc;
+	new_x_reg->early_resolved = true;
+	return true;
+}
+
+void print_early_branch_stats(void){
+	if(!early_branch){
+		return;
+	}
+	printf("Early beq/bne resolution in decode:\n");
+	printf("  Resolved in decode: %" PRIu64 "\n", early_branch_resolved);
+	printf("  Penalty saved: %" PRIu64 " cycles\n", early_branch_penalty_saved);
+	printf("  Operand stall cycles: %" PRIu64 "\n", early_branch_stall_cycles);
+	printf("  Net: %" PRId64 " cycles\n", (int64_t)(early_branch_penalty_saved - early_branch_stall_cycles));
+}
+
+void print_jal_stats(void){
+	if(!jal_decode_redirect){
+		return;
+	}
+	printf("jal redirect in decode:\n");
+	printf("  Redirects: %" PRIu64 "\n", jal_redirects);
+	printf("  Bubbles saved: %" PRIu64 "\n", jal_bubbles_saved);
+}
+
+void print_btb_stats(void){
+	printf("BTB (%" PRIu64 " entries, %" PRIu64 "-way, %" PRIu64 "-bit tags):\n", btb_entries, btb_ways, btb_tag_bits);
+	printf("  Lookups/hits: %" PRIu64 "/%" PRIu64 "\n", btb_lookups, btb_hits);
+	printf("  Allocations/evictions: %" PRIu64 "/%" PRIu64 "\n", btb_allocations, btb_evictions);
+	printf("  Partial tag aliases: %" PRIu64 "\n", btb_aliases);
+}
+
+/*
+	Dual issue (issue_width 2)
+		-fetch stage takes the instruction at pc + 4 from the same i-cache
+		 line as a second lane when the pairing rules allow it:
+		 lane 0 is not a jump, branch, fence or system instruction, lane 1
+		 is a plain ALU instruction (the second ALU; the memory port and
+		 the multiplier stay with lane 0), and lane 1 does not read the
+		 register lane 0 writes
+		-lane 1 rides in the pair_* fields of the stage registers and is
+		 written back after lane 0
+		-lane 1 takes its operands from the bypass network like lane 0;
+		 decode stage holds (one bubble) a lane 1 reading a load in execute
+		 stage
+*/
+#define PAIR_OK                0
+#define PAIR_CONTROL           1 // lane 0 ends the fetch group
+#define PAIR_LINE_END          2 // pc + 4 is in the next i-cache line
+#define PAIR_NOT_ALU           3 // lane 1 needs the memory port, a multiplier or redirects
+#define PAIR_DEPENDENT         4 // lane 1 reads lane 0's result
+#define PAIR_COMPRESSED        5 // a lane is a 16-bit instruction
+#define PAIR_RULES             6
+
+HART_LOCAL uint64_t issue_width = 1;
+HART_LOCAL uint64_t issue_groups = 0, issue_pairs = 0;
+HART_LOCAL uint64_t pair_breaks[PAIR_RULES];
+const char *pair_rule_name[PAIR_RULES] = {"paired", "control in lane 0", "end of i-cache line", "lane 1 not ALU", "dependent", "compressed"};
+
+uint64_t sext32(uint64_t value){
+	return (uint64_t)(int64_t)(int32_t)value;
+}
+
+/*
+	alu_funct mainly decodes the instructions the second ALU can run
+	return their funct number as in stage_decode, 0 for any other
+*/
+int alu_funct(uint32_t instr){
+	uint32_t funct3 = (instr >> 12) & 0x7;
+	uint32_t funct7 = instr >> 25;
+	switch(instr & 0x7F){
+		case 0x13:
+			if(funct3 == 0x1){
+				return (funct7 >> 1) == 0 ? 11 : 0; // slli
+			}
+			if(funct3 == 0x5){
+				return (funct7 >> 1) == 0 ? 15 : (funct7 >> 1) == 0x10 ? 16 : 0; // srli, srai
+			}
+			return (int[]){10, 0, 12, 13, 14, 0, 17, 18}[funct3];
+		case 0x1B:
+			if(funct3 == 0x0){
+				return 20; // addiw
+			}
+			if(funct3 == 0x1){
+				return funct7 == 0 ? 21 : 0; // slliw
+			}
+			if(funct3 == 0x5){
+				return funct7 == 0 ? 22 : funct7 == 0x20 ? 23 : 0; // srliw, sraiw
+			}
+			return 0;
+		case 0x33:
+			if(funct7 == 0x20){
+				return funct3 == 0x0 ? 29 : funct3 == 0x5 ? 35 : 0; // sub, sra
+			}
+			return funct7 == 0 ? 28 + funct3 + (funct3 >= 0x1) + (funct3 >= 0x6) : 0; // add sll slt sltu xor srl or and
+		case 0x3B:
+			if(funct7 == 0x20){
+				return funct3 == 0x0 ? 40 : funct3 == 0x5 ? 43 : 0; // subw, sraw
+			}
+			if(funct7 != 0){
+				return 0;
+			}
+			return funct3 == 0x0 ? 39 : funct3 == 0x1 ? 41 : funct3 == 0x5 ? 42 : 0; // addw, sllw, srlw
+		case 0x37:
+			return 38; // lui
+		case 0x17:
+			return 19; // auipc
+	}
+	return 0;
+}
+
+uint64_t alu_result(int funct, uint64_t a, uint64_t b, uint64_t imm, uint64_t pc){
+	switch(funct){
+		case 10: return a + imm;
+		case 11: return a << (imm & 0x3F);
+		case 12: return (int64_t)a < (int64_t)imm;
+		case 13: return a < imm;
+		case 14: return a ^ imm;
+		case 15: return a >> (imm & 0x3F);
+		case 16: return (uint64_t)((int64_t)a >> (imm & 0x3F));
+		case 17: return a | imm;
+		case 18: return a & imm;
+		case 19: return pc + imm;
+		case 20: return sext32(a + imm);
+		case 21: return sext32((uint32_t)a << (imm & 0x1F));
+		case 22: return sext32((uint32_t)a >> (imm & 0x1F));
+		case 23: return sext32((uint32_t)((int32_t)a >> (imm & 0x1F)));
+		case 28: return a + b;
+		case 29: return a - b;
+		case 30: return a << (b & 0x3F);
+		case 31: return (int64_t)a < (int64_t)b;
+		case 32: return a < b;
+		case 33: return a ^ b;
+		case 34: return a >> (b & 0x3F);
+		case 35: return (uint64_t)((int64_t)a >> (b & 0x3F));
+		case 36: return a | b;
+		case 37: return a & b;
+		case 38: return imm;
+		case 39: return sext32(a + b);
+		case 40: return sext32(a - b);
+		case 41: return sext32((uint32_t)a << (b & 0x1F));
+		case 42: return sext32((uint32_t)a >> (b & 0x1F));
+		case 43: return sext32((uint32_t)((int32_t)a >> (b & 0x1F)));
+	}
+	return 0;
+}
+
+/*
+	pair_rule mainly applies the pairing rules to the instructions at
+	pc and pc + 4, second is the instruction at pc + 4
+*/
+int pair_rule(uint64_t pc, uint32_t first, uint32_t second){
+	uint32_t opcode = first & 0x7F;
+	if(opcode == 0x63 || opcode == 0x67 || opcode == 0x6F || opcode == 0x0F || opcode == 0x73){
+		return PAIR_CONTROL;
+	}
+	if((pc & 0xF) == 0xC){
+		return PAIR_LINE_END;
+	}
+	if((pc & 0x3) != 0 || (second & 0x3) != 0x3){
+		return PAIR_COMPRESSED;
+	}
+	if(alu_funct(second) == 0){
+		return PAIR_NOT_ALU;
+	}
+	if(instr_reads(second, instr_rd(first))){
+		return PAIR_DEPENDENT;
+	}
+	return PAIR_OK;
+}
+
+void decode_pair(struct stage_reg_x *new_x_reg){
+	uint32_t instr = cur_d_reg.pair_instruction;
+	uint32_t opcode = instr & 0x7F;
+	
+	new_x_reg->pair_rule = cur_d_reg.pair_rule;
+	new_x_reg->pair = cur_d_reg.pair;
+	if(!cur_d_reg.pair){
+		return;
+	}
+	new_x_reg->pair_instruction = instr;
+	new_x_reg->pair_funct   = alu_funct(instr);
+	new_x_reg->pair_rd      = (instr >> 7) & 0x1F;
+	new_x_reg->pair_rs1_reg = (instr >> 15) & 0x1F;
+	new_x_reg->pair_rs2_reg = (opcode == 0x33 || opcode == 0x3B) ? (instr >> 20) & 0x1F : 0;
+	if(opcode == 0x37 || opcode == 0x17){
+		new_x_reg->pair_rs1_reg = 0;
+		new_x_reg->pair_imm = sext32(instr & 0xFFFFF000);
+	}else{
+		new_x_reg->pair_imm = (uint64_t)((int64_t)(int32_t)instr >> 20);
+	}
+	register_read(new_x_reg->pair_rs1_reg, new_x_reg->pair_rs2_reg, &new_x_reg->pair_rs1, &new_x_reg->pair_rs2);
+}
+
+void execute_pair(struct stage_reg_m *new_m_reg){
+	if(cur_x_reg.funct != 0){
+		issue_groups++;
+		pair_breaks[cur_x_reg.pair_rule]++;
+	}
+	new_m_reg->pair = cur_x_reg.pair;
+	if(!cur_x_reg.pair){
+		return;
+	}
+	issue_pairs++;
+	instructions_executed++;
+	uint64_t a = bypass_operand(cur_x_reg.pair_rs1_reg);
+	uint64_t b = bypass_operand(cur_x_reg.pair_rs2_reg);
+	new_m_reg->pair_rd = cur_x_reg.pair_rd;
+	new_m_reg->pair_result = alu_result(cur_x_reg.pair_funct, a, b, cur_x_reg.pair_imm, cur_x_reg.pc + 4);
+}
+
+void print_dual_issue_stats(void){
+	if(issue_width < 2){
+		return;
+	}
+	printf("Dual issue:\n");
+	printf("  Issue groups: %" PRIu64 ", dual-issued: %" PRIu64 "\n", issue_groups, issue_pairs);
+	if(issue_groups > 0){
+		printf("  Dual-issue rate: %.2f%%\n", 100.0 * issue_pairs / issue_groups);
+		for(int rule = PAIR_CONTROL; rule < PAIR_RULES; rule++){
+			printf("  Not paired, %s: %" PRIu64 "\n", pair_rule_name[rule], pair_breaks[rule]);
+		}
+	}
+	printf("  Lane 1 interlock cycles: %" PRIu64 "\n", pair_interlock_cycles);
+	if(get_cycle_counter() > 0){
+		printf("  IPC: %.3f\n", (double)instructions_executed / get_cycle_counter());
+	}
+}
+
+/*
+	Multiply/divide unit (RV64M)
+		-decode stage gives every M instruction funct 60 (multiply), 61
+		 (divide) or 62 (remainder), execute stage gets the result of the
+		 exact instruction from muldiv_result
+		-the multiplier is pipelined: a multiply can start every cycle and
+		 its result can be bypassed mul_latency cycles later, decode stage
+		 only holds the instructions that read it
+		-the divider is iterative: a div/rem stays in execute stage for
+		 div_latency cycles and everything behind it holds, so the next
+		 div/rem cannot start before the divider is free
+		-the out-of-order back end uses the same latencies and starts one
+		 div/rem at a time
+*/
+#define MULDIV_MAX_LATENCY     64
+
+HART_LOCAL uint64_t mul_latency = 3, div_latency = 20;
+HART_LOCAL bool     divider_busy = false;
+HART_LOCAL uint64_t divider_left = 0;       // cycles the div/rem in execute stage still needs
+HART_LOCAL uint64_t divider_free_cycle = 0; // out-of-order back end
+HART_LOCAL uint64_t mul_count = 0, div_count = 0, divider_stall_cycles = 0;
+
+bool is_muldiv(uint32_t instr){
+	uint32_t opcode = instr & 0x7F;
+	return (opcode == 0x33 || opcode == 0x3B) && (instr >> 25) == 0x1;
+}
+
+bool is_divide(uint32_t instr){
+	return is_muldiv(instr) && ((instr >> 12) & 0x4);
+}
+
+// funct decode stage gives an M instruction
+int muldiv_funct(uint32_t instr){
+	uint32_t funct3 = (instr >> 12) & 0x7;
+	return funct3 < 0x4 ? 60 : funct3 < 0x6 ? 61 : 62;
+}
+
+/*
+	muldiv_result mainly runs an M extension instruction, division by zero
+	and overflow give what the ISA says instead of trapping the host
+*/
+uint64_t muldiv_result(uint32_t instr, uint64_t a, uint64_t b){
+	uint32_t funct3 = (instr >> 12) & 0x7;
+	if((instr & 0x7F) == 0x3B){ // *w: 32-bit operands, sign-extended result
+		int32_t x = (int32_t)a, y = (int32_t)b;
+		switch(funct3){
+			case 0x0: return sext32((uint32_t)x * (uint32_t)y);
+			case 0x4: return sext32(y == 0 ? UINT32_MAX : (x == INT32_MIN && y == -1) ? (uint32_t)x : (uint32_t)(x / y));
+			case 0x5: return sext32(y == 0 ? UINT32_MAX : (uint32_t)a / (uint32_t)b);
+			case 0x6: return sext32(y == 0 ? (uint32_t)x : (x == INT32_MIN && y == -1) ? 0 : (uint32_t)(x % y));
+			case 0x7: return sext32(y == 0 ? (uint32_t)a : (uint32_t)a % (uint32_t)b);
+		}
+		return 0;
+	}
+	int64_t x = (int64_t)a, y = (int64_t)b;
+	switch(funct3){
+		case 0x0: return a * b;
+		case 0x1: return (uint64_t)(((__int128)x * (__int128)y) >> 64);
+		case 0x2: return (uint64_t)(((__int128)x * (unsigned __int128)b) >> 64);
+		case 0x3: return (uint64_t)(((unsigned __int128)a * (unsigned __int128)b) >> 64);
+		case 0x4: return y == 0 ? UINT64_MAX : (x == INT64_MIN && y == -1) ? a : (uint64_t)(x / y);
+		case 0x5: return b == 0 ? UINT64_MAX : a / b;
+		case 0x6: return y == 0 ? a : (x == INT64_MIN && y == -1) ? 0 : (uint64_t)(x % y);
+		case 0x7: return b == 0 ? a : a % b;
+	}
+	return 0;
+}
+
+// slots from leaving decode stage until readers of the result may follow
+uint64_t result_distance(uint32_t instr){
+	if((instr & 0x7F) == 0x03 || (instr & 0x7F) == 0x2F){
+		return execute_stages + memory_stages;
+	}
+	if(is_muldiv(instr) && !is_divide(instr)){
+		return execute_stages + mul_latency - 1;
+	}
+	return execute_stages;
+}
+
+/*
+	divider_wait mainly keeps a div/rem in execute stage until the divider
+	is done with it, return true while it holds
+*/
+bool divider_wait(struct stage_reg_m *new_m_reg){
+	if(cur_x_reg.funct != 61 && cur_x_reg.funct != 62){
+		return false;
+	}
+	if(!divider_busy){
+		divider_busy = true;
+		divider_left = div_latency;
+	}
+	if(--divider_left > 0){
+		divider_stall_cycles++;
+		execute_hold = true;
+		execute_bubble(new_m_reg);
+		return true;
+	}
+	divider_busy = false;
+	return false;
+}
+
+void print_muldiv_stats(void){
+	if(mul_count + div_count == 0){
+		return;
+	}
+	printf("Multiply/divide unit (multiply %" PRIu64 " cycles pipelined, divide %" PRIu64 " cycles iterative):\n", mul_latency, div_latency);
+	printf("  Multiplies: %" PRIu64 ", divides/remainders: %" PRIu64 "\n", mul_count, div_count);
+	printf("  Divider stall cycles: %" PRIu64 "\n", divider_stall_cycles);
+}
+
+/*
+	Vector unit (RVV)
+		-32 vector registers of vlen bits (setopt vlen), vsetvli, vsetivli
+		 and vsetvl set vl and vtype; integer arithmetic, compares,
+		 merges, reductions, mask logic and moves to and from x registers,
+		 unit-stride, strided and indexed loads and stores with segments
+		-execute stage runs an arithmetic instruction over all vl elements
+		 at once; the unfilled part of the registers (tail) and the
+		 masked-off elements keep their old values
+		-timing: vector_lanes 64-bit lanes, each does 64/SEW elements a
+		 cycle, so an instruction takes ceil(vl * SEW / (64 * lanes))
+		 cycles (its chime) of the vector ALU or, for multiplies and
+		 divides, the vector multiplier; the first result comes out
+		 vector_latency (mul_latency) cycles after it starts
+		-an instruction waits in execute stage until its unit is free and
+		 its source registers are written; with vector_chaining it can
+		 start as soon as the first elements of a source come out, as long
+		 as it never overtakes the producer
+		-loads and stores go through the d-cache port in memory stage, one
+		 8-byte word a cycle (all elements in it for a load, a full word or
+		 one element for a store), and hold the pipeline until done
+		-unmasked vadd, vsub, vand, vor and vxor run on the host's SSE2
+		 (AVX2 when built with -mavx2) unit
+	The vector unit only works with the in-order back end.
+*/
+#define VLEN_MAX               4096
+#define VLENB_MAX              (VLEN_MAX / 8)
+#define VECTOR_MAX_LANES       64
+#define VTYPE_VILL             (1ULL << 63)
+
+#define VUNIT_ALU              0
+#define VUNIT_MUL              1
+#define VUNIT_NONE             -1 // not supported, runs as a nop
+
+#define VMEM_UNIT_STRIDE       0
+#define VMEM_INDEXED           1
+#define VMEM_STRIDED           2
+
+struct model_vmem{
+	uint32_t instruction;
+	int      mode;
+	bool     store;
+	bool     masked;
+	uint64_t base, stride;
+	uint64_t elements;     // elements per field
+	uint64_t fields;       // nf + 1, more than 1 for segment loads/stores
+	uint64_t field_regs;   // registers between two fields
+	uint64_t bytes;        // of a data element
+	uint64_t index_bytes;  // of an index element
+	uint64_t next;         // next access, element * fields + field
+};
+
+HART_LOCAL uint64_t vlen = 128, vector_lanes = 2, vector_latency = 2;
+HART_LOCAL bool     vector_chaining = false;
+HART_LOCAL uint8_t  vregs[32 * VLENB_MAX];  // v0..v31, a register group is contiguous
+HART_LOCAL uint64_t vl = 0, vtype = VTYPE_VILL;
+HART_LOCAL uint64_t vunit_free[2];          // cycle the vector ALU/multiplier can start again
+HART_LOCAL uint64_t vreg_first[32], vreg_ready[32]; // first/all elements of the register can be read
+HART_LOCAL bool     vector_waiting = false; // execute stage holds a vector instruction
+HART_LOCAL uint64_t vector_start = 0, vector_data_start = 0;
+HART_LOCAL struct model_vmem vmem;          // the load/store in memory stage
+
+HART_LOCAL uint64_t vector_config = 0, vector_arith = 0, vector_loads = 0, vector_stores = 0, vector_elements = 0;
+HART_LOCAL uint64_t vector_unit_busy[2], vector_busy_stalls = 0, vector_dependency_stalls = 0, vector_chained = 0;
+HART_LOCAL uint64_t vector_memory_cycles = 0, vector_memory_accesses = 0, vector_simd_elements = 0;
+const char *vector_unit_name[2] = {"ALU", "Multiplier"};
+
+uint64_t vsew_bytes(void){
+	return 1ULL << ((vtype >> 3) & 0x7);
+}
+
+// log2 of LMUL, -3 to 3
+int vlmul_shift(uint64_t type){
+	int lmul = type & 0x7;
+	return lmul < 4 ? lmul : lmul - 8;
+}
+
+// registers in a group of LMUL
+uint64_t vgroup_regs(void){
+	int shift = vlmul_shift(vtype);
+	return shift > 0 ? 1ULL << shift : 1;
+}
+
+uint64_t vlmax(uint64_t type){
+	uint64_t elements = vlen / (8ULL << ((type >> 3) & 0x7));
+	int      shift    = vlmul_shift(type);
+	return shift >= 0 ? elements << shift : elements >> -shift;
+}
+
+bool vtype_legal(uint64_t type){
+	uint64_t sew = 8ULL << ((type >> 3) & 0x7);
+	int      shift = vlmul_shift(type);
+	if(type >> 8 || ((type >> 3) & 0x7) > 3 || (type & 0x7) == 4){
+		return false;
+	}
+	return (shift >= 0 || sew <= (64ULL >> -shift)) && vlmax(type) > 0;
+}
+
+uint8_t* velem(uint64_t reg, uint64_t i, uint64_t bytes){
+	return &vregs[(reg * (vlen / 8) + i * bytes) % (32 * (vlen / 8))];
+}
+
+uint64_t vget(uint64_t reg, uint64_t i, uint64_t bytes){
+	uint64_t value = 0;
+	memcpy(&value, velem(reg, i, bytes), bytes);
+	return value;
+}
+
+void vput(uint64_t reg, uint64_t i, uint64_t bytes, uint64_t value){
+	memcpy(velem(reg, i, bytes), &value, bytes);
+}
+
+bool vmask_bit(uint64_t reg, uint64_t i){
+	return (*velem(reg, i / 8, 1) >> (i % 8)) & 0x1;
+}
+
+void vput_mask_bit(uint64_t reg, uint64_t i, bool bit){
+	uint8_t *p = velem(reg, i / 8, 1);
+	*p = (*p & ~(1 << (i % 8))) | (bit << (i % 8));
+}
+
+int64_t vsext(uint64_t value, uint64_t bytes){
+	int shift = 64 - 8 * bytes;
+	return (int64_t)(value << shift) >> shift;
+}
+
+uint64_t vtrunc(uint64_t value, uint64_t bytes){
+	return bytes == 8 ? value : value & ((1ULL << (8 * bytes)) - 1);
+}
+
+// funct decode stage gives a vector instruction, 0 if it is not one
+int vector_funct(uint32_t instr){
+	uint32_t opcode = instr & 0x7F;
+	uint32_t funct3 = (instr >> 12) & 0x7;
+	if(opcode == 0x07 || opcode == 0x27){ // widths 1-4 are scalar floating point
+		if(funct3 != 0x0 && funct3 < 0x5){
+			return 0;
+		}
+		return opcode == 0x07 ? 64 : 65;
+	}
+	if(funct3 == 0x7){
+		return 63; // vsetvli, vsetivli, vsetvl
+	}
+	if(funct3 == 0x2 && (instr >> 26) == 0x10){
+		return 67; // vmv.x.s, vcpop.m, vfirst.m
+	}
+	return 66;
+}
+
+// x register the vector instruction reads, see instr_rs1 and instr_rs2
+uint64_t vector_rs1(uint32_t instr){
+	uint32_t funct3 = (instr >> 12) & 0x7;
+	if((instr & 0x7F) != 0x57){
+		return (instr >> 15) & 0x1F; // base address
+	}
+	if(funct3 == 0x4 || funct3 == 0x6 || (funct3 == 0x7 && (instr >> 30) != 0x3)){
+		return (instr >> 15) & 0x1F;
+	}
+	return 0;
+}
+
+uint64_t vector_rs2(uint32_t instr){
+	if((instr & 0x7F) == 0x57){
+		return ((instr >> 12) & 0x7) == 0x7 && (instr >> 30) == 0x2 ? (instr >> 20) & 0x1F : 0; // vsetvl
+	}
+	return ((instr >> 26) & 0x3) == VMEM_STRIDED ? (instr >> 20) & 0x1F : 0;
+}
+
+/*
+	vector_unit mainly finds the unit an arithmetic instruction needs
+	return VUNIT_NONE when it is not supported
+*/
+int vector_unit(uint32_t instr){
+	uint32_t funct3 = (instr >> 12) & 0x7;
+	uint32_t funct6 = instr >> 26;
+	bool     opm    = funct3 == 0x2 || funct3 == 0x6;
+	if(funct3 == 0x1 || funct3 == 0x5 || funct3 == 0x7){ // floating point, vset*
+		return VUNIT_NONE;
+	}
+	if(!opm){
+		if(funct6 <= 0x0B && funct6 != 0x01 && funct6 != 0x08){
+			return funct6 == 0x02 && funct3 == 0x3 ? VUNIT_NONE : VUNIT_ALU; // no vsub.vi
+		}
+		if(funct6 == 0x17 || (funct6 >= 0x18 && funct6 <= 0x1F) || funct6 == 0x25 || funct6 == 0x28 || funct6 == 0x29){
+			return VUNIT_ALU;
+		}
+		return VUNIT_NONE;
+	}
+	if(funct3 == 0x2 && (funct6 <= 0x07 || (funct6 >= 0x18 && funct6 <= 0x1F))){ // reductions, mask logic
+		return VUNIT_ALU;
+	}
+	if(funct6 == 0x10){
+		return VUNIT_ALU;
+	}
+	if(funct6 >= 0x20 && funct6 <= 0x2F && funct6 != 0x28 && funct6 != 0x2A && funct6 != 0x2C && funct6 != 0x2E){
+		return VUNIT_MUL;
+	}
+	return VUNIT_NONE;
+}
+
+/*
+	vector_element mainly works out one element of an arithmetic
+	instruction, a is the vs2 element, b the vs1 element or the scalar,
+	d the old vd element; both already cut to bytes
+*/
+uint64_t vector_element(bool opm, uint32_t funct6, uint64_t a, uint64_t b, uint64_t d, uint64_t bytes){
+	int64_t  sa = vsext(a, bytes), sb = vsext(b, bytes);
+	uint64_t bits = 8 * bytes, sh = b & (bits - 1);
+	if(!opm){
+		switch(funct6){
+			case 0x00: return a + b;
+			case 0x02: return a - b;
+			case 0x03: return b - a;
+			case 0x04: return a < b ? a : b;
+			case 0x05: return sa < sb ? a : b;
+			case 0x06: return a > b ? a : b;
+			case 0x07: return sa > sb ? a : b;
+			case 0x09: return a & b;
+			case 0x0A: return a | b;
+			case 0x0B: return a ^ b;
+			case 0x18: return a == b;
+			case 0x19: return a != b;
+			case 0x1A: return a < b;
+			case 0x1B: return sa < sb;
+			case 0x1C: return a <= b;
+			case 0x1D: return sa <= sb;
+			case 0x1E: return a > b;
+			case 0x1F: return sa > sb;
+			case 0x25: return a << sh;
+			case 0x28: return a >> sh;
+			case 0x29: return (uint64_t)(sa >> sh);
+		}
+		return 0;
+	}
+	switch(funct6){
+		case 0x20: return b == 0 ? UINT64_MAX : a / b;
+		case 0x21: return sb == 0 ? UINT64_MAX : (sb == -1 && a == vtrunc(1ULL << (bits - 1), bytes)) ? a : (uint64_t)(sa / sb);
+		case 0x22: return b == 0 ? a : a % b;
+		case 0x23: return sb == 0 ? a : sb == -1 ? 0 : (uint64_t)(sa % sb);
+		case 0x24: return bytes == 8 ? (uint64_t)(((unsigned __int128)a * b) >> 64) : (a * b) >> bits;
+		case 0x25: return a * b;
+		case 0x26: return bytes == 8 ? (uint64_t)(((__int128)sa * (unsigned __int128)b) >> 64) : (uint64_t)((sa * (int64_t)b) >> bits);
+		case 0x27: return bytes == 8 ? (uint64_t)(((__int128)sa * sb) >> 64) : (uint64_t)((sa * sb) >> bits);
+		case 0x29: return b * d + a;  // vmadd
+		case 0x2B: return a - b * d;  // vnmsub
+		case 0x2D: return b * a + d;  // vmacc
+		case 0x2F: return d - b * a;  // vnmsac
+	}
+	return 0;
+}
+
+#if defined(__SSE2__)
+__m128i simd_splat(uint64_t value, uint64_t bytes){
+	switch(bytes){
+		case 1: return _mm_set1_epi8((char)value);
+		case 2: return _mm_set1_epi16((short)value);
+		case 4: return _mm_set1_epi32((int)value);
+	}
+	return _mm_set1_epi64x((long long)value);
+}
+
+__m128i simd_op(uint32_t funct6, __m128i a, __m128i b, uint64_t bytes){
+	switch(funct6){
+		case 0x09: return _mm_and_si128(a, b);
+		case 0x0A: return _mm_or_si128(a, b);
+		case 0x0B: return _mm_xor_si128(a, b);
+	}
+	switch(bytes){
+		case 1: return funct6 == 0x00 ? _mm_add_epi8(a, b)  : _mm_sub_epi8(a, b);
+		case 2: return funct6 == 0x00 ? _mm_add_epi16(a, b) : _mm_sub_epi16(a, b);
+		case 4: return funct6 == 0x00 ? _mm_add_epi32(a, b) : _mm_sub_epi32(a, b);
+	}
+	return funct6 == 0x00 ? _mm_add_epi64(a, b) : _mm_sub_epi64(a, b);
+}
+#endif
+
+#if defined(__AVX2__)
+__m256i simd_op256(uint32_t funct6, __m256i a, __m256i b, uint64_t bytes){
+	switch(funct6){
+		case 0x09: return _mm256_and_si256(a, b);
+		case 0x0A: return _mm256_or_si256(a, b);
+		case 0x0B: return _mm256_xor_si256(a, b);
+	}
+	switch(bytes){
+		case 1: return funct6 == 0x00 ? _mm256_add_epi8(a, b)  : _mm256_sub_epi8(a, b);
+		case 2: return funct6 == 0x00 ? _mm256_add_epi16(a, b) : _mm256_sub_epi16(a, b);
+		case 4: return funct6 == 0x00 ? _mm256_add_epi32(a, b) : _mm256_sub_epi32(a, b);
+	}
+	return funct6 == 0x00 ? _mm256_add_epi64(a, b) : _mm256_sub_epi64(a, b);
+}
+#endif
+
+/*
+	vector_simd mainly runs an unmasked vadd, vsub, vand, vor or vxor
+	(OPIVV, OPIVX or OPIVI) on the host's SIMD unit, b is NULL for a
+	scalar operand
+	return how many elements it did, the rest go one by one
+*/
+uint64_t vector_simd(uint32_t funct6, uint8_t *d, const uint8_t *a, const uint8_t *b, uint64_t scalar, uint64_t bytes, uint64_t n){
+	uint64_t done = 0, total = n * bytes;
+	if(funct6 != 0x00 && funct6 != 0x02 && funct6 != 0x09 && funct6 != 0x0A && funct6 != 0x0B){
+		return 0;
+	}
+#if defined(__SSE2__)
+	__m128i splat = simd_splat(scalar, bytes);
+#if defined(__AVX2__)
+	__m256i splat256 = _mm256_broadcastsi128_si256(splat);
+	for(; done + 32 <= total; done += 32){
+		__m256i y = b ? _mm256_loadu_si256((const __m256i *)(b + done)) : splat256;
+		__m256i x = _mm256_loadu_si256((const __m256i *)(a + done));
+		_mm256_storeu_si256((__m256i *)(d + done), simd_op256(funct6, x, y, bytes));
+	}
+#endif
+	for(; done + 16 <= total; done += 16){
+		__m128i y = b ? _mm_loadu_si128((const __m128i *)(b + done)) : splat;
+		__m128i x = _mm_loadu_si128((const __m128i *)(a + done));
+		_mm_storeu_si128((__m128i *)(d + done), simd_op(funct6, x, y, bytes));
+	}
+#endif
+	vector_simd_elements += done / bytes;
+	return done / bytes;
+}
+
+/*
+	vector_setvl mainly runs vsetvli, vsetivli and vsetvl
+	return the new vl, which goes to rd
+*/
+uint64_t vector_setvl(uint32_t instr, uint64_t a, uint64_t b){
+	uint64_t rs1 = (instr >> 15) & 0x1F, rd = (instr >> 7) & 0x1F;
+	uint64_t type, avl = a;
+	vector_config++;
+	if((instr >> 31) == 0){ // vsetvli
+		type = (instr >> 20) & 0x7FF;
+	}else if((instr >> 30) == 0x3){ // vsetivli
+		type = (instr >> 20) & 0x3FF;
+		avl  = rs1;
+	}else{ // vsetvl
+		type = b;
+	}
+	if((instr >> 30) != 0x3 && rs1 == 0){
+		avl = rd != 0 ? UINT64_MAX : vl; // vlmax, or keep vl
+	}
+	if(!vtype_legal(type)){
+		vtype = VTYPE_VILL;
+		vl    = 0;
+		return 0;
+	}
+	vtype = type;
+	vl    = avl < vlmax(type) ? avl : vlmax(type);
+	return vl;
+}
+
+/*
+	vector_execute mainly runs an arithmetic instruction (funct 66),
+	x is the scalar operand of a .vx instruction
+*/
+void vector_execute(uint32_t instr, uint64_t x){
+	uint32_t funct3 = (instr >> 12) & 0x7;
+	uint32_t funct6 = instr >> 26;
+	uint64_t vs2 = (instr >> 20) & 0x1F, vs1 = (instr >> 15) & 0x1F, vd = (instr >> 7) & 0x1F;
+	bool     vm  = (instr >> 25) & 0x1;
+	bool     opm = funct3 == 0x2 || funct3 == 0x6;
+	bool     vv  = funct3 == 0x0 || funct3 == 0x2;
+	uint64_t bytes = vsew_bytes(), group = vgroup_regs(), scalar = 0;
+	static const uint32_t reduce_op[8] = {0x00, 0x09, 0x0A, 0x0B, 0x04, 0x05, 0x06, 0x07};
+	
+	if((vtype & VTYPE_VILL) || vector_unit(instr) == VUNIT_NONE){
+		return;
+	}
+	if(funct3 == 0x3){
+		scalar = vtrunc((uint64_t)(((int64_t)vs1 << 59) >> 59), bytes); // simm5
+		if(funct6 == 0x25 || funct6 == 0x28 || funct6 == 0x29){
+			scalar = vs1; // uimm5
+		}
+	}else if(!vv){
+		scalar = vtrunc(x, bytes);
+	}
+	vector_elements += vl;
+	
+	if(opm && funct6 <= 0x07){ // vred*.vs: vd[0] = vs1[0] op vs2[*]
+		uint64_t acc = vget(vs1, 0, bytes);
+		if(vs2 % group != 0){
+			return;
+		}
+		for(uint64_t i = 0; i < vl; i++){
+			if(vm || vmask_bit(0, i)){
+				acc = vtrunc(vector_element(false, reduce_op[funct6], vget(vs2, i, bytes), acc, 0, bytes), bytes);
+			}
+		}
+		if(vl > 0){
+			vput(vd, 0, bytes, acc);
+		}
+		return;
+	}
+	if(opm && funct6 == 0x10){ // vmv.s.x
+		if(vl > 0){
+			vput(vd, 0, bytes, scalar);
+		}
+		return;
+	}
+	if(opm && funct6 >= 0x18 && funct6 <= 0x1F){ // vmandn.mm, vmand.mm, vmor.mm, vmxor.mm, vmorn.mm, vmnand.mm, vmnor.mm, vmxnor.mm
+		for(uint64_t i = 0; i < vl; i++){
+			bool a = vmask_bit(vs2, i), b = vmask_bit(vs1, i), bit;
+			switch(funct6 & 0x3){
+				case 0x0: bit = a & !b; break;
+				case 0x1: bit = a & b;  break;
+				case 0x2: bit = a | b;  break;
+				default:  bit = a ^ b;  break;
+			}
+			if(funct6 == 0x1C){
+				bit = a | !b;
+			}else if(funct6 > 0x1C){
+				bit = !bit;
+			}
+			vput_mask_bit(vd, i, bit);
+		}
+		return;
+	}
+	if(vs2 % group != 0 || (vv && vs1 % group != 0)){
+		return;
+	}
+	if(!opm && funct6 >= 0x18 && funct6 <= 0x1F){ // compares write a mask
+		for(uint64_t i = 0; i < vl; i++){
+			if(vm || vmask_bit(0, i)){
+				uint64_t b = vv ? vget(vs1, i, bytes) : scalar;
+				vput_mask_bit(vd, i, vector_element(false, funct6, vget(vs2, i, bytes), b, 0, bytes));
+			}
+		}
+		return;
+	}
+	if(vd % group != 0){
+		return;
+	}
+	if(!opm && funct6 == 0x17){ // vmv.v.* (vm = 1), vmerge.v*m
+		for(uint64_t i = 0; i < vl; i++){
+			uint64_t b = vv ? vget(vs1, i, bytes) : scalar;
+			vput(vd, i, bytes, vm || vmask_bit(0, i) ? b : vget(vs2, i, bytes));
+		}
+		return;
+	}
+	uint64_t i = 0;
+	if(vm && !opm){
+		i = vector_simd(funct6, velem(vd, 0, bytes), velem(vs2, 0, bytes), vv ? velem(vs1, 0, bytes) : NULL, scalar, bytes, vl);
+	}
+	for(; i < vl; i++){
+		if(vm || vmask_bit(0, i)){
+			uint64_t b = vv ? vget(vs1, i, bytes) : scalar;
+			vput(vd, i, bytes, vtrunc(vector_element(opm, funct6, vget(vs2, i, bytes), b, vget(vd, i, bytes), bytes), bytes));
+		}
+	}
+}
+
+/*
+	vector_scalar mainly runs vmv.x.s, vcpop.m and vfirst.m (funct 67)
+	return what goes to rd
+*/
+uint64_t vector_scalar(uint32_t instr){
+	uint64_t vs2 = (instr >> 20) & 0x1F, vs1 = (instr >> 15) & 0x1F, count = 0;
+	bool     vm  = (instr >> 25) & 0x1;
+	if(vtype & VTYPE_VILL){
+		return 0;
+	}
+	if(vs1 == 0x00){ // vmv.x.s
+		return (uint64_t)vsext(vget(vs2, 0, vsew_bytes()), vsew_bytes());
+	}
+	for(uint64_t i = 0; i < vl; i++){
+		if((vm || vmask_bit(0, i)) && vmask_bit(vs2, i)){
+			if(vs1 == 0x11){ // vfirst.m
+				return i;
+			}
+			count++;
+		}
+	}
+	return vs1 == 0x11 ? UINT64_MAX : count;
+}
+
+// registers in a group of EEW-bit elements, EMUL = EEW / SEW * LMUL
+uint64_t vemul_regs(uint64_t eew){
+	int shift = vlmul_shift(vtype);
+	for(uint64_t b = eew; b < vsew_bytes(); b <<= 1){
+		shift--;
+	}
+	for(uint64_t b = vsew_bytes(); b < eew; b <<= 1){
+		shift++;
+	}
+	return shift > 0 ? 1ULL << shift : 1;
+}
+
+// bytes of the elements in vs2 (index) or vd (data) of a vector load/store
+uint64_t vmem_eew(uint32_t instr){
+	uint32_t width = (instr >> 12) & 0x7;
+	return width == 0x0 ? 1 : 1ULL << (width - 4);
+}
+
+// registers the data of a vector load/store takes, all fields
+uint64_t vmem_regs(uint32_t instr){
+	uint64_t nf = ((instr >> 29) & 0x7) + 1, lumop = (instr >> 20) & 0x1F;
+	if(((instr >> 26) & 0x3) == VMEM_UNIT_STRIDE && lumop == 0x08){ // whole registers
+		return nf;
+	}
+	if(((instr >> 26) & 0x3) == VMEM_UNIT_STRIDE && lumop == 0x0B){ // mask
+		return 1;
+	}
+	return nf * (((instr >> 26) & 0x1) ? vgroup_regs() : vemul_regs(vmem_eew(instr)));
+}
+
+uint32_t vreg_mask(uint64_t reg, uint64_t regs){
+	return regs >= 32 ? UINT32_MAX << reg : (uint32_t)(((1ULL << regs) - 1) << reg);
+}
+
+/*
+	vector_registers mainly finds the vector registers an instruction
+	reads and writes, as bit masks, for the timing in execute stage
+*/
+void vector_registers(uint32_t instr, uint32_t *reads, uint32_t *writes){
+	uint32_t opcode = instr & 0x7F;
+	uint32_t funct3 = (instr >> 12) & 0x7;
+	uint32_t funct6 = instr >> 26;
+	uint64_t vs2 = (instr >> 20) & 0x1F, vs1 = (instr >> 15) & 0x1F, vd = (instr >> 7) & 0x1F;
+	uint64_t group = vgroup_regs();
+	bool     opm   = funct3 == 0x2 || funct3 == 0x6;
+	
+	*reads  = ((instr >> 25) & 0x1) ? 0 : 0x1; // v0 when masked
+	*writes = 0;
+	if(opcode == 0x07 || opcode == 0x27){
+		if((instr >> 26) & 0x1){ // indexed
+			*reads |= vreg_mask(vs2, vemul_regs(vmem_eew(instr)));
+		}
+		if(opcode == 0x27){
+			*reads |= vreg_mask(vd, vmem_regs(instr));
+		}else{
+			*writes = vreg_mask(vd, vmem_regs(instr));
+		}
+		return;
+	}
+	if(funct3 == 0x2 && funct6 == 0x10){ // vmv.x.s, vcpop.m, vfirst.m
+		*reads |= vreg_mask(vs2, 1);
+		return;
+	}
+	if(funct3 == 0x2 && funct6 <= 0x07){ // reductions
+		*reads |= vreg_mask(vs2, group) | vreg_mask(vs1, 1);
+		*writes = vreg_mask(vd, 1);
+		return;
+	}
+	if(funct3 == 0x2 && funct6 >= 0x18 && funct6 <= 0x1F){ // mask logic
+		*reads |= vreg_mask(vs2, 1) | vreg_mask(vs1, 1);
+		*writes = vreg_mask(vd, 1);
+		return;
+	}
+	if(funct3 == 0x6 && funct6 == 0x10){ // vmv.s.x
+		*writes = vreg_mask(vd, 1);
+		return;
+	}
+	if(!(funct6 == 0x17 && ((instr >> 25) & 0x1))){ // not vmv.v.*
+		*reads |= vreg_mask(vs2, group);
+	}
+	if(funct3 == 0x0 || funct3 == 0x2){
+		*reads |= vreg_mask(vs1, group);
+	}
+	if(opm && (funct6 & 0x29) == 0x29){ // vmadd, vnmsub, vmacc, vnmsac
+		*reads |= vreg_mask(vd, group);
+	}
+	*writes = !opm && funct6 >= 0x18 && funct6 <= 0x1F ? vreg_mask(vd, 1) : vreg_mask(vd, group); // compares write a mask
+}
+
+// cycles an instruction keeps its unit busy
+uint64_t vector_chime(void){
+	uint64_t bits = vl * vsew_bytes() * 8, width = vector_lanes * 64;
+	return bits == 0 ? 1 : (bits + width - 1) / width;
+}
+
+/*
+	vector_issue mainly holds a vector instruction in execute stage until
+	its unit and source registers let it start
+	return true while it holds
+*/
+bool vector_issue(struct stage_reg_m *new_m_reg){
+	uint64_t now = get_cycle_counter();
+	uint32_t reads, writes, instr = cur_x_reg.instruction;
+	int      unit = cur_x_reg.funct == 66 ? vector_unit(instr) : VUNIT_NONE;
+	uint64_t chime = vector_chime();
+	
+	if(cur_x_reg.funct < 64 || cur_x_reg.funct > 67){
+		return false;
+	}
+	vector_registers(instr, &reads, &writes);
+	if(!vector_waiting){
+		uint64_t first = 0, ready = 0;
+		for(int r = 0; r < 32; r++){
+			if(reads & (1U << r)){
+				first = vreg_first[r] > first ? vreg_first[r] : first;
+				ready = vreg_ready[r] > ready ? vreg_ready[r] : ready;
+			}
+		}
+		vector_data_start = ready;
+		if(vector_chaining && cur_x_reg.funct != 67){ // the consumer must not overtake the producer
+			vector_data_start = ready >= chime && ready - chime + 1 > first ? ready - chime + 1 : first;
+		}
+		vector_start = vector_data_start > now ? vector_data_start : now;
+		if(unit != VUNIT_NONE && vunit_free[unit] > vector_start){
+			vector_start = vunit_free[unit];
+		}
+		if(vector_start < ready){
+			vector_chained++;
+		}
+		vector_waiting = true;
+	}
+	if(now < vector_start){
+		if(now < vector_data_start){
+			vector_dependency_stalls++;
+		}else{
+			vector_busy_stalls++;
+		}
+		execute_hold = true;
+		execute_bubble(new_m_reg);
+		return true;
+	}
+	vector_waiting = false;
+	if(unit != VUNIT_NONE){
+		uint64_t latency = unit == VUNIT_MUL ? mul_latency : vector_latency;
+		vunit_free[unit] = now + chime;
+		vector_unit_busy[unit] += chime;
+		for(int r = 0; r < 32; r++){
+			if(writes & (1U << r)){
+				vreg_first[r] = now + latency;
+				vreg_ready[r] = now + chime - 1 + latency;
+			}
+		}
+	}
+	return false;
+}
+
+/*
+	vector_memory_setup mainly hands a vector load/store from execute
+	stage to memory stage
+*/
+void vector_memory_setup(uint32_t instr, uint64_t base, uint64_t stride){
+	uint32_t lumop = (instr >> 20) & 0x1F;
+	uint64_t eew   = vmem_eew(instr);
+	
+	memset(&vmem, 0, sizeof(vmem));
+	vmem.instruction = instr;
+	vmem.store    = (instr & 0x7F) == 0x27;
+	vmem.masked   = !((instr >> 25) & 0x1);
+	vmem.mode     = (instr >> 26) & 0x1 ? VMEM_INDEXED : (instr >> 26) & 0x3;
+	vmem.base     = base;
+	vmem.stride   = stride;
+	vmem.fields   = ((instr >> 29) & 0x7) + 1;
+	vmem.bytes    = vmem.mode == VMEM_INDEXED ? vsew_bytes() : eew;
+	vmem.index_bytes = eew;
+	vmem.elements = (vtype & VTYPE_VILL) ? 0 : vl;
+	vmem.field_regs = vmem.mode == VMEM_INDEXED ? vgroup_regs() : vemul_regs(eew);
+	if(vmem.mode == VMEM_UNIT_STRIDE && lumop == 0x08){ // whole registers
+		vmem.elements = vmem.fields * (vlen / 8) / eew;
+		vmem.fields   = 1;
+		vmem.masked   = false;
+	}else if(vmem.mode == VMEM_UNIT_STRIDE && lumop == 0x0B){ // vlm.v, vsm.v
+		vmem.elements = (vmem.elements + 7) / 8;
+		vmem.bytes    = 1;
+		vmem.fields   = 1;
+	}
+	if(vmem.store){
+		vector_stores++;
+	}else{
+		vector_loads++;
+	}
+	vector_elements += vmem.elements;
+}
+
+uint64_t vmem_address(uint64_t k){
+	uint64_t i = k / vmem.fields, f = k % vmem.fields;
+	switch(vmem.mode){
+		case VMEM_STRIDED:
+			return vmem.base + i * vmem.stride + f * vmem.bytes;
+		case VMEM_INDEXED:
+			return vmem.base + vget((vmem.instruction >> 20) & 0x1F, i, vmem.index_bytes) + f * vmem.bytes;
+	}
+	return vmem.base + k * vmem.bytes;
+}
+
+// vector register the access goes to or comes from
+uint64_t vmem_register(uint64_t k){
+	return ((vmem.instruction >> 7) & 0x1F) + (k % vmem.fields) * vmem.field_regs;
+}
+
+// next access at or after k that is not masked off
+uint64_t vmem_skip(uint64_t k){
+	while(k < vmem.elements * vmem.fields && vmem.masked && !vmask_bit(0, k / vmem.fields)){
+		k++;
+	}
+	return k;
+}
+
+void vector_memory_done(struct stage_reg_w *new_w_reg){
+	uint32_t reads, writes;
+	if(!vmem.store){ // the loaded registers can be read from now on
+		vector_registers(vmem.instruction, &reads, &writes);
+		for(int r = 0; r < 32; r++){
+			if(writes & (1U << r)){
+				vreg_first[r] = vreg_ready[r] = get_cycle_counter();
+			}
+		}
+	}
+	new_w_reg->d_cache_stall = false;
+}
+
+/*
+	vector_memory mainly does the next accesses of the vector load/store
+	in memory stage, all the elements in one 8-byte word for a load, the
+	whole word or one element for a store
+	return true while memory stage holds it
+*/
+bool vector_memory(struct stage_reg_w *new_w_reg){
+	uint64_t result_array[2], temp, paddr;
+	uint64_t total = vmem.elements * vmem.fields;
+	uint64_t k = vmem_skip(vmem.next);
+	
+	vector_memory_cycles++;
+	if(k == total){ // nothing (more) to access
+		memory_port_idle();
+		vector_memory_done(new_w_reg);
+		return false;
+	}
+	uint64_t address = vmem_address(k);
+	uint64_t word    = address & ~0x7ULL;
+	if(!translate(&dtlb, address, vmem.store ? TLB_WRITE : TLB_READ, &paddr)){
+		new_w_reg->d_cache_stall = true;
+		new_w_reg->tlb_stall = true;
+		return true;
+	}
+	m_stage_paddr = paddr;
+	paddr -= address - word; // the word
+	
+	if(!vmem.store){
+		if(check_d_cache(d_cache, paddr, 8, result_array)[0] == 1){
+			memory_port_idle();
+		}else if(coherence_access(&coherence_demand, paddr, 8, false)){
+			new_w_reg->d_cache_stall = true;
+			new_w_reg->vector_stall = true;
+			memory_port_idle();
+			return true;
+		}else if(memory_read_l2(paddr, &temp, 8)){ // no memory latency
+			update_d_cache(d_cache, paddr, temp);
+			result_array[1] = temp;
+		}else{
+			new_w_reg->d_cache_stall = true;
+			return true;
+		}
+		forward_store_buffer(paddr, 8, &result_array[1]);
+		for(; k < total && (vmem_address(k) & ~0x7ULL) == word; k = vmem_skip(k + 1)){
+			vput(vmem_register(k), k / vmem.fields, vmem.bytes, result_array[1] >> (8 * (vmem_address(k) - word)));
+		}
+	}else{
+		uint64_t value = 0, bytes = 0, next = k, end = address;
+		for(; next < total && vmem_address(next) == end && end - word < 8; next = vmem_skip(next + 1)){
+			memcpy((uint8_t *)&value + (end - word), velem(vmem_register(next), next / vmem.fields, vmem.bytes), vmem.bytes);
+			end   += vmem.bytes;
+			bytes += vmem.bytes;
+		}
+		if(address == word && bytes == 8){ // the whole word in one write
+			k = next;
+		}else{
+			value = vget(vmem_register(k), k / vmem.fields, vmem.bytes);
+			bytes = vmem.bytes;
+			paddr = m_stage_paddr;
+			k = vmem_skip(k + 1);
+		}
+		if(store_buffer_enabled){
+			if(!insert_store_buffer(paddr, value, bytes)){
+				sb_full_stall_cycles++;
+				new_w_reg->d_cache_stall = true;
+				new_w_reg->store_buffer_stall = true;
+				memory_port_idle();
+				return true;
+			}
+			memory_port_idle();
+		}else if(coherence_access(&coherence_demand, paddr, bytes, true)){
+			new_w_reg->d_cache_stall = true;
+			new_w_reg->vector_stall = true;
+			memory_port_idle();
+			return true;
+		}else{
+			memory_write_l2(paddr, value, bytes);
+			write_d_cache(d_cache, paddr, value, bytes);
+		}
+	}
+	vector_memory_accesses++;
+	vmem.next = k;
+	if(k < total){
+		new_w_reg->d_cache_stall = true;
+		new_w_reg->vector_stall = true;
+		return true;
+	}
+	vector_memory_done(new_w_reg);
+	return false;
+}
+
+void print_vector_stats(void){
+	if(vector_config + vector_arith + vector_loads + vector_stores == 0){
+		return;
+	}
+	printf("Vector unit (VLEN %" PRIu64 ", %" PRIu64 " lanes, chaining %s):\n", vlen, vector_lanes, vector_chaining ? "on" : "off");
+	printf("  vset* instructions: %" PRIu64 ", arithmetic: %" PRIu64 ", loads: %" PRIu64 ", stores: %" PRIu64 "\n",
+	       vector_config, vector_arith, vector_loads, vector_stores);
+	printf("  Elements: %" PRIu64 "\n", vector_elements);
+	for(int unit = 0; unit < 2; unit++){
+		printf("  %s busy cycles: %" PRIu64 "\n", vector_unit_name[unit], vector_unit_busy[unit]);
+	}
+	printf("  Stall cycles for a busy unit: %" PRIu64 ", for source registers: %" PRIu64 "\n", vector_busy_stalls, vector_dependency_stalls);
+	printf("  Instructions started before their sources were complete (chained): %" PRIu64 "\n", vector_chained);
+	printf("  Memory stage cycles: %" PRIu64 ", d-cache accesses: %" PRIu64 "\n", vector_memory_cycles, vector_memory_accesses);
+	printf("  Elements done by host SIMD kernels: %" PRIu64 "\n", vector_simd_elements);
+}
+
+/*
+	Atomic memory operations (RV64A)
+		-lr, sc and amo* (.w and .d) are funct 68; execute stage takes the
+		 address from rs1 and passes rs2 along
+		-memory stage first lets the store buffer drain, like for a fence,
+		 then hands the whole read-modify-write to memory_atomic, which no
+		 other hart can split; memory stage does its accesses one at a time
+		 in program order, so the aq/rl bits need nothing more
+		-atomics go around the d-cache and drop this hart's cached copies
+		 of the 8-byte line, the next load fetches the new value; the copies
+		 of other harts are invalidated like for a store
+*/
+HART_LOCAL bool     atomic_issued = false; // memory stage started the atomic it holds
+HART_LOCAL bool     atomic_done = false;
+HART_LOCAL uint64_t atomic_value = 0;
+HART_LOCAL uint64_t atomic_lr = 0, atomic_sc = 0, atomic_sc_failures = 0, atomic_amo = 0, atomic_stall_cycles = 0;
+
+// AMO_* operation of an atomic instruction
+int atomic_op(uint32_t instr){
+	return instr >> 27;
+}
+
+/*
+	drop_d_copies mainly removes the copies of the 8-byte line at address
+	from the d-cache, the victim cache and the L2
+*/
+void drop_d_copies(uint64_t address){
+	int tag   = (address & 0xFFFFC000) >> 14;
+	int index = (address & 0x3FF8) >> 3;
+	if(d_cache[index].valid_bit == 1 && d_cache[index].tag == tag){
+		d_cache[index].valid_bit = 0;
+	}
+	invalidate_victim_cache(address & ~0x7ULL, 8);
+	if(l2_enabled){
+		struct model_l2_cache *entry = find_l2_line(address);
+		if(entry != NULL){
+			entry->valid_bit[(address >> 3) & 1] = 0;
+		}
+	}
+}
+
+/*
+	atomic_access mainly does the atomic memory stage holds, result is the
+	old memory value (sign-extended for .w), or the sc status
+	return false while it waits for memory
+*/
+bool atomic_access(uint32_t instr, uint64_t address, uint64_t operand, uint64_t size, uint64_t *result){
+	uint64_t unused, written;
+	if(!atomic_issued){
+		if(atomic_op(instr) != AMO_LR && coherence_access(&coherence_demand, address, size, true)){
+			return false;
+		}
+		atomic_value  = operand;
+		atomic_done   = memory_atomic(address, &atomic_value, &written, size, atomic_op(instr));
+		atomic_issued = true;
+		if(atomic_op(instr) != AMO_LR){
+			drop_d_copies(address);
+		}
+		if(atomic_op(instr) != AMO_LR && (atomic_op(instr) != AMO_SC || atomic_value == 0)){
+			coherence_write(address, written, size);
+		}
+	}else if(!atomic_done){
+		atomic_done = memory_status(address, &unused);
+		memory_port_idle();
+	}
+	if(!atomic_done){
+		atomic_stall_cycles++;
+		return false;
+	}
+	atomic_issued = false;
+	if(atomic_op(instr) == AMO_LR){
+		atomic_lr++;
+	}else if(atomic_op(instr) == AMO_SC){
+		atomic_sc++;
+		atomic_sc_failures += atomic_value != 0;
+	}else{
+		atomic_amo++;
+	}
+	*result = size == 4 ? sext32(atomic_value) : atomic_value;
+	return true;
+}
+
+void print_atomic_stats(void){
+	if(atomic_lr + atomic_sc + atomic_amo == 0){
+		return;
+	}
+	printf("Atomics:\n");
+	printf("  lr: %" PRIu64 ", sc: %" PRIu64 " (failed: %" PRIu64 "), amo: %" PRIu64 "\n", atomic_lr, atomic_sc, atomic_sc_failures, atomic_amo);
+	printf("  Memory stage cycles waiting for memory: %" PRIu64 "\n", atomic_stall_cycles);
+}
+
+/*
+	ebreak_retired mainly tells sim_drained that an ebreak has left
+	writeback stage, or the reorder buffer, since fetch stage last fetched
+	anything else; fetch stage stays on an ebreak and sends it again every
+	cycle, so when one of them retires everything older has retired
+*/
+HART_LOCAL bool ebreak_retired = false;
+
+/*
+	Out-of-order back end (setopt ooo 1)
+		-fetch and decode stage stay as they are; execute stage renames the
+		 decoded instruction (both lanes with issue_width 2) into a reorder
+		 buffer, the physical register file and the issue and load/store
+		 queues, then issues up to ooo_width ready instructions, oldest first
+		-renaming keeps a map from architectural to physical registers; a
+		 mispredicted branch or jump frees the registers of everything
+		 younger while rolling the map back, and redirects fetch
+		-memory stage runs the load/store queue: stores write the d-cache
+		 and memory when they reach the head of the reorder buffer, loads
+		 wait for every older store address, take the data of an older store
+		 to the same bytes, and otherwise go to the d-cache; a load hits
+		 under one outstanding miss
+		-writeback stage commits up to ooo_width instructions in order into
+		 the register file; the hart stops at an ebreak once it commits
+	The store buffer and prefetcher only work with the in-order back end.
+	There is no vector unit: a vector instruction that reaches the head of
+	the reorder buffer stops the hart with a message.
+*/
+#define ROB_MAX_ENTRIES        256
+#define PHYS_MAX_REGS          512
+#define OOO_NOT_READY          UINT64_MAX
+
+#define OOO_NOP                0 // fence, system: nothing to execute
+#define OOO_ALU                1
+#define OOO_MULDIV             2
+#define OOO_LOAD               3
+#define OOO_STORE              4
+#define OOO_BRANCH             5
+#define OOO_JUMP               6
+#define OOO_ATOMIC             7
+#define OOO_VECTOR             8 // never executes, stops the hart at commit
+
+#define LOAD_WAITING           0
+#define LOAD_MISS              1
+#define LOAD_DONE              2
+
+#define DISPATCH_ROB_FULL      0
+#define DISPATCH_IQ_FULL       1
+#define DISPATCH_LSQ_FULL      2
+#define DISPATCH_NO_REGISTER   3
+#define DISPATCH_STALLS        4
+
+struct model_rob{
+	bool     valid_bit;
+	bool     issued;
+	uint64_t tag;          // dispatch number, tells a reused entry apart
+	uint64_t pc;
+	uint64_t seq_pc;       // pc of the next instruction in program order
+	uint32_t instruction;
+	int      op;
+	int      alu;          // alu_funct of an OOO_ALU
+	uint64_t rd, prd, old_prd;
+	uint64_t prs1, prs2;
+	uint64_t imm;
+	uint64_t ready_cycle;  // result is there (and it may commit) from this cycle on
+	bool     branch_prediction;
+	bool     ras_predicted;
+	int      ras_top;
+	uint64_t ras_top_value;
+	uint64_t predicted_pc;
+	// load/store queue part
+	bool     address_ready;
+	uint64_t address;
+	uint64_t store_data;
+	uint64_t size;
+	bool     sign;         // sign-extending load
+	int      load_state;
+};
+
+HART_LOCAL bool     ooo_enabled = false;
+HART_LOCAL uint64_t rob_entries = 32, iq_entries = 16, lsq_entries = 16, phys_regs = 64, ooo_width = 2;
+
+HART_LOCAL struct model_rob rob[ROB_MAX_ENTRIES];
+HART_LOCAL uint64_t rob_head = 0, rob_count = 0, iq_count = 0, lsq_count = 0, rob_tag = 0;
+HART_LOCAL uint64_t rename_map[32];
+HART_LOCAL uint64_t prf_value[PHYS_MAX_REGS], prf_ready[PHYS_MAX_REGS];
+HART_LOCAL uint64_t free_regs[PHYS_MAX_REGS], free_count = 0;
+
+HART_LOCAL bool     ooo_dispatch_stall = false; // decode stage holds, the back end is full
+HART_LOCAL bool     ooo_drop_next = false;      // what decode stage sent after a redirect is wrong-path
+HART_LOCAL bool     ooo_miss_active = false;
+HART_LOCAL uint64_t ooo_miss_line = 0, ooo_miss_tag = 0;
+HART_LOCAL bool     ooo_store_pending = false;  // a store write still occupies the memory port
+HART_LOCAL uint64_t ooo_store_address = 0;
+HART_LOCAL bool     ooo_stopped = false;        // a vector instruction reached commit
+
+HART_LOCAL uint64_t ooo_cycles = 0, ooo_committed = 0, ooo_recoveries = 0, ooo_squashed = 0;
+HART_LOCAL uint64_t rob_occupancy = 0, rob_max_occupancy = 0, iq_occupancy = 0, lsq_occupancy = 0;
+HART_LOCAL uint64_t dispatch_stalls[DISPATCH_STALLS], frontend_empty_cycles = 0;
+HART_LOCAL uint64_t commit_load_stalls = 0, commit_execute_stalls = 0, commit_store_stalls = 0;
+HART_LOCAL uint64_t lsq_forwards = 0, lsq_order_stalls = 0, lsq_miss_stalls = 0;
+const char *dispatch_stall_name[DISPATCH_STALLS] = {"ROB full", "issue queue full", "load/store queue full", "no free register"};
+
+struct model_rob* rob_at(uint64_t k){ // k-th oldest
+	return &rob[(rob_head + k) % rob_entries];
+}
+
+void ooo_reset(void){
+	memset(rob, 0, sizeof(rob));
+	rob_head = rob_count = iq_count = lsq_count = 0;
+	for(int r = 0; r < 32; r++){
+		rename_map[r] = r;
+		prf_ready[r] = 0;
+	}
+	free_count = 0;
+	for(uint64_t p = phys_regs; p-- > 32;){
+		free_regs[free_count++] = p;
+	}
+	prf_value[0] = 0;
+	ooo_miss_active = ooo_store_pending = ooo_dispatch_stall = ooo_drop_next = ooo_stopped = false;
+}
+
+uint64_t imm_s(uint32_t instr){
+	return (uint64_t)(((int64_t)(int32_t)(instr & 0xFE000000) >> 20) | ((instr >> 7) & 0x1F));
+}
+
+uint64_t imm_b(uint32_t instr){
+	return (uint64_t)(((int64_t)(int32_t)(instr & 0x80000000) >> 19) | ((instr & 0x80) << 4) |
+	                  ((instr >> 20) & 0x7E0) | ((instr >> 7) & 0x1E));
+}
+
+uint64_t imm_j(uint32_t instr){
+	return (uint64_t)(((int64_t)(int32_t)(instr & 0x80000000) >> 11) | (instr & 0xFF000) |
+	                  ((instr >> 9) & 0x800) | ((instr >> 20) & 0x7FE));
+}
+
+/*
+	ooo_classify mainly fills op, registers and immediate of an entry from
+	the instruction bits, decode stage's funct numbers miss some of them
+*/
+void ooo_classify(struct model_rob *e, uint64_t *rs1, uint64_t *rs2){
+	uint32_t instr  = e->instruction;
+	uint32_t opcode = instr & 0x7F;
+	uint32_t funct3 = (instr >> 12) & 0x7;
+	
+	*rs1 = (instr >> 15) & 0x1F;
+	*rs2 = 0;
+	e->rd  = instr_rd(instr);
+	e->imm = (uint64_t)((int64_t)(int32_t)instr >> 20);
+	e->alu = alu_funct(instr);
+	switch(opcode){
+		case 0x37:
+		case 0x17:
+			*rs1   = 0;
+			e->imm = sext32(instr & 0xFFFFF000);
+			e->op  = OOO_ALU;
+			return;
+		case 0x33:
+		case 0x3B:
+			*rs2  = (instr >> 20) & 0x1F;
+			e->op = e->alu != 0 ? OOO_ALU : (instr >> 25) == 0x1 ? OOO_MULDIV : OOO_NOP;
+			break;
+		case 0x13:
+		case 0x1B:
+			e->op = e->alu != 0 ? OOO_ALU : OOO_NOP;
+			break;
+		case 0x03:
+			e->op   = funct3 == 0x7 ? OOO_NOP : OOO_LOAD;
+			e->size = 1ULL << (funct3 & 0x3);
+			e->sign = !(funct3 & 0x4);
+			break;
+		case 0x23:
+			*rs2    = (instr >> 20) & 0x1F;
+			e->op   = funct3 > 0x3 ? OOO_NOP : OOO_STORE;
+			e->size = 1ULL << (funct3 & 0x3);
+			e->imm  = imm_s(instr);
+			break;
+		case 0x63:
+			*rs2   = (instr >> 20) & 0x1F;
+			e->op  = OOO_BRANCH;
+			e->imm = imm_b(instr);
+			break;
+		case 0x6F:
+			*rs1   = 0;
+			e->op  = OOO_JUMP;
+			e->imm = imm_j(instr);
+			break;
+		case 0x67:
+			e->op = OOO_JUMP;
+			break;
+		case 0x2F:
+			*rs2    = (instr >> 20) & 0x1F;
+			e->op   = (funct3 == 0x2 || funct3 == 0x3) ? OOO_ATOMIC : OOO_NOP;
+			e->size = funct3 == 0x2 ? 4 : 8;
+			e->imm  = 0;
+			break;
+		case 0x73:
+			if(funct3 == 0x2 && (instr >> 20) == 0xF14){ // csrr of mhartid, an addi to x0
+				*rs1   = 0;
+				e->alu = 10;
+				e->imm = get_hart_id();
+				e->op  = OOO_ALU;
+				break;
+			}
+			e->op = OOO_NOP;
+			break;
+		case 0x07:
+		case 0x27:
+		case 0x57:
+			e->op = OOO_VECTOR;
+			break;
+		default:
+			e->op = OOO_NOP;
+	}
+	if(e->op == OOO_NOP || e->op == OOO_VECTOR){
+		*rs1 = *rs2 = 0;
+		e->rd = 0;
+	}
+}
+
+/*
+	ooo_dispatch mainly renames a group of decoded instructions into the
+	back end, all of them or none
+	return false and the reason when a structure is full
+*/
+bool ooo_dispatch(struct model_rob group[], int n, int *reason){
+	uint64_t rs1[2], rs2[2], need_iq = 0, need_lsq = 0, need_regs = 0;
+	for(int i = 0; i < n; i++){
+		ooo_classify(&group[i], &rs1[i], &rs2[i]);
+		need_iq   += group[i].op != OOO_NOP && group[i].op != OOO_VECTOR;
+		need_lsq  += group[i].op == OOO_LOAD || group[i].op == OOO_STORE || group[i].op == OOO_ATOMIC;
+		need_regs += group[i].rd != 0;
+	}
+	if(rob_count + n > rob_entries){
+		*reason = DISPATCH_ROB_FULL;
+		return false;
+	}
+	if(iq_count + need_iq > iq_entries){
+		*reason = DISPATCH_IQ_FULL;
+		return false;
+	}
+	if(lsq_count + need_lsq > lsq_entries){
+		*reason = DISPATCH_LSQ_FULL;
+		return false;
+	}
+	if(free_count < need_regs){
+		*reason = DISPATCH_NO_REGISTER;
+		return false;
+	}
+	
+	for(int i = 0; i < n; i++){
+		struct model_rob *e = rob_at(rob_count++);
+		*e = group[i];
+		e->valid_bit   = true;
+		e->tag         = ++rob_tag;
+		e->prs1        = rename_map[rs1[i]];
+		e->prs2        = rename_map[rs2[i]];
+		e->prd         = 0;
+		e->issued      = e->op == OOO_NOP || e->op == OOO_VECTOR;
+		e->ready_cycle = e->op == OOO_NOP ? get_cycle_counter() : OOO_NOT_READY;
+		e->address_ready = false;
+		e->load_state  = LOAD_WAITING;
+		if(e->rd != 0){
+			e->prd     = free_regs[--free_count];
+			e->old_prd = rename_map[e->rd];
+			rename_map[e->rd] = e->prd;
+			prf_ready[e->prd] = OOO_NOT_READY;
+		}
+		iq_count  += !e->issued;
+		lsq_count += e->op == OOO_LOAD || e->op == OOO_STORE || e->op == OOO_ATOMIC;
+	}
+	return true;
+}
+
+/*
+	ooo_recover mainly squashes everything younger than the k-th oldest
+	entry, rolling the rename map back youngest first, and redirects fetch
+*/
+void ooo_recover(uint64_t k, uint64_t pc){
+	struct model_rob *branch = rob_at(k);
+	while(rob_count > k + 1){
+		struct model_rob *e = rob_at(--rob_count);
+		if(e->prd != 0){
+			rename_map[e->rd] = e->old_prd;
+			free_regs[free_count++] = e->prd;
+		}
+		iq_count  -= !e->issued;
+		lsq_count -= e->op == OOO_LOAD || e->op == OOO_STORE || e->op == OOO_ATOMIC;
+		e->valid_bit = false;
+		ooo_squashed++;
+	}
+	ooo_recoveries++;
+	set_pc(pc);
+	repair_ras(branch->ras_top, branch->ras_top_value);
+	execute_redirect = true;
+	refill(fetch_stages - 1 + execute_stages - 1);
+	ooo_drop_next = true;
+	ooo_dispatch_stall = false;
+}
+
+/*
+	ooo_issue mainly executes one entry whose operands are ready
+	return true if it redirected fetch
+*/
+bool ooo_issue(uint64_t k){
+	struct model_rob *e = rob_at(k);
+	uint64_t now = get_cycle_counter();
+	uint64_t a = prf_value[e->prs1], b = prf_value[e->prs2];
+	uint64_t result = 0;
+	bool     redirected = false;
+	
+	e->issued = true;
+	iq_count--;
+	e->ready_cycle = now + 1;
+	switch(e->op){
+		case OOO_ALU:
+			result = alu_result(e->alu, a, b, e->imm, e->pc);
+			break;
+		case OOO_MULDIV:
+			result = muldiv_result(e->instruction, a, b);
+			if(is_divide(e->instruction)){
+				e->ready_cycle = now + div_latency;
+				divider_free_cycle = e->ready_cycle;
+				div_count++;
+			}else{
+				e->ready_cycle = now + mul_latency;
+				mul_count++;
+			}
+			break;
+		case OOO_LOAD: // memory stage finishes it
+			e->address = a + e->imm;
+			e->address_ready = true;
+			e->ready_cycle = OOO_NOT_READY;
+			return false;
+		case OOO_STORE: // memory stage writes it at commit
+			e->address = a + e->imm;
+			e->store_data = b;
+			e->address_ready = true;
+			return false;
+		case OOO_ATOMIC: // memory stage does it at commit
+			e->address = a;
+			e->store_data = b;
+			e->address_ready = true;
+			e->ready_cycle = OOO_NOT_READY;
+			return false;
+		case OOO_BRANCH: {
+			uint32_t funct3 = (e->instruction >> 12) & 0x7;
+			bool taken = funct3 == 0x0 ? a == b : funct3 == 0x1 ? a != b :
+			             funct3 == 0x4 ? (int64_t)a < (int64_t)b : funct3 == 0x5 ? (int64_t)a >= (int64_t)b :
+			             funct3 == 0x6 ? a < b : a >= b;
+			if(train_branch(e->pc, e->seq_pc, taken, e->pc + e->imm, e->branch_prediction, e->predicted_pc)){
+				ooo_recover(k, taken ? e->pc + e->imm : e->seq_pc);
+				redirected = true;
+			}
+			break;
+		}
+		case OOO_JUMP: {
+			bool     jalr   = (e->instruction & 0x7F) == 0x67;
+			uint64_t target = jalr ? (a + e->imm) & ~1ULL : e->pc + e->imm;
+			result = e->seq_pc;
+			if(train_jump(e->pc, jalr, e->ras_predicted, target, e->predicted_pc)){
+				ooo_recover(k, target);
+				redirected = true;
+			}
+			break;
+		}
+	}
+	if(e->prd != 0){
+		prf_value[e->prd] = result;
+		prf_ready[e->prd] = e->ready_cycle;
+	}
+	return redirected;
+}
+
+void ooo_execute(void){
+	uint64_t now = get_cycle_counter();
+	
+	ooo_cycles++;
+	rob_occupancy += rob_count;
+	iq_occupancy  += iq_count;
+	lsq_occupancy += lsq_count;
+	if(rob_count > rob_max_occupancy){
+		rob_max_occupancy = rob_count;
+	}
+	
+	// issue, oldest first
+	bool     redirected = false;
+	uint64_t issued = 0;
+	for(uint64_t k = 0; k < rob_count && issued < ooo_width; k++){
+		struct model_rob *e = rob_at(k);
+		if(e->issued || prf_ready[e->prs1] > now || prf_ready[e->prs2] > now){
+			continue;
+		}
+		if(e->op == OOO_MULDIV && is_divide(e->instruction) && divider_free_cycle > now){
+			continue; // the divider is still busy
+		}
+		issued++;
+		if(ooo_issue(k)){
+			redirected = true;
+			break;
+		}
+	}
+	
+	if(redirected){
+		return;
+	}
+	
+	// dispatch what decode stage sent; after a redirect it is wrong-path
+	bool drop = ooo_drop_next;
+	ooo_drop_next = false;
+	ooo_dispatch_stall = false;
+	if(drop || cur_x_reg.i_cache_stall || cur_x_reg.stall || cur_x_reg.funct == 0){
+		frontend_empty_cycles++;
+		return;
+	}
+	if(rob_count == 0){ // the register file may have been written from outside
+		for(int r = 1; r < 32; r += 2){
+			register_read(r, r + 1, &prf_value[rename_map[r]], &prf_value[rename_map[(r + 1) % 32]]);
+		}
+		prf_value[0] = 0;
+	}
+	
+	struct model_rob group[2];
+	int n = 1, reason;
+	memset(group, 0, sizeof(group));
+	group[0].pc                = cur_x_reg.pc;
+	group[0].seq_pc            = cur_x_reg.seq_pc;
+	group[0].instruction       = cur_x_reg.instruction;
+	group[0].branch_prediction = cur_x_reg.branch_prediction;
+	group[0].ras_predicted     = cur_x_reg.ras_predicted;
+	group[0].ras_top           = cur_x_reg.ras_top;
+	group[0].ras_top_value     = cur_x_reg.ras_top_value;
+	group[0].predicted_pc      = cur_x_reg.branch_prediction ? cur_x_reg.new_pc : cur_x_reg.seq_pc;
+	if(cur_x_reg.pair){
+		group[1].pc           = cur_x_reg.pc + 4;
+		group[1].seq_pc       = cur_x_reg.pc + 8;
+		group[1].instruction  = cur_x_reg.pair_instruction;
+		group[1].predicted_pc = cur_x_reg.pc + 8;
+		n = 2;
+	}
+	if(!ooo_dispatch(group, n, &reason)){
+		dispatch_stalls[reason]++;
+		ooo_dispatch_stall = true;
+	}
+}
+
+/*
+	ooo_load mainly tries the oldest load that has its address
+	return true if it used the memory port
+*/
+bool ooo_load(void){
+	uint64_t now = get_cycle_counter();
+	uint64_t result_array[2];
+	uint64_t k, temp;
+	
+	for(k = 0; k < rob_count; k++){
+		struct model_rob *e = rob_at(k);
+		if((e->op == OOO_STORE && !e->address_ready) || e->op == OOO_ATOMIC){
+			lsq_order_stalls++; // every later load waits for this address, or for the atomic
+			return false;
+		}
+		if(e->op == OOO_LOAD && e->address_ready && e->load_state == LOAD_WAITING){
+			break;
+		}
+	}
+	if(k == rob_count){
+		return false;
+	}
+	struct model_rob *load = rob_at(k);
+	uint64_t value = 0;
+	
+	// the youngest older store to any of these bytes
+	int64_t j;
+	for(j = k - 1; j >= 0; j--){
+		struct model_rob *st = rob_at(j);
+		if(st->op == OOO_STORE && st->address < load->address + load->size && load->address < st->address + st->size){
+			break;
+		}
+	}
+	if(j >= 0){
+		struct model_rob *st = rob_at(j);
+		if(load->address < st->address || load->address + load->size > st->address + st->size){
+			lsq_order_stalls++; // partly covered, wait for the store to commit
+			return false;
+		}
+		value = st->store_data >> ((load->address - st->address) * 8);
+		lsq_forwards++;
+	}else{
+		uint64_t paddr;
+		if(!translate(&dtlb, load->address, TLB_READ, &paddr)){
+			return true;
+		}
+		if(check_d_cache(d_cache, paddr, load->size, result_array)[0] == 1){
+			value = result_array[1];
+		}else if(ooo_miss_active){
+			lsq_miss_stalls++;
+			return false;
+		}else if(coherence_access(&coherence_demand, paddr, load->size, false)){
+			return false;
+		}else if(memory_read_l2(paddr & ~0x7ULL, &temp, 8)){
+			update_d_cache(d_cache, paddr, temp);
+			value = check_d_cache(d_cache, paddr, load->size, result_array)[1];
+		}else{
+			ooo_miss_active = true;
+			ooo_miss_line   = paddr & ~0x7ULL;
+			ooo_miss_tag    = load->tag;
+			load->load_state = LOAD_MISS;
+			return true;
+		}
+	}
+	if(load->size < 8){
+		value &= (1ULL << (load->size * 8)) - 1;
+		if(load->sign && (value >> (load->size * 8 - 1))){
+			value |= ~((1ULL << (load->size * 8)) - 1);
+		}
+	}
+	load->load_state  = LOAD_DONE;
+	load->ready_cycle = now + 1;
+	if(load->prd != 0){
+		prf_value[load->prd] = value;
+		prf_ready[load->prd] = load->ready_cycle;
+	}
+	return true;
+}
+
+void ooo_retire(struct model_rob *e){
+	if(e->prd != 0){
+		register_write(e->rd, prf_value[e->prd]);
+		free_regs[free_count++] = e->old_prd;
+	}
+	lsq_count -= e->op == OOO_LOAD || e->op == OOO_STORE || e->op == OOO_ATOMIC;
+	e->valid_bit = false;
+	rob_head = (rob_head + 1) % rob_entries;
+	rob_count--;
+	if(e->instruction == 0x00100073){ // fetch stage sends it again until it commits
+		ebreak_retired = true;
+		return;
+	}
+	ooo_committed++;
+	instructions_executed++;
+}
+
+void ooo_memory(void){
+	uint64_t temp;
+	uint64_t result_array[2];
+	
+	if(ooo_miss_active && memory_status_l2(ooo_miss_line, &temp)){
+		if(check_d_cache(d_cache, ooo_miss_line, 1, result_array)[0] != 1){
+			update_d_cache(d_cache, ooo_miss_line, temp);
+		}
+		ooo_miss_active = false;
+		for(uint64_t k = 0; k < rob_count; k++){ // the load, unless it was squashed, tries again
+			if(rob_at(k)->tag == ooo_miss_tag && rob_at(k)->load_state == LOAD_MISS){
+				rob_at(k)->load_state = LOAD_WAITING;
+			}
+		}
+	}
+	if(ooo_store_pending){
+		if(!memory_write_status(ooo_store_address)){
+			return;
+		}
+		ooo_store_pending = false;
+	}
+	
+	// a store at the head commits here, memory writes are only allowed in this stage
+	struct model_rob *head = rob_at(0);
+	if(rob_count > 0 && head->op == OOO_STORE && head->ready_cycle <= get_cycle_counter()){
+		uint64_t paddr;
+		if(!translate(&dtlb, head->address, TLB_WRITE, &paddr) || coherence_access(&coherence_demand, paddr, head->size, true)){
+			return;
+		}
+		if(!memory_write_l2(paddr, head->store_data, head->size)){
+			ooo_store_pending = true;
+			ooo_store_address = paddr;
+		}
+		write_d_cache(d_cache, paddr, head->store_data, head->size);
+		ooo_retire(head);
+		return;
+	}
+	if(rob_count > 0 && head->op == OOO_ATOMIC && head->address_ready){
+		uint64_t paddr;
+		if(!translate(&dtlb, head->address, TLB_WRITE, &paddr) ||
+		   !atomic_access(head->instruction, paddr, head->store_data, head->size, &temp)){
+			return;
+		}
+		if(head->prd != 0){
+			prf_value[head->prd] = temp;
+			prf_ready[head->prd] = get_cycle_counter() + 1;
+		}
+		ooo_retire(head);
+		return;
+	}
+	ooo_load();
+}
+
+void ooo_commit(void){
+	uint64_t now = get_cycle_counter();
+	for(uint64_t i = 0; i < ooo_width && rob_count > 0; i++){
+		struct model_rob *head = rob_at(0);
+		if(head->op == OOO_VECTOR){ // everything older has committed, the pc stays on it
+			if(!ooo_stopped){
+				fprintf(stderr, "ooo: vector instruction 0x%08x at pc 0x%016" PRIx64 ", the out-of-order back end has no vector unit, hart stops\n",
+				        head->instruction, head->pc);
+				set_pc(head->pc);
+			}
+			ooo_stopped = true;
+			return;
+		}
+		if(head->op == OOO_STORE || head->op == OOO_ATOMIC){ // memory stage commits it
+			commit_store_stalls += i == 0;
+			return;
+		}
+		if(head->ready_cycle > now){
+			if(i == 0 && head->op == OOO_LOAD){
+				commit_load_stalls++;
+			}else if(i == 0){
+				commit_execute_stalls++;
+			}
+			return;
+		}
+		ooo_retire(head);
+	}
+}
+
+void print_ooo_stats(void){
+	if(!ooo_enabled){
+		return;
+	}
+	printf("Out-of-order back end (ROB %" PRIu64 ", IQ %" PRIu64 ", LSQ %" PRIu64 ", %" PRIu64 " registers, %" PRIu64 "-wide):\n",
+	       rob_entries, iq_entries, lsq_entries, phys_regs, ooo_width);
+	printf("  Committed: %" PRIu64 "\n", ooo_committed);
+	if(ooo_cycles > 0){
+		printf("  IPC: %.3f\n", (double)ooo_committed / ooo_cycles);
+		printf("  ROB occupancy: %.2f average, %" PRIu64 " max\n", (double)rob_occupancy / ooo_cycles, rob_max_occupancy);
+		printf("  IQ/LSQ occupancy: %.2f/%.2f average\n", (double)iq_occupancy / ooo_cycles, (double)lsq_occupancy / ooo_cycles);
+	}
+	for(int reason = 0; reason < DISPATCH_STALLS; reason++){
+		printf("  Dispatch stall cycles, %s: %" PRIu64 "\n", dispatch_stall_name[reason], dispatch_stalls[reason]);
+	}
+	printf("  Front end empty cycles: %" PRIu64 "\n", frontend_empty_cycles);
+	printf("  Commit stall cycles, load/execute/store: %" PRIu64 "/%" PRIu64 "/%" PRIu64 "\n",
+	       commit_load_stalls, commit_execute_stalls, commit_store_stalls);
+	printf("  Recoveries: %" PRIu64 ", squashed: %" PRIu64 "\n", ooo_recoveries, ooo_squashed);
+	printf("  Store-to-load forwards: %" PRIu64 "\n", lsq_forwards);
+	printf("  Load stall cycles, older store/outstanding miss: %" PRIu64 "/%" PRIu64 "\n", lsq_order_stalls, lsq_miss_stalls);
+}
+
+/*
+	memory_stage_stalled mainly tells the earlier stages that memory stage
+	holds its instruction in this cycle, so they must hold theirs too;
+	memory stage runs first, so this is its output of the current cycle
+*/
+HART_LOCAL struct stage_reg_w *m_stage_out = NULL;
+
+bool memory_stage_stalled(void){
+	return m_stage_out != NULL && m_stage_out->d_cache_stall;
+}
+
+void stage_fetch (struct stage_reg_d *new_d_reg){
+	//printf(">>>>> FETCH STAGE <<<<<\n");
+	
+	uint32_t inst = 0;
+	uint32_t full_inst[4];
+	full_inst[0]=0; full_inst[1]=0; full_inst[2]=0; full_inst[3]=0; 
+	uint32_t result_array[2]; // result[1] contains success status of cache, result[2] contains exact result
+	
+	if(ooo_stopped || memory_stage_stalled()){
+		return;
+	}
+	
+	if(cur_d_reg.i_cache_stall){
+		//printf("> ????pc is: 0x%016lx\n",cur_d_reg.pc);
+		if(memory_status_l2(cur_d_reg.paddr & ~0xFULL, &full_inst) || cur_d_reg.first_cache_stall){
+			//printf("> READ in x1\n");
+			if(cur_d_reg.first_cache_stall){
+				new_d_reg->first_cache_stall = false;
+				new_d_reg->i_cache_stall = false;
+				//printf("> READ in x2\n");
+			}else{
+				update_i_cache(i_cache, cur_d_reg.paddr, full_inst);
+				//printf("0x%016lx\n",cur_d_reg.pc);
+				new_d_reg->i_cache_stall     = true;
+				new_d_reg->first_cache_stall = true;
+				//printf("> READ in x3\n");
+				return;
+			}
+		}else{
+			new_d_reg->i_cache_stall = true;
+			return;
+		}
+	}
 	
 	if(cur_m_reg.wrong_prediction){
 		new_d_reg->fixed = true;
@@ -270,59 +5364,202 @@ void stage_fetch (struct stage_reg_d *new_d_reg){
 		new_d_reg->fixed = false;
 	}
 	
-	if(cur_x_reg.stall){
+	if(cur_x_reg.stall || decode_hold){
+		return;
+	}
+	
+	if(refill_bubbles > 0){ // the deeper front end is still refilling
+		refill_bubbles--;
+		refill_cycles++;
+		new_d_reg->bubble = true;
+		new_d_reg->i_cache_stall = false;
+		new_d_reg->pair = false;
 		return;
 	}
 	
 	new_d_reg->ptr = &cur_d_reg;
 	uint64_t pc = get_pc();
 	new_d_reg->pc = pc;
-	new_d_reg->new_pc = (pc + 4);
+	new_d_reg->branch_prediction = false;
+	new_d_reg->ras_predicted = false;
+	new_d_reg->i_cache_fill = cur_d_reg.i_cache_stall; // fetched right after an i-cache fill
+	new_d_reg->pair = false;
+	new_d_reg->pair_rule = PAIR_OK;
 	//printf("> stored in d_reg pc is: 0x%016lx\n", pc);
 	
+	// translate the pc, decode stage gets bubbles while the ITLB walks
+	uint64_t paddr;
+	if(!translate(&itlb, pc, TLB_EXECUTE, &paddr)){
+		new_d_reg->bubble = true;
+		return;
+	}
+	new_d_reg->bubble = false;
+	new_d_reg->paddr = paddr;
+	
 	// check i-cache
-	uint32_t* temp_result = check_i_cache(i_cache, cur_d_reg.pc, result_array);
+	i_cache_accesses++;
+	uint32_t* temp_result = check_i_cache(i_cache, paddr, result_array);
 	//printf("0x%016x\n0x%016x\n",temp_result[0],temp_result[1]);
 	if(temp_result[0] == 1){ // i-cache hit
 		new_d_reg->instruction = temp_result[1];
 		new_d_reg->i_cache_stall = false;
 		inst = temp_result[1];
 	}else{ // i-cache miss
-		bool status = memory_read(cur_d_reg.pc, &full_inst, 16);
+		i_cache_misses++;
+		bool status = memory_read_l2(paddr & ~0xFULL, &full_inst, 16); // whole i-cache line
 		//printf("read from memory, pc: 0x%016lx\n",cur_d_reg.pc);
 		//printf("read instruction-1 is: 0x%016x\n",full_inst[0]);
-		new_d_reg->i_cache_stall = true; // i-cache miss needs stalls
-		if(status){ // successfully read value from the memory
-			update_i_cache(i_cache, cur_d_reg.pc, full_inst);
+		if(status){ // no memory latency, the line is here already
+			update_i_cache(i_cache, paddr, full_inst);
+			inst = check_i_cache(i_cache, paddr, result_array)[1];
+			new_d_reg->instruction = inst;
+			new_d_reg->i_cache_stall = false;
 		}else{ // failed to read value from the memory, need stalls
+			new_d_reg->i_cache_stall = true; // i-cache miss needs stalls
+			return;
+		}
+	}
+	
+	// C extension: expand a 16-bit instruction, or get the upper half of a
+	// 32-bit one at the end of the line from the next line
+	bool compressed = rvc_enabled && (inst & 0x3) != 0x3;
+	if(compressed){
+		inst = expand_compressed(inst & 0xFFFF);
+		rvc_compressed++;
+	}else if(rvc_enabled && (paddr & 0xF) == 0xE){
+		uint64_t paddr_next = paddr + 2;
+		if(((pc + 2) & 0xFFF) == 0 && !translate(&itlb, pc + 2, TLB_EXECUTE, &paddr_next)){
+			new_d_reg->bubble = true;
+			return;
+		}
+		i_cache_accesses++;
+		temp_result = check_i_cache(i_cache, paddr_next, result_array);
+		if(temp_result[0] != 1){
+			i_cache_misses++;
+			new_d_reg->paddr = paddr_next; // the fill is polled for this line
+			if(!memory_read_l2(paddr_next, &full_inst, 16)){
+				new_d_reg->i_cache_stall = true;
+				return;
+			}
+			update_i_cache(i_cache, paddr_next, full_inst);
+			temp_result = check_i_cache(i_cache, paddr_next, result_array);
+		}
+		if(straddle_pc != pc){ // the second access takes another cycle
+			straddle_pc = pc;
+			rvc_straddles++;
+			new_d_reg->bubble = true;
+			return;
+		}
+		straddle_pc = UINT64_MAX;
+		inst = (inst & 0xFFFF) | (temp_result[1] << 16);
+		rvc_full++;
+	}else{
+		rvc_full++;
+	}
+	new_d_reg->instruction = inst;
+	new_d_reg->seq_pc = pc + (compressed ? 2 : 4);
+	new_d_reg->new_pc = new_d_reg->seq_pc;
+	if(inst == 0x00100073){ // ebreak, the pc stays on it
+		return;
+	}
+	ebreak_retired = false;
+	
+	// Return address prediction, OPCODE 0x67 is jalr and 0x6F is jal
+	if((inst & 0x7F) == 0x67 || (inst & 0x7F) == 0x6F)
+	{
+		uint64_t target;
+		bool     predicted = predictReturn(new_d_reg->seq_pc, inst, &target);
+		ras_checkpoint(new_d_reg);
+		if(predicted){
+			set_pc(target);
+			refill(fetch_stages - 1);
+			new_d_reg->new_pc = target;
+			new_d_reg->branch_prediction = true;
+			new_d_reg->ras_predicted = true;
+			return;
+		}
+		if((inst & 0x7F) == 0x67 && predictIndirect(pc, &target)){
+			set_pc(target);
+			refill(fetch_stages - 1);
+			new_d_reg->new_pc = target;
+			new_d_reg->branch_prediction = true;
 			return;
 		}
+	}else{
+		ras_checkpoint(new_d_reg);
 	}
 	
 	// Branch Prediction
 	if((inst & 0x7F) == 0x63) // OPCODE 0x63 is for branch operations
 	{
-		int x = branchPrediction(BTB, pc, inst);
-		if(x == 33){ // 33 means there is NO branch prediction
+		uint64_t target;
+		if(!branchPrediction(pc, inst, &target)){ // there is NO branch prediction
 			// keep going as normal
 			new_d_reg->branch_prediction = false;
 		}else{ // there is a branch prediction
-			new_d_reg->new_pc = BTB[x][1]; // store the new_pc from the prediction
+			new_d_reg->new_pc = target; // store the new_pc from the prediction
 			new_d_reg->branch_prediction = true; // mark there exists a prediction
+			refill(fetch_stages - 1);
 			return;
 		}
 	}
 
-	set_pc(pc+4);
+	// second lane from the same i-cache line
+	if(issue_width == 2 && compressed){
+		new_d_reg->pair_rule = PAIR_COMPRESSED;
+	}else if(issue_width == 2){
+		new_d_reg->pair_rule = pair_rule(paddr, inst, 0);
+		if(new_d_reg->pair_rule != PAIR_CONTROL && new_d_reg->pair_rule != PAIR_LINE_END){
+			new_d_reg->pair_instruction = check_i_cache(i_cache, paddr + 4, result_array)[1];
+			new_d_reg->pair_rule = pair_rule(paddr, inst, new_d_reg->pair_instruction);
+		}
+		if(new_d_reg->pair_rule == PAIR_OK){
+			new_d_reg->pair = true;
+			set_pc(pc+8);
+			return;
+		}
+	}
+	set_pc(new_d_reg->seq_pc);
 	
 	//printf("> PC: 0x%016lx\n",pc);
 	//printf("> New_PC: 0x%016lx\n", new_d_reg->new_pc);
 	//printf("> Instruction is: 0x%08x\n", inst);
 }
 
+/*
+	decode_bubble mainly sends an empty slot to execute stage
+*/
+void decode_bubble(struct stage_reg_x *new_x_reg){
+	new_x_reg->funct = 0;
+	new_x_reg->instruction = 0x13; // nop
+	new_x_reg->e[9] = 0;
+	new_x_reg->branch_prediction = false;
+	new_x_reg->ras_predicted = false;
+	new_x_reg->early_resolved = false;
+	new_x_reg->i_cache_fill = false;
+	new_x_reg->pair = false;
+	new_x_reg->pair_rule = PAIR_OK;
+}
+
 void stage_decode (struct stage_reg_x *new_x_reg){
 	//printf(">>>>> DECODE STAGE STARTS <<<<<\n");
+	decode_hold = false;
+	
+	if(ooo_dispatch_stall){ // the out-of-order back end is full
+		decode_hold = true;
+		return;
+	}
+	
+	if(execute_hold){ // execute stage keeps its instruction
+		decode_hold = true;
+		return;
+	}
 
+	if(memory_stage_stalled()){
+		return;
+	}
+	operand_distance_step();
+	
 	if(cur_d_reg.i_cache_stall){
 		new_x_reg->i_cache_stall = true;
 		return;
@@ -330,10 +5567,6 @@ void stage_decode (struct stage_reg_x *new_x_reg){
 		new_x_reg->i_cache_stall = false;
 	}
 	
-	if(cur_w_reg.d_cache_stall){
-		return;
-	}
-	
 	if(cur_d_reg.fixed){
 		new_x_reg->fixed = true;
 	}else{
@@ -345,7 +5578,35 @@ void stage_decode (struct stage_reg_x *new_x_reg){
 		return;
 	}
 	
+	if(cur_d_reg.bubble){
+		decode_bubble(new_x_reg);
+		return;
+	}
+	
+	// on a redirect the group is the wrong path, it goes down to be flushed
+	if(!ooo_enabled && !execute_redirect && depth_interlock()){
+		decode_hold = true;
+		decode_bubble(new_x_reg);
+		return;
+	}
+	decode_pair(new_x_reg);
+	if(!execute_redirect){ // else it is the wrong path and gets flushed
+		operand_distance_set(cur_d_reg.instruction, result_distance(cur_d_reg.instruction),
+		                     (cur_d_reg.instruction & 0x7F) == 0x03 || (cur_d_reg.instruction & 0x7F) == 0x2F);
+		if(cur_d_reg.pair){
+			operand_distance_set(cur_d_reg.pair_instruction, execute_stages, false);
+		}
+	}
+	
 	new_x_reg->pc = cur_d_reg.pc;
+	new_x_reg->seq_pc = cur_d_reg.seq_pc;
+	new_x_reg->new_pc = cur_d_reg.new_pc;
+	new_x_reg->branch_prediction = cur_d_reg.branch_prediction;
+	new_x_reg->ras_predicted = cur_d_reg.ras_predicted;
+	new_x_reg->ras_top = cur_d_reg.ras_top;
+	new_x_reg->ras_top_value = cur_d_reg.ras_top_value;
+	new_x_reg->early_resolved = false;
+	new_x_reg->i_cache_fill = cur_d_reg.i_cache_fill;
 	//printf("> stored in x_reg pc is: 0x%016lx\n", cur_d_reg.pc);
 	new_x_reg->ptr = &cur_x_reg;
 	uint32_t instr = cur_d_reg.instruction;
@@ -361,6 +5622,7 @@ void stage_decode (struct stage_reg_x *new_x_reg){
 		// for 'R' format of instrcution
 		case 0x33:
 		case 0x3B:
+		case 0x2F: // lr, sc, amo*
 			funct7  = (instr & 0xFE000000) >> 25;
 			new_x_reg->e[7]    = (instr & 0x1F00000) >> 20;
 			new_x_reg->e[8]    = (instr & 0xF8000) >> 15;
@@ -434,6 +5696,14 @@ void stage_decode (struct stage_reg_x *new_x_reg){
 			new_x_reg->e[9]    = (instr & 0xF80) >> 7;
 			break;
 
+		// for vector instructions, execute stage takes the fields itself
+		case 0x07:
+		case 0x27:
+		case 0x57:
+			funct3  = (instr & 0x7000) >> 12;
+			new_x_reg->e[9]    = (instr & 0xF80) >> 7;
+			break;
+
 		// for 'UJ' format of instruction
 		case 0x6F:
 			new_x_reg->e[4]  = (instr & 0x80000000) >> 12;
@@ -454,6 +5724,10 @@ void stage_decode (struct stage_reg_x *new_x_reg){
 	{
 		// for 'R' format of instruction
 		case 0x33:
+			if(funct7 == 0x1){ // mul, mulh, mulhsu, mulhu, div, divu, rem, remu
+				new_x_reg->funct = muldiv_funct(instr);
+				break;
+			}
 			switch(funct3)
 			{
 				case 0x0:
@@ -463,8 +5737,6 @@ void stage_decode (struct stage_reg_x *new_x_reg){
 						//printf("____ the new_x_reg is: %d\n",new_x_reg->funct);break;
 					}else if(funct7 == 0x20){
 						new_x_reg->funct = 29; break; // sub
-					}else if(funct7 == 0x1){
-						new_x_reg->funct = 60; break; // mul
 					}
 				case 0x1:
 					new_x_reg->funct = 30; break; // sll
@@ -473,11 +5745,7 @@ void stage_decode (struct stage_reg_x *new_x_reg){
 				case 0x3:
 					new_x_reg->funct = 32; break; // sltu
 				case 0x4:
-					if(funct7 == 0x0){
-						new_x_reg->funct = 33; break; // xor
-					}else if(funct7 == 0x1){
-						new_x_reg->funct = 61; break; // div
-					}
+					new_x_reg->funct = 33; break; // xor
 				case 0x5:
 					if(funct7 == 0x0)
 					{
@@ -486,17 +5754,17 @@ void stage_decode (struct stage_reg_x *new_x_reg){
 						new_x_reg->funct = 35; break; //sra
 					}
 				case 0x6:
-					if(funct7 == 0x0){
-						new_x_reg->funct = 36; break; // or
-					}else if(funct7 == 0x1){
-						new_x_reg->funct = 62; break; // rem
-					}
+					new_x_reg->funct = 36; break; // or
 				case 0x7:
 					new_x_reg->funct = 37; break; // and
 
 			}
 			break;
 		case 0x3B:
+			if(funct7 == 0x1){ // mulw, divw, divuw, remw, remuw
+				new_x_reg->funct = muldiv_funct(instr);
+				break;
+			}
 			switch(funct3)
 			{
 				case 0x0:
@@ -523,61 +5791,19 @@ void stage_decode (struct stage_reg_x *new_x_reg){
 			switch(funct3)
 			{
 				case 0x0:
-					new_x_reg->funct = 1; 
-					if((cur_x_reg.funct <= 27) & (cur_x_reg.funct >= 24)){
-						if(cur_x_reg.e[7] == ((instr & 0xF8000) >> 15)){
-							new_x_reg->stall = true;
-						}
-					}
-					break; // lb
+					new_x_reg->funct = 1; break; // lb
 				case 0x1:
-					new_x_reg->funct = 2; // lh
-					if((cur_x_reg.funct <= 27) & (cur_x_reg.funct >= 24)){
-						if(cur_x_reg.e[7] == ((instr & 0xF8000) >> 15)){
-							new_x_reg->stall = true;
-						}
-					}
-					break;
+					new_x_reg->funct = 2; break; // lh
+				case 0x2:
+					new_x_reg->funct = 3; break; // lw
 				case 0x3:
-					new_x_reg->funct = 3; // lw
-					if((cur_x_reg.funct <= 27) & (cur_x_reg.funct >= 24)){
-						if(cur_x_reg.e[7] == ((instr & 0xF8000) >> 15)){
-							new_x_reg->stall = true;
-						}
-					}
-					break; 
+					new_x_reg->funct = 4; break; // ld
 				case 0x4:
-					new_x_reg->funct = 4; // ld
-					if((cur_x_reg.funct <= 27) & (cur_x_reg.funct >= 24)){
-						if(cur_x_reg.e[7] == ((instr & 0xF8000) >> 15)){
-							new_x_reg->stall = true;
-						}
-					}
-					break; 
+					new_x_reg->funct = 5; break; // lbu
 				case 0x5:
-					new_x_reg->funct = 5; // lbu
-					if((cur_x_reg.funct <= 27) & (cur_x_reg.funct >= 24)){
-						if(cur_x_reg.e[7] == ((instr & 0xF8000) >> 15)){
-							new_x_reg->stall = true;
-						}
-					}
-					break; 
+					new_x_reg->funct = 6; break; // lhu
 				case 0x6:
-					new_x_reg->funct = 6; // lhu
-					if((cur_x_reg.funct <= 27) & (cur_x_reg.funct >= 24)){
-						if(cur_x_reg.e[7] == ((instr & 0xF8000) >> 15)){
-							new_x_reg->stall = true;
-						}
-					}
-					break; 
-				case 0x7:
-					new_x_reg->funct = 7; // lwu
-					if((cur_x_reg.funct <= 27) & (cur_x_reg.funct >= 24)){
-						if(cur_x_reg.e[7] == ((instr & 0xF8000) >> 15)){
-							new_x_reg->stall = true;
-						}
-					}
-					break; 
+					new_x_reg->funct = 7; break; // lwu
 			}
 			break;
 		// fence(.i) (0x0F) -> no need but kept for record
@@ -609,7 +5835,7 @@ void stage_decode (struct stage_reg_x *new_x_reg){
 					new_x_reg->funct = 14; break; // xori
 				//	printf("____ the new_x_reg is: %d\n",new_x_reg->funct);break;
 				case 0x5:
-					if(new_x_reg->e[1] == 0x0)
+					if((new_x_reg->e[1] >> 1) == 0x0) // shamt bit 5 sits in funct7
 					{
 						new_x_reg->funct = 15; break; // slri
 				//		printf("____ the new_x_reg is: %d\n",new_x_reg->funct);break;
@@ -632,8 +5858,8 @@ void stage_decode (struct stage_reg_x *new_x_reg){
 					new_x_reg->funct = 20; break; // addiw
 				case 0x1:
 					new_x_reg->funct = 21; break; // slliw
-				case 0x2:
-					if(new_x_reg->e[0] == 0x0)
+				case 0x5:
+					if(new_x_reg->e[1] == 0x0)
 					{
 						new_x_reg->funct = 22; break; // srliw
 					}else{
@@ -676,37 +5902,13 @@ void stage_decode (struct stage_reg_x *new_x_reg){
 			switch(funct3)
 			{
 				case 0x0:
-					new_x_reg->funct = 24; // sb
-					if((cur_x_reg.funct <= 7) & (cur_x_reg.funct >= 1)){
-						if(cur_x_reg.e[9] == ((instr & 0xF8000) >> 15)){
-							new_x_reg->stall = true;
-						}
-					}
-					break;
+					new_x_reg->funct = 24; break; // sb
 				case 0x1:
-					new_x_reg->funct = 25; // sh
-					if((cur_x_reg.funct <= 7) & (cur_x_reg.funct >= 1)){
-						if(cur_x_reg.e[9] == ((instr & 0xF8000) >> 15)){
-							new_x_reg->stall = true;
-						}
-					}
-					break;
+					new_x_reg->funct = 25; break; // sh
 				case 0x2:
-					new_x_reg->funct = 26; // sw
-					if((cur_x_reg.funct <= 7) & (cur_x_reg.funct >= 1)){
-						if(cur_x_reg.e[9] == ((instr & 0xF8000) >> 15)){
-							new_x_reg->stall = true;
-						}
-					}
-					break;
+					new_x_reg->funct = 26; break; // sw
 				case 0x3:
-					new_x_reg->funct = 27; // sd
-					if((cur_x_reg.funct <= 7) & (cur_x_reg.funct >= 1)){
-						if(cur_x_reg.e[9] == ((instr & 0xF8000) >> 15)){
-							new_x_reg->stall = true;
-						}
-					}
-					break;
+					new_x_reg->funct = 27; break; // sd
 			}
 			break;
 
@@ -737,7 +5939,35 @@ void stage_decode (struct stage_reg_x *new_x_reg){
 
 		// for 'UJ' format of instruction
 		case 0x6F:
-			new_x_reg->funct = 51; break; // jal
+			new_x_reg->funct = 51; // jal
+			decode_jal(new_x_reg);
+			break;
+
+		// vector instructions (RVV)
+		case 0x07:
+		case 0x27:
+		case 0x57:
+			new_x_reg->funct = vector_funct(instr); // 63: vset*, 64: load, 65: store, 66: arithmetic, 67: to x register
+			break;
+
+		// atomic instructions (RV64A)
+		case 0x2F:
+			if(funct3 == 0x2 || funct3 == 0x3){
+				new_x_reg->funct = 68; // lr, sc, amo* (.w and .d)
+			}
+			break;
+	}
+	
+	// renaming takes care of the load/store hazards decode stage stalls for
+	if(ooo_enabled){
+		new_x_reg->stall = false;
+		return;
+	}
+	
+	// beq/bne resolved early, a held branch leaves a bubble for execute stage
+	if(opcode == 0x63 && (funct3 == 0x0 || funct3 == 0x1) && !decode_branch(new_x_reg, funct3 == 0x1)){
+		decode_hold = true;
+		decode_bubble(new_x_reg);
 	}
 }
 
@@ -745,18 +5975,31 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 	//printf(">>>>> EXECUTE STAGE <<<<<\n");
 	//printf("> The instruction is: 0x%08x\n", cur_x_reg.instruction);
 	//printf("> The cur_x_reg.funct is: %d\n", cur_x_reg.funct);
+	execute_redirect = false;
+	execute_hold = false;
+	
+	if(ooo_enabled){
+		memset(new_m_reg, 0, sizeof(*new_m_reg));
+		ooo_execute();
+		return;
+	}
+	scoreboard_update();
 
+	if(memory_stage_stalled()){
+		return;
+	}
+	
 	if(cur_x_reg.i_cache_stall){
+		if(cur_m_reg.branch){ // the slot behind a redirect was empty, the flush is done
+			new_m_reg->branch = false;
+			return;
+		}
 		new_m_reg->i_cache_stall = true;
 		return;
 	}else{
 		new_m_reg->i_cache_stall = false;
 	}
 	
-	if(cur_w_reg.d_cache_stall){
-		return;
-	}
-	
 	if(cur_m_reg.wrong_prediction){
 		if(cur_d_reg.fixed){
 			new_m_reg->wrong_prediction = false;
@@ -769,6 +6012,7 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 	
 	if(cur_m_reg.branch){
 		new_m_reg->branch = false;
+		wrong_path_execute();
 		return;
 	}
 	
@@ -776,12 +6020,35 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 		return;
 	}
 	
+	if(!execute_operands_ready()){
+		scoreboard_stall_cycles++;
+		execute_hold = true;
+		execute_bubble(new_m_reg);
+		return;
+	}
+	
+	if(divider_wait(new_m_reg)){
+		return;
+	}
+	
+	if(vector_issue(new_m_reg)){
+		return;
+	}
+	
 	new_m_reg->ptr = &cur_m_reg;
+	if(cur_x_reg.funct != 0 && cur_x_reg.funct != 53){ // not a bubble, nor an ebreak fetch stage sends again
+		instructions_executed++;
+	}
 	uint64_t p_rs1 = 0, p_rs2 = 0, p_r = 0, shiftAmount = 0, dest = 0, temp = 0;
+	if(cur_x_reg.funct != 0){
+		p_rs1 = bypass_operand(instr_rs1(cur_x_reg.instruction));
+		p_rs2 = bypass_operand(instr_rs2(cur_x_reg.instruction));
+	}
 	
 	new_m_reg->pc = cur_x_reg.pc;
 	//printf("> stored in m_reg pc is: 0x%016lx\n",cur_x_reg.pc);
 	new_m_reg->instruction = cur_x_reg.instruction;
+	new_m_reg->funct = cur_x_reg.funct;
 	for(int i = 0; i<11; i++){
 		new_m_reg->e[i] = cur_x_reg.e[i];
 	}
@@ -789,33 +6056,24 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 	new_m_reg->memoryRead = false;
 	new_m_reg->memoryWrite = false;
 	new_m_reg->writeRun = false;
+	execute_pair(new_m_reg);
 
 	switch(cur_x_reg.funct)
 	{
 		case 1: ;// lb															// Initialize pointers
 			//printf("> Execute lb\n");
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[9] == cur_m_reg.e[8]){
-					new_m_reg->unsigned_passValue = cur_m_reg.forwardingValue;
-				//	printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-				//	printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				cur_x_reg.e[0] = converter(cur_x_reg.e[0],0x800,0xFFFFFFFFFFFFF000);
-				dest = cur_x_reg.e[8] + cur_x_reg.e[0];													// Add offset to rs1 in "dest" to get memory address
-				dest = dest & 0xFFFFFFFF;
+			cur_x_reg.e[0] = converter(cur_x_reg.e[0],0x800,0xFFFFFFFFFFFFF000);
+			dest = p_rs1 + cur_x_reg.e[0];													// Add offset to rs1 in "dest" to get memory address
+			dest = dest & 0xFFFFFFFF;
 			//	printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
 
-				// Pass the required value to M register
-				new_m_reg->destinationAddress = dest;
-				new_m_reg->sizeOfByte = 1;
-				//new_m_reg->forwardingValue = p_rs1+temp;
+			// Pass the required value to M register
+			new_m_reg->destinationAddress = dest;
+			new_m_reg->sizeOfByte = 1;
+			//new_m_reg->forwardingValue = p_rs1+temp;
 
-				// Set the M and W register status
-				new_m_reg->memoryRead = true;
-			}
+			// Set the M and W register status
+			new_m_reg->memoryRead = true;
 
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
 
@@ -826,28 +6084,18 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 2: ;// lh															// Initialize pointers
 			//printf("> Execute lh\n");
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[9] == cur_m_reg.e[8]){
-					new_m_reg->unsigned_passValue = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				cur_x_reg.e[0] = converter(cur_x_reg.e[0],0x800,0xFFFFFFFFFFFFF000);
-				dest = cur_x_reg.e[8] + cur_x_reg.e[0];													// Add offset to rs1 in "dest" to get memory address
-				dest = dest & 0xFFFFFFFF;
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
+			cur_x_reg.e[0] = converter(cur_x_reg.e[0],0x800,0xFFFFFFFFFFFFF000);
+			dest = p_rs1 + cur_x_reg.e[0];													// Add offset to rs1 in "dest" to get memory address
+			dest = dest & 0xFFFFFFFF;
+			//printf("> ___READ from REGISTER___\n");
 
-				// Pass the required value to M register
-				new_m_reg->destinationAddress = dest;
-				new_m_reg->sizeOfByte = 2;
-				//new_m_reg->forwardingValue = p_rs1+temp;
+			// Pass the required value to M register
+			new_m_reg->destinationAddress = dest;
+			new_m_reg->sizeOfByte = 2;
+			//new_m_reg->forwardingValue = p_rs1+temp;
 
-				// Set the M and W register status
-				new_m_reg->memoryRead = true;
-			}
+			// Set the M and W register status
+			new_m_reg->memoryRead = true;
 
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
 
@@ -858,28 +6106,18 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 3: ;// lw															// Initialize pointers
 			//printf("> Execute lw\n");
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[9] == cur_m_reg.e[8]){
-					new_m_reg->unsigned_passValue = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				cur_x_reg.e[0] = converter(cur_x_reg.e[0],0x800,0xFFFFFFFFFFFFF000);
-				dest = cur_x_reg.e[8] + cur_x_reg.e[0];													// Add offset to rs1 in "dest" to get memory address
-				dest = dest & 0xFFFFFFFF;
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
+			cur_x_reg.e[0] = converter(cur_x_reg.e[0],0x800,0xFFFFFFFFFFFFF000);
+			dest = p_rs1 + cur_x_reg.e[0];													// Add offset to rs1 in "dest" to get memory address
+			dest = dest & 0xFFFFFFFF;
+			//printf("> ___READ from REGISTER___\n");
 
-				// Pass the required value to M register
-				new_m_reg->destinationAddress = dest;
-				new_m_reg->sizeOfByte = 4;
-				//new_m_reg->forwardingValue = p_rs1+temp;
+			// Pass the required value to M register
+			new_m_reg->destinationAddress = dest;
+			new_m_reg->sizeOfByte = 4;
+			//new_m_reg->forwardingValue = p_rs1+temp;
 
-				// Set the M and W register status
-				new_m_reg->memoryRead = true;
-			}
+			// Set the M and W register status
+			new_m_reg->memoryRead = true;
 
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
 
@@ -890,28 +6128,18 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 4: ;// ld															// Initialize pointers
 			//printf("> Execute ld\n");
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[9] == cur_m_reg.e[8]){
-					new_m_reg->unsigned_passValue = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				cur_x_reg.e[0] = converter(cur_x_reg.e[0],0x800,0xFFFFFFFFFFFFF000);
-				dest = cur_x_reg.e[8] + cur_x_reg.e[0];													// Add offset to rs1 in "dest" to get memory address
-				dest = dest & 0xFFFFFFFF;
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
+			cur_x_reg.e[0] = converter(cur_x_reg.e[0],0x800,0xFFFFFFFFFFFFF000);
+			dest = p_rs1 + cur_x_reg.e[0];													// Add offset to rs1 in "dest" to get memory address
+			dest = dest & 0xFFFFFFFF;
+			//printf("> ___READ from REGISTER___\n");
 
-				// Pass the required value to M register
-				new_m_reg->destinationAddress = dest;
-				new_m_reg->sizeOfByte = 8;
-				//new_m_reg->forwardingValue = p_rs1+temp;
+			// Pass the required value to M register
+			new_m_reg->destinationAddress = dest;
+			new_m_reg->sizeOfByte = 8;
+			//new_m_reg->forwardingValue = p_rs1+temp;
 
-				// Set the M and W register status
-				new_m_reg->memoryRead = true;
-			}
+			// Set the M and W register status
+			new_m_reg->memoryRead = true;
 
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
 
@@ -922,28 +6150,18 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 5: ;// lbu															// Initialize pointers
 			//printf("> Execute lbu\n");
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[9] == cur_m_reg.e[8]){
-					new_m_reg->unsigned_passValue = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				cur_x_reg.e[0] = converter(cur_x_reg.e[0],0x800,0xFFFFFFFFFFFFF000);
-				dest = cur_x_reg.e[8] + cur_x_reg.e[0];													// Add offset to rs1 in "dest" to get memory address
-				dest = dest & 0xFFFFFFFF;
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
+			cur_x_reg.e[0] = converter(cur_x_reg.e[0],0x800,0xFFFFFFFFFFFFF000);
+			dest = p_rs1 + cur_x_reg.e[0];													// Add offset to rs1 in "dest" to get memory address
+			dest = dest & 0xFFFFFFFF;
+			//printf("> ___READ from REGISTER___\n");
 
-				// Pass the required value to M register
-				new_m_reg->destinationAddress = dest;
-				new_m_reg->sizeOfByte = 1;
-				//new_m_reg->forwardingValue = p_rs1+temp;
+			// Pass the required value to M register
+			new_m_reg->destinationAddress = dest;
+			new_m_reg->sizeOfByte = 1;
+			//new_m_reg->forwardingValue = p_rs1+temp;
 
-				// Set the M and W register status
-				new_m_reg->memoryRead = true;
-			}
+			// Set the M and W register status
+			new_m_reg->memoryRead = true;
 
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
 
@@ -954,28 +6172,18 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 6: ;// lhu															// Initialize pointers
 			//printf("> Execute lhu\n");
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[9] == cur_m_reg.e[8]){
-					new_m_reg->unsigned_passValue = cur_m_reg.forwardingValue;
-				//	printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-				//	printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				cur_x_reg.e[0] = converter(cur_x_reg.e[0],0x800,0xFFFFFFFFFFFFF000);
-				dest = cur_x_reg.e[8] + cur_x_reg.e[0];													// Add offset to rs1 in "dest" to get memory address
-				dest = dest & 0xFFFFFFFF;
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
+			cur_x_reg.e[0] = converter(cur_x_reg.e[0],0x800,0xFFFFFFFFFFFFF000);
+			dest = p_rs1 + cur_x_reg.e[0];													// Add offset to rs1 in "dest" to get memory address
+			dest = dest & 0xFFFFFFFF;
+			//printf("> ___READ from REGISTER___\n");
 
-				// Pass the required value to M register
-				new_m_reg->destinationAddress = dest;
-				new_m_reg->sizeOfByte = 2;
-				//new_m_reg->forwardingValue = p_rs1+temp;
+			// Pass the required value to M register
+			new_m_reg->destinationAddress = dest;
+			new_m_reg->sizeOfByte = 2;
+			//new_m_reg->forwardingValue = p_rs1+temp;
 
-				// Set the M and W register status
-				new_m_reg->memoryRead = true;
-			}
+			// Set the M and W register status
+			new_m_reg->memoryRead = true;
 
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
 
@@ -986,28 +6194,18 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 7: ;// lwu															// Initialize pointers
 			//printf("> Execute lwu\n");
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[9] == cur_m_reg.e[8]){
-					new_m_reg->unsigned_passValue = cur_m_reg.forwardingValue;
-				//	printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-				//	printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				cur_x_reg.e[0] = converter(cur_x_reg.e[0],0x800,0xFFFFFFFFFFFFF000);
-				dest = cur_x_reg.e[8] + cur_x_reg.e[0];													// Add offset to rs1 in "dest" to get memory address
-				dest = dest & 0xFFFFFFFF;
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
+			cur_x_reg.e[0] = converter(cur_x_reg.e[0],0x800,0xFFFFFFFFFFFFF000);
+			dest = p_rs1 + cur_x_reg.e[0];													// Add offset to rs1 in "dest" to get memory address
+			dest = dest & 0xFFFFFFFF;
+			//printf("> ___READ from REGISTER___\n");
 
-				// Pass the required value to M register
-				new_m_reg->destinationAddress = dest;
-				new_m_reg->sizeOfByte = 4;
-				//new_m_reg->forwardingValue = p_rs1+temp;
+			// Pass the required value to M register
+			new_m_reg->destinationAddress = dest;
+			new_m_reg->sizeOfByte = 4;
+			//new_m_reg->forwardingValue = p_rs1+temp;
 
-				// Set the M and W register status
-				new_m_reg->memoryRead = true;
-			}
+			// Set the M and W register status
+			new_m_reg->memoryRead = true;
 
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
 
@@ -1019,23 +6217,10 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 		case 10: ;// addi
 			//printf("> Execute addi\n");
 			temp = converter(cur_x_reg.e[0],0x800,0xFFFFFFFFFFFFF000);
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs1);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				p_rs1 = cur_x_reg.rs1;
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
-			}
 
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
 			new_m_reg->unsigned_passValue = p_rs1 + temp;
-			new_m_reg->forwardingValue = p_rs1+temp;
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
@@ -1044,21 +6229,9 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 11: ;// slli
 		//	printf("> Execute slli\n");
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-			//		printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				p_rs1 = cur_x_reg.rs1;
-			//	printf("> ___READ___\n");
-				new_m_reg->forwardTag = true;
-			}
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
 			new_m_reg->unsigned_passValue = p_rs1 << cur_x_reg.e[0];
-			new_m_reg->forwardingValue = p_rs1 << cur_x_reg.e[0];
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
@@ -1067,28 +6240,15 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 		case 12: ;// slti
 			//printf("> Execute slti\n");
 			temp = converter(cur_x_reg.e[0],0x800,0xFFFFFFFFFFFFF000);
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-			//		printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				p_rs1 = cur_x_reg.rs1;
-			//	printf("> ___READ___\n");
-				new_m_reg->forwardTag = true;
-			}
 
-			if(p_rs1 < temp){
+			if((int64_t)p_rs1 < (int64_t)temp){
 				// Pass the required value to M register
 				new_m_reg->destinationRegister = cur_x_reg.e[9];
 				new_m_reg->unsigned_passValue = 0x1;
-				new_m_reg->forwardingValue = 0x1;
 			}else{
 				// Pass the required value to M register
 				new_m_reg->destinationRegister = cur_x_reg.e[9];
 				new_m_reg->unsigned_passValue = 0x0;
-				new_m_reg->forwardingValue = 0x0;
 			}
 
 			// Set the M and W register status
@@ -1098,27 +6258,15 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 13: ;// sltiu
 			//printf("> Execute sltiu\n");
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				p_rs1 = cur_x_reg.rs1;
-				//printf("> ___READ___\n");
-				new_m_reg->forwardTag = true;
-			}
-			if(p_rs1 < cur_x_reg.e[0]){
+			temp = converter(cur_x_reg.e[0],0x800,0xFFFFFFFFFFFFF000);
+			if(p_rs1 < temp){
 				// Pass the required value to M register
 				new_m_reg->destinationRegister = cur_x_reg.e[9];
 				new_m_reg->unsigned_passValue = 0x1;
-				new_m_reg->forwardingValue = 0x1;
 			}else{
 				// Pass the required value to M register
 				new_m_reg->destinationRegister = cur_x_reg.e[9];
 				new_m_reg->unsigned_passValue = 0x0;
-				new_m_reg->forwardingValue = 0x0;
 			}
 
 			// Set the M and W register status
@@ -1129,22 +6277,10 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 		case 14: ;// xori
 			//printf("> Execute xori\n");
 			temp = converter(cur_x_reg.e[0],0x800,0xFFFFFFFFFFFFF000);
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				p_rs1 = cur_x_reg.rs1;
-				//printf("> ___READ___\n");
-				new_m_reg->forwardTag = true;
-			}
 
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
 			new_m_reg->unsigned_passValue = p_rs1 ^ temp;
-			new_m_reg->forwardingValue = p_rs1^temp;
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
@@ -1153,21 +6289,9 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 15: ;// srli
 			//printf("> Execute slri\n");
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				p_rs1 = cur_x_reg.rs1;
-				//printf("> ___READ___\n");
-				new_m_reg->forwardTag = true;
-			}
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
-			new_m_reg->unsigned_passValue = p_rs1 >> temp;
-			new_m_reg->forwardingValue = p_rs1 >> temp;
+			new_m_reg->unsigned_passValue = p_rs1 >> (cur_x_reg.e[0] & 0x3F);
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
@@ -1175,21 +6299,9 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 16: ;// srai
 			//printf("> Execute srai\n");
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				p_rs1 = cur_x_reg.rs1;
-				//printf("> ___READ___\n");
-				new_m_reg->forwardTag = true;
-			}
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
-			new_m_reg->unsigned_passValue = p_rs1 >> temp;
-			new_m_reg->forwardingValue = p_rs1 >> temp;
+			new_m_reg->unsigned_passValue = (int64_t)p_rs1 >> (cur_x_reg.e[0] & 0x3F);
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
@@ -1198,21 +6310,9 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 		case 17: ;// ori
 			//printf("> Execute ori\n");
 			temp = converter(cur_x_reg.e[0],0x800,0xFFFFFFFFFFFFF000);
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				p_rs1 = cur_x_reg.rs1;
-				//printf("> ___READ___\n");
-				new_m_reg->forwardTag = true;
-			}
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
 			new_m_reg->unsigned_passValue = p_rs1 | temp;
-			new_m_reg->forwardingValue = p_rs1 | temp;
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
@@ -1221,49 +6321,33 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 		case 18: ;// andi
 			//printf("> Execute andi\n");
 			temp = converter(cur_x_reg.e[0],0x800,0xFFFFFFFFFFFFF000);
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				p_rs1 = cur_x_reg.rs1;
-				//printf("> ___READ___\n");
-				new_m_reg->forwardTag = true;
-			}
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
 			new_m_reg->unsigned_passValue = p_rs1 & temp;
-			new_m_reg->forwardingValue = p_rs1 & temp;
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
 			break;
 
 		case 19: ;// auipc
+			//printf("> Execute auipc\n");
+			temp = converter(cur_x_reg.e[3] << 12,0x80000000,0xFFFFFFFF00000000);
+
+			// Pass the required value to M register
+			new_m_reg->destinationRegister = cur_x_reg.e[9];
+			new_m_reg->unsigned_passValue = cur_x_reg.pc + temp;
+
+			// Set the M and W register status
+			new_m_reg->writeRun = true;
 			break;
 
 		case 20: ;// addiw
 			//printf("> Execute addiw\n");
 			temp = converter(cur_x_reg.e[0],0x800,0xFFFFFFFFFFFFF000);
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-				p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs1);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				p_rs1 = cur_x_reg.rs1;
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
-			}
 
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
-			new_m_reg->unsigned_passValue = p_rs1 + temp;
-			new_m_reg->forwardingValue = p_rs1+temp;
+			new_m_reg->unsigned_passValue = (int64_t)(int32_t)(p_rs1 + temp);
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
@@ -1272,21 +6356,9 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 21: ;// slliw
 			//printf("> Execute slliw\n");
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				p_rs1 = cur_x_reg.rs1;
-				//printf("> ___READ___\n");
-				new_m_reg->forwardTag = true;
-			}
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
-			new_m_reg->unsigned_passValue = p_rs1 << cur_x_reg.e[0];
-			new_m_reg->forwardingValue = p_rs1 << cur_x_reg.e[0];
+			new_m_reg->unsigned_passValue = (int64_t)(int32_t)((uint32_t)p_rs1 << (cur_x_reg.e[0] & 0x1F));
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
@@ -1294,21 +6366,9 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 22: ;// srliw
 			//printf("> Execute slriw\n");
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				p_rs1 = cur_x_reg.rs1;
-				//printf("> ___READ___\n");
-				new_m_reg->forwardTag = true;
-			}
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
-			new_m_reg->unsigned_passValue = p_rs1 >> temp;
-			new_m_reg->forwardingValue = p_rs1 >> temp;
+			new_m_reg->unsigned_passValue = (int64_t)(int32_t)((uint32_t)p_rs1 >> (cur_x_reg.e[0] & 0x1F));
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
@@ -1316,21 +6376,9 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 23: ;// sraiw
 			//printf("> Execute sraiw\n");
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				p_rs1 = cur_x_reg.rs1;
-				//printf("> ___READ___\n");
-				new_m_reg->forwardTag = true;
-			}
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
-			new_m_reg->unsigned_passValue = p_rs1 >> temp;
-			new_m_reg->forwardingValue = p_rs1 >> temp;
+			new_m_reg->unsigned_passValue = (int64_t)((int32_t)p_rs1 >> (cur_x_reg.e[0] & 0x1F));
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
@@ -1338,22 +6386,6 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 24: ;// sb
 			//printf("> Execute sb\n");
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[7] == cur_m_reg.e[9]){
-					p_rs2 = cur_w_reg.forwardingValue;
-					p_rs2 = p_rs2 &0xFF;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				p_rs2 = cur_x_reg.rs2;
-				p_rs2 = p_rs2 & 0xFF;
-				//printf("> ___READ from REGISTER___\n");
-			  new_m_reg->forwardTag = true;
-			}
-
-			p_rs1 = cur_x_reg.rs1;
 			//register_read(cur_x_reg.e[8], cur_x_reg.e[7], &p_rs1, &p_rs2);
 			p_r = ((cur_x_reg.e[1] << 5) | cur_x_reg.e[5]);
 			p_r = converter(p_r,0x800,0xFFFFFFFFFFFFF000);
@@ -1363,7 +6395,6 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 			new_m_reg->destinationAddress = p_r;
 			new_m_reg->sizeOfByte = 1;
 			new_m_reg->unsigned_passValue = p_rs2;
-			new_m_reg->forwardingValue = p_rs2;
 
 			// Set the M and W register status
 			new_m_reg->memoryWrite = true;
@@ -1372,22 +6403,6 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 25: ;// sh
 			//printf("> Execute sh\n");
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[7] == cur_m_reg.e[9]){
-					p_rs2 = cur_w_reg.forwardingValue;
-					p_rs2 = p_rs2 &0xFF;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				p_rs2 = cur_x_reg.rs2;
-				p_rs2 = p_rs2 & 0xFF;
-				//printf("> ___READ from REGISTER___\n");
-			  new_m_reg->forwardTag = true;
-			}
-
-			p_rs1 = cur_x_reg.rs1;
 			//register_read(cur_x_reg.e[8], cur_x_reg.e[7], &p_rs1, &p_rs2);
 			p_r = ((cur_x_reg.e[1] << 5) | cur_x_reg.e[5]);
 			p_r = converter(p_r,0x800,0xFFFFFFFFFFFFF000);
@@ -1397,7 +6412,6 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 			new_m_reg->destinationAddress = p_r;
 			new_m_reg->sizeOfByte = 2;
 			new_m_reg->unsigned_passValue = p_rs2;
-			new_m_reg->forwardingValue = p_rs2;
 
 			// Set the M and W register status
 			new_m_reg->memoryWrite = true;
@@ -1406,22 +6420,6 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 26: ;// sw
 			//printf("> Execute sw\n");
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[7] == cur_m_reg.e[9]){
-					p_rs2 = cur_w_reg.forwardingValue;
-					p_rs2 = p_rs2 &0xFF;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				p_rs2 = cur_x_reg.rs2;
-				p_rs2 = p_rs2 & 0xFF;
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
-			}
-
-			p_rs1 = cur_x_reg.rs1;
 			//register_read(cur_x_reg.e[8], cur_x_reg.e[7], &p_rs1, &p_rs2);
 			p_r = ((cur_x_reg.e[1] << 5) | cur_x_reg.e[5]);
 			p_r = converter(p_r,0x800,0xFFFFFFFFFFFFF000);
@@ -1431,7 +6429,6 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 			new_m_reg->destinationAddress = p_r;
 			new_m_reg->sizeOfByte = 4;
 			new_m_reg->unsigned_passValue = p_rs2;
-			new_m_reg->forwardingValue = p_rs2;
 
 			// Set the M and W register status
 			new_m_reg->memoryWrite = true;
@@ -1440,22 +6437,6 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 27: ;// sd
 			//printf("> Execute sd\n");
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[7] == cur_m_reg.e[9]){
-					p_rs2 = cur_w_reg.forwardingValue;
-					p_rs2 = p_rs2 &0xFF;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				p_rs2 = cur_x_reg.rs2;
-				p_rs2 = p_rs2 & 0xFF;
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
-			}
-
-			p_rs1 = cur_x_reg.rs1;
 			//register_read(cur_x_reg.e[8], cur_x_reg.e[7], &p_rs1, &p_rs2);
 			p_r = ((cur_x_reg.e[1] << 5) | cur_x_reg.e[5]);
 			p_r = converter(p_r,0x800,0xFFFFFFFFFFFFF000);
@@ -1465,7 +6446,6 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 			new_m_reg->destinationAddress = p_r;
 			new_m_reg->sizeOfByte = 8;
 			new_m_reg->unsigned_passValue = p_rs2;
-			new_m_reg->forwardingValue = p_rs2;
 
 			// Set the M and W register status
 			new_m_reg->memoryWrite = true;
@@ -1474,29 +6454,10 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 28: ;// add
 			//printf("> Execute add\n");
-			p_rs1 = cur_x_reg.rs1;
-			p_rs2 = cur_x_reg.rs2;
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs1);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}else if(cur_x_reg.e[7] == cur_m_reg.e[9]){
-					p_rs2 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
-			}
 
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
 			new_m_reg->unsigned_passValue = p_rs1 + p_rs2;
-			new_m_reg->forwardingValue = p_rs1+p_rs2;
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
@@ -1505,29 +6466,10 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 29: ;// sub
 			//printf("> Execute sub\n");
-			p_rs1 = cur_x_reg.rs1;
-			p_rs2 = cur_x_reg.rs2;
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs1);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}else if(cur_x_reg.e[7] == cur_m_reg.e[9]){
-					p_rs2 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
-			}
 
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
 			new_m_reg->unsigned_passValue = p_rs1 - p_rs2;
-			new_m_reg->forwardingValue = p_rs1-p_rs2;
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
@@ -1536,29 +6478,10 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 30: ;// sll
 			//printf("> Execute sll\n");
-			p_rs1 = cur_x_reg.rs1;
-			p_rs2 = cur_x_reg.rs2;
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs1);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}else if(cur_x_reg.e[7] == cur_m_reg.e[9]){
-					p_rs2 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
-			}
 
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
-			new_m_reg->unsigned_passValue = p_rs1 << p_rs2;
-			new_m_reg->forwardingValue = p_rs1<<p_rs2;
+			new_m_reg->unsigned_passValue = p_rs1 << (p_rs2 & 0x3F);
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
@@ -1567,102 +6490,46 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 31: ;// slt
 			//printf("> Execute slt\n");
-			p_rs1 = cur_x_reg.rs1;
-			p_rs2 = cur_x_reg.rs2;
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs1);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}else if(cur_x_reg.e[7] == cur_m_reg.e[9]){
-					p_rs2 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
-			}
 
-		  if(p_rs1 < p_rs2){
+			if((int64_t)p_rs1 < (int64_t)p_rs2){
 				// Pass the required value to M register
 				new_m_reg->destinationRegister = cur_x_reg.e[9];
 				new_m_reg->unsigned_passValue = 0x1;
-				new_m_reg->forwardingValue = 0x1;
 			}else{
 				// Pass the required value to M register
 				new_m_reg->destinationRegister = cur_x_reg.e[9];
 				new_m_reg->unsigned_passValue = 0x0;
-				new_m_reg->forwardingValue = 0x0;
 			}
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
 
+			break;
+
 		case 32: ;// sltu
-			//printf("> Execute sltu\n");
-			p_rs1 = cur_x_reg.rs1;
-			p_rs2 = cur_x_reg.rs2;
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs1);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}else if(cur_x_reg.e[7] == cur_m_reg.e[9]){
-					p_rs2 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
-			}
+			//printf("> Execute sltu\n");
 
 			if(p_rs1 < p_rs2){
 				// Pass the required value to M register
 				new_m_reg->destinationRegister = cur_x_reg.e[9];
 				new_m_reg->unsigned_passValue = 0x1;
-				new_m_reg->forwardingValue = 0x1;
 			}else{
 				// Pass the required value to M register
 				new_m_reg->destinationRegister = cur_x_reg.e[9];
 				new_m_reg->unsigned_passValue = 0x0;
-				new_m_reg->forwardingValue = 0x0;
 			}
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
 
+			break;
 
 		case 33: ;// xor
 			//printf("> Execute xor\n");
-			p_rs1 = cur_x_reg.rs1;
-			p_rs2 = cur_x_reg.rs2;
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs1);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}else if(cur_x_reg.e[7] == cur_m_reg.e[9]){
-					p_rs2 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
-			}
 
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
 			new_m_reg->unsigned_passValue = p_rs1 ^ p_rs2;
-			new_m_reg->forwardingValue = p_rs1^p_rs2;
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
@@ -1671,29 +6538,10 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 34: ;// srl
 			//printf("> Execute srl\n");
-			p_rs1 = cur_x_reg.rs1;
-			p_rs2 = cur_x_reg.rs2;
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs1);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}else if(cur_x_reg.e[7] == cur_m_reg.e[9]){
-					p_rs2 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
-			}
 
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
-			new_m_reg->unsigned_passValue = p_rs1 >> p_rs2;
-			new_m_reg->forwardingValue = p_rs1>>p_rs2;
+			new_m_reg->unsigned_passValue = p_rs1 >> (p_rs2 & 0x3F);
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
@@ -1701,34 +6549,23 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 			break;
 
 		case 35: ;// sra
+			//printf("> Execute sra\n");
+
+			// Pass the required value to M register
+			new_m_reg->destinationRegister = cur_x_reg.e[9];
+			new_m_reg->unsigned_passValue = (int64_t)p_rs1 >> (p_rs2 & 0x3F);
+
+			// Set the M and W register status
+			new_m_reg->writeRun = true;
 
 			break;
 
 		case 36: ;// or
 			//printf("> Execute or\n");
-			p_rs1 = cur_x_reg.rs1;
-			p_rs2 = cur_x_reg.rs2;
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs1);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}else if(cur_x_reg.e[7] == cur_m_reg.e[9]){
-					p_rs2 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
-			}
 
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
 			new_m_reg->unsigned_passValue = p_rs1 | p_rs2;
-			new_m_reg->forwardingValue = p_rs1|p_rs2;
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
@@ -1737,29 +6574,10 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 37: ;// and
 			//printf("> Execute and\n");
-			p_rs1 = cur_x_reg.rs1;
-			p_rs2 = cur_x_reg.rs2;
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs1);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}else if(cur_x_reg.e[7] == cur_m_reg.e[9]){
-					p_rs2 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
-			}
 
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
 			new_m_reg->unsigned_passValue = p_rs1 & p_rs2;
-			new_m_reg->forwardingValue = p_rs1&p_rs2;
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
@@ -1767,34 +6585,23 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 			break;
 
 		case 38: ;// lui
-			
+			//printf("> Execute lui\n");
+			temp = converter(cur_x_reg.e[3] << 12,0x80000000,0xFFFFFFFF00000000);
+
+			// Pass the required value to M register
+			new_m_reg->destinationRegister = cur_x_reg.e[9];
+			new_m_reg->unsigned_passValue = temp;
+
+			// Set the M and W register status
+			new_m_reg->writeRun = true;
 			break;
 
 		case 39: ;// addw
 			//printf("> Execute addw\n");
-			p_rs1 = cur_x_reg.rs1;
-			p_rs2 = cur_x_reg.rs2;
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs1);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}else if(cur_x_reg.e[7] == cur_m_reg.e[9]){
-					p_rs2 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
-			}
 
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
-			new_m_reg->unsigned_passValue = p_rs1 + p_rs2;
-			new_m_reg->forwardingValue = p_rs1+p_rs2;
+			new_m_reg->unsigned_passValue = (int64_t)(int32_t)(p_rs1 + p_rs2);
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
@@ -1803,29 +6610,10 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 40: ;// subw
 			//printf("> Execute subw\n");
-			p_rs1 = cur_x_reg.rs1;
-			p_rs2 = cur_x_reg.rs2;
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs1);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}else if(cur_x_reg.e[7] == cur_m_reg.e[9]){
-					p_rs2 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
-			}
 
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
-			new_m_reg->unsigned_passValue = p_rs1 - p_rs2;
-			new_m_reg->forwardingValue = p_rs1-p_rs2;
+			new_m_reg->unsigned_passValue = (int64_t)(int32_t)(p_rs1 - p_rs2);
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
@@ -1834,29 +6622,10 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 41: ;// sllw
 			//printf("> Execute sllw\n");
-			p_rs1 = cur_x_reg.rs1;
-			p_rs2 = cur_x_reg.rs2;
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs1);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}else if(cur_x_reg.e[7] == cur_m_reg.e[9]){
-					p_rs2 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
-			}
 
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
-			new_m_reg->unsigned_passValue = p_rs1 << p_rs2;
-			new_m_reg->forwardingValue = p_rs1<<p_rs2;
+			new_m_reg->unsigned_passValue = (int64_t)(int32_t)((uint32_t)p_rs1 << (p_rs2 & 0x1F));
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
@@ -1864,454 +6633,192 @@ void stage_execute (struct stage_reg_m *new_m_reg){
 
 		case 42: ;// srlw
 			//printf("> Execute srlw\n");
-			p_rs1 = cur_x_reg.rs1;
-			p_rs2 = cur_x_reg.rs2;
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs1);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-			}else if(cur_x_reg.e[7] == cur_m_reg.e[9]){
-					p_rs2 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
-			}
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
-			new_m_reg->unsigned_passValue = p_rs1 >> p_rs2;
-			new_m_reg->forwardingValue = p_rs1>>p_rs2;
+			new_m_reg->unsigned_passValue = (int64_t)(int32_t)((uint32_t)p_rs1 >> (p_rs2 & 0x1F));
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
 			break;
 		
+		case 43: ;// sraw
+			//printf("> Execute sraw\n");
+			// Pass the required value to M register
+			new_m_reg->destinationRegister = cur_x_reg.e[9];
+			new_m_reg->unsigned_passValue = (int64_t)((int32_t)p_rs1 >> (p_rs2 & 0x1F));
+
+			// Set the M and W register status
+			new_m_reg->writeRun = true;
+			break;
+
 		case 44: ;// beq
             //printf("> Execute beq\n");
 			p_r = converter(cur_x_reg.e[10], 0x800, 0xFFFFFFFFFFFFF000);
 			p_r = p_r << 1;
-			p_rs1 = cur_x_reg.rs1;
-			p_rs2 = cur_x_reg.rs2;
-			
-			// forwarding
-			if(cur_w_reg.e[9] == cur_x_reg.e[7]){
-				p_rs2 = cur_w_reg.unsigned_passValue;
-			}else if(cur_w_reg.e[9] == cur_x_reg.e[8]){
-				p_rs1 = cur_w_reg.unsigned_passValue;
-			}
-			
-			if(cur_m_reg.e[9] == cur_x_reg.e[7]){
-				p_rs2 = cur_m_reg.unsigned_passValue;
-			}else if(cur_m_reg.e[9] == cur_x_reg.e[8]){
-				p_rs1 = cur_m_reg.unsigned_passValue;
-			}
 			
 			//printf("p_rs1 = 0x%016lx, p_rs1 = 0x%016lx\n", p_rs1, p_rs2);
-			if(p_rs1 == p_rs2)
-			{
-				new_m_reg->branch = true;
-				set_pc(cur_x_reg.pc + p_r);
-				//printf("?????????????????????????");
-			}
-			
 			//printf("> current_pc is: 0x%016lx\n", cur_x_reg.pc);
 			//printf("> offset is: 0x%016lx\n", p_r);
 			//printf("> new_pc is: 0x%016lx\n", (cur_x_reg.pc + p_r));
 			
-			// branch prediction checking
-			for(int i = 0; i<32; i++){
-				if(BTB[i][0] == cur_x_reg.pc){
-					if(BTB[i][1] == (cur_x_reg.pc + p_r)){
-						// same Target -> correct branch prediction, keep going
-						break;
-					}else{
-						if(BTB[i][1] == 0){ //no previous record for prediction, then store new Target
-							BTB[i][1] = (cur_x_reg.pc + p_r);
-							break;
-						}else{
-							// different target -> wrong branch prediction, need update and stalls
-							BTB[i][1] = (cur_x_reg.pc + p_r);
-							new_m_reg->wrong_prediction = true;
-						}
-					}
-				}
-			}
+			// resolve the branch and check the prediction
+			resolve_branch(new_m_reg, p_rs1 == p_rs2, cur_x_reg.pc + p_r);
 			break;
 			
 		case 45: ;// bne
 			p_r = converter(cur_x_reg.e[10], 0x800, 0xFFFFFFFFFFFFF000);
 			p_r = p_r << 1;
-			p_rs1 = cur_x_reg.rs1;
-			p_rs2 = cur_x_reg.rs2;
-			
-			// forwarding
-			if(cur_w_reg.e[9] == cur_x_reg.e[7]){
-				p_rs2 = cur_w_reg.unsigned_passValue;
-			}else if(cur_w_reg.e[9] == cur_x_reg.e[8]){
-				p_rs1 = cur_w_reg.unsigned_passValue;
-			}
-			
-			if(cur_m_reg.e[9] == cur_x_reg.e[7]){
-				p_rs2 = cur_m_reg.unsigned_passValue;
-			}else if(cur_m_reg.e[9] == cur_x_reg.e[8]){
-				p_rs1 = cur_m_reg.unsigned_passValue;
-			}
 			
 			//printf("p_rs1 = 0x%016lx, p_rs1 = 0x%016lx\n", p_rs1, p_rs2);
-			if(p_rs1 != p_rs2)
-			{
-				new_m_reg->branch = true;
-				set_pc(cur_x_reg.pc + p_r);
-			}
-			
 			//printf("> current_pc is: 0x%016lx\n", cur_x_reg.pc);
 			//printf("> offset is: 0x%016lx\n", p_r);
 			//printf("> new_pc is: 0x%016lx\n", (cur_x_reg.pc + p_r));
 			
-			// branch prediction checking
-			for(int i = 0; i<32; i++){
-				if(BTB[i][0] == cur_x_reg.pc){
-					if(BTB[i][1] == (cur_x_reg.pc + p_r)){
-						// same Target -> correct branch prediction, keep going
-						break;
-					}else{
-						if(BTB[i][1] == 0){ //no previous record for prediction, then store new Target
-							BTB[i][1] = (cur_x_reg.pc + p_r);
-							break;
-						}else{
-							// different target -> wrong branch prediction, need update and stalls
-							BTB[i][1] = (cur_x_reg.pc + p_r);
-							new_m_reg->wrong_prediction = true;
-						}
-					}
-				}
-			}
+			// resolve the branch and check the prediction
+			resolve_branch(new_m_reg, p_rs1 != p_rs2, cur_x_reg.pc + p_r);
 			break;
 
 		case 46: ;// blt
             p_r = converter(cur_x_reg.e[10], 0x800, 0xFFFFFFFFFFFFF000);
 			p_r = p_r << 1;
-			p_rs1 = cur_x_reg.rs1;
-			p_rs2 = cur_x_reg.rs2;
-			
-			// forwarding
-			if(cur_w_reg.e[9] == cur_x_reg.e[7]){
-				p_rs2 = cur_w_reg.unsigned_passValue;
-			}else if(cur_w_reg.e[9] == cur_x_reg.e[8]){
-				p_rs1 = cur_w_reg.unsigned_passValue;
-			}
-			
-			if(cur_m_reg.e[9] == cur_x_reg.e[7]){
-				p_rs2 = cur_m_reg.unsigned_passValue;
-			}else if(cur_m_reg.e[9] == cur_x_reg.e[8]){
-				p_rs1 = cur_m_reg.unsigned_passValue;
-			}
 			
 			//printf("p_rs1 = 0x%016lx, p_rs1 = 0x%016lx\n", p_rs1, p_rs2);
-			if((int64_t)p_rs1 < (int64_t)p_rs2)
-			{
-				new_m_reg->branch = true;
-				set_pc(cur_x_reg.pc + p_r);
-			}
-			
 			//printf("> current_pc is: 0x%016lx\n", cur_x_reg.pc);
 			//printf("> offset is: 0x%016lx\n", p_r);
 			//printf("> new_pc is: 0x%016lx\n", (cur_x_reg.pc + p_r));
 				
-			// branch prediction checking
-			for(int i = 0; i<32; i++){
-				if(BTB[i][0] == cur_x_reg.pc){
-					if(BTB[i][1] == (cur_x_reg.pc + p_r)){
-						// same Target -> correct branch prediction, keep going
-						break;
-					}else{
-						if(BTB[i][1] == 0){ //no previous record for prediction, then store new Target
-							BTB[i][1] = (cur_x_reg.pc + p_r);
-							break;
-						}else{
-							// different target -> wrong branch prediction, need update and stalls
-							BTB[i][1] = (cur_x_reg.pc + p_r);
-							new_m_reg->wrong_prediction = true;
-						}
-					}
-				}
-			}
+			// resolve the branch and check the prediction
+			resolve_branch(new_m_reg, (int64_t)p_rs1 < (int64_t)p_rs2, cur_x_reg.pc + p_r);
 			break;
 
 		case 47: ;// bge
             p_r = converter(cur_x_reg.e[10], 0x800, 0xFFFFFFFFFFFFF000);
 			p_r = p_r << 1;
-			p_rs1 = cur_x_reg.rs1;
-			p_rs2 = cur_x_reg.rs2;
-			
-			// forwarding
-			if(cur_w_reg.e[9] == cur_x_reg.e[7]){
-				p_rs2 = cur_w_reg.unsigned_passValue;
-			}else if(cur_w_reg.e[9] == cur_x_reg.e[8]){
-				p_rs1 = cur_w_reg.unsigned_passValue;
-			}
-			
-			if(cur_m_reg.e[9] == cur_x_reg.e[7]){
-				p_rs2 = cur_m_reg.unsigned_passValue;
-			}else if(cur_m_reg.e[9] == cur_x_reg.e[8]){
-				p_rs1 = cur_m_reg.unsigned_passValue;
-			}
 			
 			//printf("p_rs1 = 0x%016lx, p_rs1 = 0x%016lx\n", p_rs1, p_rs2);
-			if((int64_t)p_rs1 >= (int64_t)p_rs2)
-			{
-				new_m_reg->branch = true;
-				set_pc(cur_x_reg.pc + p_r);
-			}
-			
 			//printf("> current_pc is: 0x%016lx\n", cur_x_reg.pc);
 			//printf("> offset is: 0x%016lx\n", p_r);
 			//printf("> new_pc is: 0x%016lx\n", (cur_x_reg.pc + p_r));
 			
-			// branch prediction checking
-			for(int i = 0; i<32; i++){
-				if(BTB[i][0] == cur_x_reg.pc){
-					if(BTB[i][1] == (cur_x_reg.pc + p_r)){
-						// same Target -> correct branch prediction, keep going
-						break;
-					}else{
-						if(BTB[i][1] == 0){ //no previous record for prediction, then store new Target
-							BTB[i][1] = (cur_x_reg.pc + p_r);
-							break;
-						}else{
-							// different target -> wrong branch prediction, need update and stalls
-							BTB[i][1] = (cur_x_reg.pc + p_r);
-							new_m_reg->wrong_prediction = true;
-						}
-					}
-				}
-			}
+			// resolve the branch and check the prediction
+			resolve_branch(new_m_reg, (int64_t)p_rs1 >= (int64_t)p_rs2, cur_x_reg.pc + p_r);
 			break;
 
 
 		case 48: ;// bltu
             p_r = converter(cur_x_reg.e[10], 0x800, 0xFFFFFFFFFFFFF000);
 			p_r = p_r << 1;
-			p_rs1 = cur_x_reg.rs1;
-			p_rs2 = cur_x_reg.rs2;
-			
-			// forwarding
-			if(cur_w_reg.e[9] == cur_x_reg.e[7]){
-				p_rs2 = cur_w_reg.unsigned_passValue;
-			}else if(cur_w_reg.e[9] == cur_x_reg.e[8]){
-				p_rs1 = cur_w_reg.unsigned_passValue;
-			}
-			
-			if(cur_m_reg.e[9] == cur_x_reg.e[7]){
-				p_rs2 = cur_m_reg.unsigned_passValue;
-			}else if(cur_m_reg.e[9] == cur_x_reg.e[8]){
-				p_rs1 = cur_m_reg.unsigned_passValue;
-			}
 			
 			//printf("p_rs1 = 0x%016lx, p_rs1 = 0x%016lx\n", p_rs1, p_rs2);
-			if(p_rs1 < p_rs2)
-			{
-				new_m_reg->branch = true;
-				set_pc(cur_x_reg.pc + p_r);
-			}
-			
 			//printf("> current_pc is: 0x%016lx\n", cur_x_reg.pc);
 			//printf("> offset is: 0x%016lx\n", p_r);
 			//printf("> new_pc is: 0x%016lx\n", (cur_x_reg.pc + p_r));
 			
-			// branch prediction checking
-			for(int i = 0; i<32; i++){
-				if(BTB[i][0] == cur_x_reg.pc){
-					if(BTB[i][1] == (cur_x_reg.pc + p_r)){
-						// same Target -> correct branch prediction, keep going
-						break;
-					}else{
-						if(BTB[i][1] == 0){ //no previous record for prediction, then store new Target
-							BTB[i][1] = (cur_x_reg.pc + p_r);
-							break;
-						}else{
-							// different target -> wrong branch prediction, need update and stalls
-							BTB[i][1] = (cur_x_reg.pc + p_r);
-							new_m_reg->wrong_prediction = true;
-						}
-					}
-				}
-			}
+			// resolve the branch and check the prediction
+			resolve_branch(new_m_reg, p_rs1 < p_rs2, cur_x_reg.pc + p_r);
 			break;
 
 		case 49: ;// bgeu
 			p_r = converter(cur_x_reg.e[10], 0x800, 0xFFFFFFFFFFFFF000);
 			p_r = p_r << 1;
-			p_rs1 = cur_x_reg.rs1;
-			p_rs2 = cur_x_reg.rs2;
-			
-			// forwarding
-			if(cur_w_reg.e[9] == cur_x_reg.e[7]){
-				p_rs2 = cur_w_reg.unsigned_passValue;
-			}else if(cur_w_reg.e[9] == cur_x_reg.e[8]){
-				p_rs1 = cur_w_reg.unsigned_passValue;
-			}
-			
-			if(cur_m_reg.e[9] == cur_x_reg.e[7]){
-				p_rs2 = cur_m_reg.unsigned_passValue;
-			}else if(cur_m_reg.e[9] == cur_x_reg.e[8]){
-				p_rs1 = cur_m_reg.unsigned_passValue;
-			}
 			
 			//printf("p_rs1 = 0x%016lx, p_rs1 = 0x%016lx\n", p_rs1, p_rs2);
-			if(p_rs1 >= p_rs2)
-			{
-				new_m_reg->branch = true;
-				set_pc(cur_x_reg.pc + p_r);
-			}
-			
 			//printf("> current_pc is: 0x%016lx\n", cur_x_reg.pc);
 			//printf("> offset is: 0x%016lx\n", p_r);
 			//printf("> new_pc is: 0x%016lx\n", (cur_x_reg.pc + p_r));
 			
-			// branch prediction checking
-			for(int i = 0; i<32; i++){
-				if(BTB[i][0] == cur_x_reg.pc){
-					if(BTB[i][1] == (cur_x_reg.pc + p_r)){
-						// same Target -> correct branch prediction, keep going
-						break;
-					}else{
-						if(BTB[i][1] == 0){ //no previous record for prediction, then store new Target
-							BTB[i][1] = (cur_x_reg.pc + p_r);
-							break;
-						}else{
-							// different target -> wrong branch prediction, need update and stalls
-							BTB[i][1] = (cur_x_reg.pc + p_r);
-							new_m_reg->wrong_prediction = true;
-						}
-					}
-				}
-			}
+			// resolve the branch and check the prediction
+			resolve_branch(new_m_reg, p_rs1 >= p_rs2, cur_x_reg.pc + p_r);
 			break;
 
 		case 50: ;// jalr
-            p_rs1 = cur_x_reg.rs1;
-			p_rs2 = cur_x_reg.rs2;
 	        dest = converter(cur_x_reg.e[0], 0x800, 0xFFFFFFFFFFFFF000);
 			p_r = p_rs1 + dest;
-			shiftAmount = p_r & 0xfffffffe;
-			new_m_reg->branch = true;
-			set_pc(cur_x_reg.pc + shiftAmount);
+			shiftAmount = p_r & ~0x1ULL;
+			resolve_jump(new_m_reg, shiftAmount);
 			
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
-			new_m_reg->unsigned_passValue = shiftAmount;
+			new_m_reg->unsigned_passValue = cur_x_reg.seq_pc;
 			
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
 			break;
 
 		case 51: ;// jal
-			p_r = converter(cur_x_reg.e[4], 0x8000, 0xFFFFFFFFFFFF0000);
-			set_pc(cur_x_reg.pc + p_r);
-			new_m_reg->branch = true;
+			p_r = cur_x_reg.e[4] << 1; // sign-extended in decode
+			resolve_jump(new_m_reg, cur_x_reg.pc + p_r);
 			
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
-			new_m_reg->unsigned_passValue = get_pc() +4;
+			new_m_reg->unsigned_passValue = cur_x_reg.seq_pc;
 			
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
 			
 			break;
 		
-		case 60: ; // mul
-			//printf("> Execute mul\n");
-			p_rs1 = cur_x_reg.rs1;
-			p_rs2 = cur_x_reg.rs2;
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs1);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-			}else if(cur_x_reg.e[7] == cur_m_reg.e[9]){
-					p_rs2 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
+		case 55: ; // csrrs, of the csrs only mhartid is there to read
+			if((cur_x_reg.instruction >> 20) == 0xF14){
+				new_m_reg->destinationRegister = cur_x_reg.e[9];
+				new_m_reg->unsigned_passValue = get_hart_id();
+				new_m_reg->writeRun = true;
 			}
+			break;
+			
+		case 60: ; // mul, mulh, mulhsu, mulhu, mulw
+			mul_count++;
 			
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
-			new_m_reg->unsigned_passValue = p_rs1 * p_rs2;
-			new_m_reg->forwardingValue = p_rs1 * p_rs2;
+			new_m_reg->unsigned_passValue = muldiv_result(cur_x_reg.instruction, p_rs1, p_rs2);
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
 			break;
 			
-		case 61: ; // div
-			//printf("> Execute div\n");
-			p_rs1 = cur_x_reg.rs1;
-			p_rs2 = cur_x_reg.rs2;
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs1);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-			}else if(cur_x_reg.e[7] == cur_m_reg.e[9]){
-					p_rs2 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
-			}
+		case 61: ; // div, divu, divw, divuw
+		case 62: ; // rem, remu, remw, remuw
+			div_count++;
 			
 			// Pass the required value to M register
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
-			new_m_reg->unsigned_passValue = p_rs1 / p_rs2;
-			new_m_reg->forwardingValue = p_rs1 / p_rs2;
+			new_m_reg->unsigned_passValue = muldiv_result(cur_x_reg.instruction, p_rs1, p_rs2);
 
 			// Set the M and W register status
 			new_m_reg->writeRun = true;
 			break;
+		
+		case 63: ; // vsetvli, vsetivli, vsetvl
+			new_m_reg->destinationRegister = cur_x_reg.e[9];
+			new_m_reg->unsigned_passValue = vector_setvl(cur_x_reg.instruction, p_rs1, p_rs2);
+			new_m_reg->writeRun = true;
+			break;
 			
-		case 62: ; // rem
-			//printf("> Execute rem\n");
-			p_rs1 = cur_x_reg.rs1;
-			p_rs2 = cur_x_reg.rs2;
-			if(cur_m_reg.forwardTag){
-				if(cur_x_reg.e[8] == cur_m_reg.e[9]){
-					p_rs1 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs1);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-			}else if(cur_x_reg.e[7] == cur_m_reg.e[9]){
-					p_rs2 = cur_m_reg.forwardingValue;
-					//printf("> forwardingValue is: 0x%016lx\n", p_rs2);
-					//printf("> ___FORWARDING HERE___\n");
-					new_m_reg->forwardTag = false;
-				}
-			}else{
-				//printf("> ___READ from REGISTER___\n");
-				new_m_reg->forwardTag = true;
-			}
+		case 64: ; // vector loads
+		case 65: ; // vector stores, memory stage walks the elements
+			vector_memory_setup(cur_x_reg.instruction, p_rs1, p_rs2);
+			break;
 			
-			// Pass the required value to M register
+		case 66: ; // vector arithmetic
+			vector_arith++;
+			vector_execute(cur_x_reg.instruction, p_rs1);
+			break;
+			
+		case 67: ; // vmv.x.s, vcpop.m, vfirst.m
+			vector_arith++;
+			new_m_reg->destinationRegister = cur_x_reg.e[9];
+			new_m_reg->unsigned_passValue = vector_scalar(cur_x_reg.instruction);
+			new_m_reg->writeRun = true;
+			break;
+			
+		case 68: ; // lr, sc, amo*, memory stage does the read-modify-write
+			new_m_reg->destinationAddress = p_rs1 & 0xFFFFFFFF;
+			new_m_reg->sizeOfByte = ((cur_x_reg.instruction >> 12) & 0x7) == 0x2 ? 4 : 8;
+			new_m_reg->unsigned_passValue = p_rs2;
+			new_m_reg->memoryRead = true;
+			new_m_reg->memoryWrite = atomic_op(cur_x_reg.instruction) != AMO_LR;
 			new_m_reg->destinationRegister = cur_x_reg.e[9];
-			new_m_reg->unsigned_passValue = p_rs1 % p_rs2;
-			new_m_reg->forwardingValue = p_rs1 % p_rs2;
-
-			// Set the M and W register status
 			new_m_reg->writeRun = true;
 			break;
 			
@@ -2325,6 +6832,18 @@ void stage_memory (struct stage_reg_w *new_w_reg){
 	uint64_t temp;
 	uint64_t result_array[2]; // result[1] contains success status of cache, result[2] contains exact result
 	
+	m_stage_out = new_w_reg;
+	coherence_start();
+	
+	if(ooo_enabled){
+		memset(new_w_reg, 0, sizeof(*new_w_reg));
+		ooo_memory();
+		return;
+	}
+	
+	// collect finished prefetches every cycle, even when this stage stalls
+	prefetch_poll();
+	
 	if(cur_m_reg.i_cache_stall){
 		new_w_reg->i_cache_stall = true;
 		return;
@@ -2332,18 +6851,23 @@ void stage_memory (struct stage_reg_w *new_w_reg){
 		new_w_reg->i_cache_stall = false;
 	}
 	
-	if(cur_w_reg.d_cache_stall){
-		if(memory_status(cur_m_reg.destinationAddress, &temp)){
-			if(cur_w_reg.first_cache_stall){
-				new_w_reg->first_cache_stall = false;
-				new_w_reg->d_cache_stall = false;
-			}else{
-				update_d_cache(d_cache, cur_m_reg.destinationAddress, temp);
-				new_w_reg->d_cache_stall = true;
-				new_w_reg->first_cache_stall = true;
+	if(cur_w_reg.store_buffer_stall || cur_w_reg.tlb_stall || cur_w_reg.vector_stall || cur_w_reg.atomic_stall || cur_w_reg.coherence_stall){ // checked again below
+		new_w_reg->store_buffer_stall = false;
+		new_w_reg->tlb_stall = false;
+		new_w_reg->vector_stall = false;
+		new_w_reg->atomic_stall = false;
+		new_w_reg->coherence_stall = false;
+		new_w_reg->d_cache_stall = false;
+	}else if(cur_w_reg.d_cache_stall){
+		if(memory_status_l2(m_stage_paddr & ~0x7ULL, &temp)){
+			// a claimed prefetch may have filled the line already, the slot then has no data
+			if(check_d_cache(d_cache, m_stage_paddr, 1, result_array)[0] != 1){
+				update_d_cache(d_cache, m_stage_paddr, temp);
 			}
+			new_w_reg->d_cache_stall = false; // go on below, the access hits now
 		}else{
 			new_w_reg->d_cache_stall = true;
+			memory_port_idle(); // memory port is idle while waiting
 			return;
 		}
 	}
@@ -2365,6 +6889,40 @@ void stage_memory (struct stage_reg_w *new_w_reg){
 		return;
 	}
 	
+	// a vector load/store holds memory stage until all its elements are done
+	if((cur_m_reg.funct == 64 || cur_m_reg.funct == 65) && vector_memory(new_w_reg)){
+		return;
+	}
+	
+	// translate the data address, the DTLB walk holds the pipeline like a d-cache miss
+	uint64_t address = cur_m_reg.destinationAddress;
+	if(cur_m_reg.memoryRead || cur_m_reg.memoryWrite){
+		if(!translate(&dtlb, cur_m_reg.destinationAddress, cur_m_reg.memoryWrite ? TLB_WRITE : TLB_READ, &address)){
+			new_w_reg->d_cache_stall = true;
+			new_w_reg->tlb_stall = true;
+			return;
+		}
+		m_stage_paddr = address;
+	}
+	
+	// a fence or an atomic waits for the store buffer to drain, a store waits for room in it
+	if(store_buffer_enabled){
+		bool fence = (cur_m_reg.funct == 8 || cur_m_reg.funct == 9 || cur_m_reg.funct == 68) && store_buffer_count > 0;
+		bool full  = cur_m_reg.memoryWrite && store_buffer_count == store_buffer_depth &&
+		             find_store_buffer(address & ~0x7ULL) < 0;
+		if(fence || full){
+			if(fence){
+				sb_fence_stall_cycles++;
+			}else{
+				sb_full_stall_cycles++;
+			}
+			new_w_reg->d_cache_stall = true;
+			new_w_reg->store_buffer_stall = true;
+			memory_port_idle();
+			return;
+		}
+	}
+	
 	new_w_reg->ptr = &cur_w_reg;
 	new_w_reg->pc = cur_m_reg.pc;
 	new_w_reg->instruction = cur_m_reg.instruction;	
@@ -2374,32 +6932,89 @@ void stage_memory (struct stage_reg_w *new_w_reg){
 	new_w_reg->run = cur_m_reg.writeRun;
 	new_w_reg->destinationRegister = cur_m_reg.destinationRegister;
 	new_w_reg->unsigned_passValue = cur_m_reg.unsigned_passValue;
+	new_w_reg->pair = cur_m_reg.pair;
+	new_w_reg->pair_rd = cur_m_reg.pair_rd;
+	new_w_reg->pair_result = cur_m_reg.pair_result;
 	
-	if(cur_m_reg.memoryRead){
-		uint64_t* temp_result = check_d_cache(d_cache, cur_m_reg.destinationAddress, cur_m_reg.sizeOfByte, result_array);
+	uint64_t forwarded = 0;
+	int      forward   = SB_FORWARD_NONE;
+	if(cur_m_reg.memoryRead && cur_m_reg.funct != 68){
+		forward = forward_store_buffer(address, cur_m_reg.sizeOfByte, &forwarded);
+		if(forward == SB_FORWARD_FULL){
+			sb_forward_full++;
+		}else if(forward == SB_FORWARD_PARTIAL){
+			sb_forward_partial++;
+		}
+	}
+	
+	if(cur_m_reg.funct == 68){ // lr/sc/amo go to memory, around the d-cache
+		if(!atomic_access(cur_m_reg.instruction, address, cur_m_reg.unsigned_passValue, cur_m_reg.sizeOfByte, &temp)){
+			new_w_reg->d_cache_stall = true;
+			new_w_reg->atomic_stall = true;
+			return;
+		}
+		new_w_reg->unsigned_passValue = temp;
+		new_w_reg->forwardingValue = temp;
+		new_w_reg->d_cache_stall = false;
+	}else if(cur_m_reg.memoryRead && forward == SB_FORWARD_FULL){ // every byte comes from the store buffer
+		new_w_reg->unsigned_passValue = load_extend(cur_m_reg.funct, forwarded);
+		new_w_reg->forwardingValue = forwarded;
+		new_w_reg->d_cache_stall = false;
+		memory_port_idle();
+	}else if(cur_m_reg.memoryRead){
+		uint64_t* temp_result = check_d_cache(d_cache, address, cur_m_reg.sizeOfByte, result_array);
+		if(!m_stage_trained){ // the replay after a miss is the same load
+			prefetch_train(cur_m_reg.pc, address, temp_result[0] == 1);
+			wrong_path_train(address, temp_result[0] == 1);
+		}
 		if(temp_result[0] == 1){ // d-cache hit
-			new_w_reg->unsigned_passValue = temp_result[1];
+			forward_store_buffer(address, cur_m_reg.sizeOfByte, &temp_result[1]);
+			new_w_reg->unsigned_passValue = load_extend(cur_m_reg.funct, temp_result[1]);
 			new_w_reg->forwardingValue = temp_result[1];
 			new_w_reg->d_cache_stall = false;
+			memory_port_idle();
+		}else if(coherence_access(&coherence_demand, address, cur_m_reg.sizeOfByte, false)){ // another d-cache answers first
+			new_w_reg->d_cache_stall = true;
+			new_w_reg->coherence_stall = true;
+			memory_port_idle();
+		}else if(prefetch_claim(address & ~0x7ULL)){ // line already on its way from a prefetch
+			new_w_reg->d_cache_stall = true;
 		}else{ // d-cache miss
-			bool status = memory_read(cur_m_reg.destinationAddress, &temp, 8);
-			new_w_reg->d_cache_stall = true; // memory read miss, needs stalls
-			if(status){ // successfully read value from the memory
-				update_d_cache(d_cache, cur_m_reg.destinationAddress, temp);
-			}else{ // failed to read value from the memory, need stalls
+			bool status = memory_read_l2(address & ~0x7ULL, &temp, 8);
+			if(status){ // no memory latency, the line is here already
+				update_d_cache(d_cache, address, temp);
+				check_d_cache(d_cache, address, cur_m_reg.sizeOfByte, result_array);
+				forward_store_buffer(address, cur_m_reg.sizeOfByte, &result_array[1]);
+				new_w_reg->unsigned_passValue = load_extend(cur_m_reg.funct, result_array[1]);
+				new_w_reg->forwardingValue = result_array[1];
+				new_w_reg->d_cache_stall = false;
+			}else{ // memory read miss, needs stalls
+				new_w_reg->d_cache_stall = true;
 			}
 		}
+		m_stage_trained = new_w_reg->d_cache_stall;
 			
-		//printf("> Memory Reading\n> MemAddress is: 0x%016lx\n> value is: 0x%016lx\n",cur_m_reg.destinationAddress,temp);
+		//printf("> Memory Reading\n> MemAddress is: 0x%016lx\n> value is: 0x%016lx\n",address,temp);
 	
 	}else if(cur_m_reg.memoryWrite){
 
-		memory_write(cur_m_reg.destinationAddress, cur_m_reg.unsigned_passValue, cur_m_reg.sizeOfByte);
+		if(store_buffer_enabled){ // room was made above
+			insert_store_buffer(address, cur_m_reg.unsigned_passValue, cur_m_reg.sizeOfByte);
+			memory_port_idle();
+		}else if(coherence_access(&coherence_demand, address, cur_m_reg.sizeOfByte, true)){ // other copies are invalidated first
+			new_w_reg->d_cache_stall = true;
+			new_w_reg->coherence_stall = true;
+			memory_port_idle();
+			return;
+		}else{
+			memory_write_l2(address, cur_m_reg.unsigned_passValue, cur_m_reg.sizeOfByte);
+			write_d_cache(d_cache, address, cur_m_reg.unsigned_passValue, cur_m_reg.sizeOfByte);
+		}
 		new_w_reg->forwardingValue = cur_m_reg.unsigned_passValue;
 		
-		write_d_cache(d_cache, cur_m_reg.destinationAddress, cur_m_reg.unsigned_passValue);
-		
-		//printf("> Memory Writing\n> MemAddress is: 0x%016lx\n> value is: 0x%016lx\n",cur_m_reg.destinationAddress,cur_m_reg.unsigned_passValue);
+		//printf("> Memory Writing\n> MemAddress is: 0x%016lx\n> value is: 0x%016lx\n",address,cur_m_reg.unsigned_passValue);
+	}else if(cur_m_reg.funct != 64 && cur_m_reg.funct != 65){ // else vector_memory gave the port away
+		memory_port_idle();
 	}
 
 }
@@ -2407,6 +7022,11 @@ void stage_memory (struct stage_reg_w *new_w_reg){
 void stage_writeback (void){
 	//printf("----------------------------------------------\n");
 	//printf(">>>>> WRITEBACK STAGE <<<<<\n");
+	
+	if(ooo_enabled){
+		ooo_commit();
+		return;
+	}
 
 	if(cur_w_reg.i_cache_stall){
 		return;
@@ -2424,11 +7044,17 @@ void stage_writeback (void){
 		return;
 	}
 	
+	if(cur_w_reg.instruction == 0x00100073){
+		ebreak_retired = true;
+	}
 	if(cur_w_reg.run){
 		register_write(cur_w_reg.destinationRegister, cur_w_reg.unsigned_passValue);
 		//printf("> The Register is: %d\n", cur_w_reg.destinationRegister);
 		//printf("> The Value in Register is: %d\n", cur_w_reg.unsigned_passValue);
 	}
+	if(cur_w_reg.pair){ // lane 1 is younger, its write lands last
+		register_write(cur_w_reg.pair_rd, cur_w_reg.pair_result);
+	}
 	
 	//uint64_t p_rs1, p_rs2, p_r;
 	//register_read (1, 2, &p_rs1, &p_rs2);
@@ -2439,6 +7065,369 @@ void stage_writeback (void){
 
 }
 
-void unit_tests(){
+/*
+	sim_drained mainly tells the simulator whether the hart may stop at the
+	ebreak at the pc: everything before it has retired and the store buffer
+	has written all its stores to memory
+*/
+bool sim_drained(void){
+	return ebreak_retired && store_buffer_count == 0;
+}
+
+/*
+	sim_stopped mainly tells the simulator that the hart cannot go on, the
+	out-of-order back end met a vector instruction on the right path
+*/
+bool sim_stopped(void){
+	return ooo_stopped;
+}
+
+/*
+	sim_set_option mainly handles the "setopt" command of the simulator
+	return false when the option is unknown or the value is out of range
+*/
+bool sim_set_option(const char *name, uint64_t value){
+	if(!strcmp(name, "bpred")){ // 0: static, 1: bimodal, 2: gshare, 3: TAGE
+		if(value > BPRED_TAGE){
+			return false;
+		}
+		bpred_mode = value;
+		reset_direction_predictor();
+	}else if(!strcmp(name, "bpred_bits")){ // log2 of the bimodal/gshare table size
+		if(value == 0 || value > BPRED_MAX_BITS){
+			return false;
+		}
+		bpred_bits = value;
+		reset_direction_predictor();
+	}else if(!strcmp(name, "bpred_history")){ // gshare history length
+		if(value > GHIST_MAX){
+			return false;
+		}
+		bpred_history_bits = value;
+		reset_direction_predictor();
+	}else if(!strcmp(name, "ras")){
+		ras_enabled = value != 0;
+		ras_top     = 0;
+	}else if(!strcmp(name, "ras_depth")){
+		if(value == 0 || value > RAS_MAX_DEPTH){
+			return false;
+		}
+		ras_depth = value;
+		ras_top   = 0;
+	}else if(!strcmp(name, "indirect")){
+		indirect_enabled = value != 0;
+		reset_indirect_predictor();
+	}else if(!strcmp(name, "indirect_entries")){ // power of 2
+		if(value == 0 || value > INDIRECT_MAX_ENTRIES || __builtin_popcountll(value) != 1){
+			return false;
+		}
+		indirect_entries = value;
+		reset_indirect_predictor();
+	}else if(!strcmp(name, "indirect_history")){
+		if(value > INDIRECT_MAX_HISTORY){
+			return false;
+		}
+		indirect_history = value;
+		reset_indirect_predictor();
+	}else if(!strcmp(name, "itlb_entries")){
+		if(value == 0 || value > TLB_MAX_ENTRIES){
+			return false;
+		}
+		itlb.entries = value;
+		flush_tlb(&itlb);
+	}else if(!strcmp(name, "dtlb_entries")){
+		if(value == 0 || value > TLB_MAX_ENTRIES){
+			return false;
+		}
+		dtlb.entries = value;
+		flush_tlb(&dtlb);
+	}else if(!strcmp(name, "tlb_superpage_entries")){ // 0: one mixed-size TLB
+		if(value > TLB_MAX_ENTRIES){
+			return false;
+		}
+		itlb.super_entries = value;
+		dtlb.super_entries = value;
+		flush_tlb(&itlb);
+		flush_tlb(&dtlb);
+	}else if(!strcmp(name, "l2_tlb_entries")){ // 0: no L2 TLB
+		if(value > TLB_MAX_ENTRIES){
+			return false;
+		}
+		l2_tlb.entries = value;
+		flush_tlb(&l2_tlb);
+	}else if(!strcmp(name, "l2_tlb_latency")){
+		l2_tlb_latency = value;
+	}else if(!strcmp(name, "pwc_entries")){ // 0: no page-walk cache
+		if(value > PWC_MAX_ENTRIES){
+			return false;
+		}
+		pwc_entries = value;
+		flush_pwc();
+	}else if(!strcmp(name, "pwc_latency")){
+		pwc_latency = value;
+	}else if(!strcmp(name, "tlb_latency")){
+		tlb_latency = value;
+	}else if(!strcmp(name, "vipt")){
+		vipt = value != 0;
+		if(vipt){
+			print_vipt_aliasing(&itlb, "I-cache");
+			print_vipt_aliasing(&dtlb, "D-cache");
+		}
+	}else if(!strcmp(name, "wrong_path")){
+		wrong_path_enabled = value != 0;
+	}else if(!strcmp(name, "early_branch")){
+		early_branch = value != 0;
+	}else if(!strcmp(name, "jal_decode")){
+		jal_decode_redirect = value != 0;
+	}else if(!strcmp(name, "ooo")){
+		ooo_enabled = value != 0;
+		ooo_reset();
+	}else if(!strcmp(name, "rob_entries")){
+		if(value == 0 || value > ROB_MAX_ENTRIES){
+			return false;
+		}
+		rob_entries = value;
+		ooo_reset();
+	}else if(!strcmp(name, "iq_entries")){
+		if(value == 0){
+			return false;
+		}
+		iq_entries = value;
+	}else if(!strcmp(name, "lsq_entries")){
+		if(value == 0){
+			return false;
+		}
+		lsq_entries = value;
+	}else if(!strcmp(name, "phys_regs")){ // 32 hold the committed state
+		if(value <= 32 || value > PHYS_MAX_REGS){
+			return false;
+		}
+		phys_regs = value;
+		ooo_reset();
+	}else if(!strcmp(name, "ooo_width")){
+		if(value == 0){
+			return false;
+		}
+		ooo_width = value;
+	}else if(!strcmp(name, "fetch_stages")){
+		if(value == 0 || value > MAX_STAGES){
+			return false;
+		}
+		fetch_stages = value;
+	}else if(!strcmp(name, "execute_stages")){
+		if(value == 0 || value > MAX_STAGES){
+			return false;
+		}
+		execute_stages = value;
+	}else if(!strcmp(name, "memory_stages")){
+		if(value == 0 || value > MAX_STAGES){
+			return false;
+		}
+		memory_stages = value;
+	}else if(!strcmp(name, "mul_latency")){
+		if(value == 0 || value > MULDIV_MAX_LATENCY){
+			return false;
+		}
+		mul_latency = value;
+	}else if(!strcmp(name, "div_latency")){
+		if(value == 0 || value > MULDIV_MAX_LATENCY){
+			return false;
+		}
+		div_latency = value;
+	}else if(!strcmp(name, "vlen")){ // bits per vector register, power of 2
+		if(value < 64 || value > VLEN_MAX || __builtin_popcountll(value) != 1){
+			return false;
+		}
+		vlen = value;
+		vtype = VTYPE_VILL;
+		vl = 0;
+	}else if(!strcmp(name, "vector_lanes")){
+		if(value == 0 || value > VECTOR_MAX_LANES){
+			return false;
+		}
+		vector_lanes = value;
+	}else if(!strcmp(name, "vector_latency")){
+		if(value == 0 || value > MULDIV_MAX_LATENCY){
+			return false;
+		}
+		vector_latency = value;
+	}else if(!strcmp(name, "vector_chaining")){
+		vector_chaining = value != 0;
+	}else if(!strcmp(name, "rvc")){
+		rvc_enabled = value != 0;
+	}else if(!strcmp(name, "issue_width")){
+		if(value != 1 && value != 2){
+			return false;
+		}
+		issue_width = value;
+	}else if(!strcmp(name, "btb_entries")){ // power of 2
+		if(value < btb_ways || value > BTB_MAX_ENTRIES || __builtin_popcountll(value) != 1){
+			return false;
+		}
+		btb_entries = value;
+		memset(BTB, 0, sizeof(BTB));
+	}else if(!strcmp(name, "btb_ways")){ // power of 2
+		if(value == 0 || value > btb_entries || __builtin_popcountll(value) != 1){
+			return false;
+		}
+		btb_ways = value;
+		memset(BTB, 0, sizeof(BTB));
+	}else if(!strcmp(name, "btb_tag_bits")){
+		if(value == 0 || value > 32){
+			return false;
+		}
+		btb_tag_bits = value;
+		memset(BTB, 0, sizeof(BTB));
+	}else if(!strcmp(name, "prefetch")){ // 0: off, 1: stride, 2: stream, 3: both
+		if(value > PREFETCH_BOTH){
+			return false;
+		}
+		prefetch_mode = value;
+	}else if(!strcmp(name, "prefetch_degree")){
+		if(value > PREFETCH_MAX_DEGREE){
+			return false;
+		}
+		prefetch_degree = value; // 0 stops issuing prefetches
+	}else if(!strcmp(name, "victim")){ // 0: off, 1: on
+		victim_enabled = (value != 0);
+		memset(i_victim_cache, 0, sizeof(i_victim_cache));
+		memset(d_victim_cache, 0, sizeof(d_victim_cache));
+	}else if(!strcmp(name, "victim_entries")){
+		if(value == 0 || value > VICTIM_MAX_ENTRIES){
+			return false;
+		}
+		victim_entries = value;
+		memset(i_victim_cache, 0, sizeof(i_victim_cache));
+		memset(d_victim_cache, 0, sizeof(d_victim_cache));
+	}else if(!strcmp(name, "store_buffer")){ // 0: off, 1: on
+		if(!value && store_buffer_count > 0){ // buffered stores would be lost
+			return false;
+		}
+		store_buffer_enabled = (value != 0);
+	}else if(!strcmp(name, "store_buffer_depth")){
+		if(value == 0 || value > STORE_BUFFER_MAX_DEPTH || (int)value < store_buffer_count){
+			return false;
+		}
+		store_buffer_depth = value;
+	}else if(!strcmp(name, "l2")){ // 0: off, 1: on
+		l2_enabled = (value != 0);
+		if(l2_enabled){
+			configure_l2_cache();
+		}
+	}else if(!strcmp(name, "l2_size")){ // in bytes, power of 2
+		if(value < L2_LINE_SIZE * l2_ways || __builtin_popcountll(value) != 1){
+			return false;
+		}
+		l2_size = value;
+		if(l2_enabled){
+			configure_l2_cache();
+		}
+	}else if(!strcmp(name, "l2_ways")){
+		if(value == 0 || l2_size % (L2_LINE_SIZE * value) != 0){
+			return false;
+		}
+		l2_ways = value;
+		if(l2_enabled){
+			configure_l2_cache();
+		}
+	}else if(!strcmp(name, "l2_latency")){
+		l2_latency = value;
+	}else if(!strcmp(name, "l2_banks")){
+		if(value == 0 || value > L2_MAX_BANKS){
+			return false;
+		}
+		l2_banks = value;
+	}else if(!strcmp(name, "coherence_latency")){
+		coherence_latency = value;
+	}else if(!strcmp(name, "l2_policy")){ // 0: NINE, 1: inclusive, 2: exclusive
+		if(value > L2_EXCLUSIVE){
+			return false;
+		}
+		l2_policy = value;
+		if(l2_enabled){
+			configure_l2_cache();
+		}
+	}else{
+		return false;
+	}
+	return true;
+}
+
+/*
+	sim_print_stats mainly handles the "simstats" command of the simulator
+*/
+void sim_print_stats(void){
+	print_bpred_stats();
+	print_btb_stats();
+	print_ras_stats();
+	print_indirect_stats();
+	print_jal_stats();
+	print_early_branch_stats();
+	print_dual_issue_stats();
+	print_bypass_stats();
+	print_depth_stats();
+	print_muldiv_stats();
+	print_vector_stats();
+	print_atomic_stats();
+	print_coherence_stats();
+	print_rvc_stats();
+	print_ooo_stats();
+	print_tlb_stats(&itlb);
+	print_tlb_stats(&dtlb);
+	print_walk_cache_stats();
+	print_prefetch_stats();
+	print_wrong_path_stats();
+	print_store_buffer_stats();
+	print_victim_stats();
+	print_l2_stats();
+}
+
+/*
+	unit_test_ebreak mainly checks the architectural state after a program
+	whose ebreak comes right behind a store, a load and its user, so the
+	hart only stops in the right state if it waits for all of them
+	return false if a register, the stored doubleword or the pc is wrong
+*/
+bool unit_test_ebreak(bool ooo){
+	static const uint32_t program[] = {
+		0x00001537, // lui  a0, 1
+		0x00500593, // addi a1, x0, 5
+		0x00000613, // addi a2, x0, 0
+		0x00b60633, // add  a2, a2, a1
+		0xfff58593, // addi a1, a1, -1
+		0xfe059ce3, // bnez a1, -8
+		0x00c53023, // sd   a2, 0(a0)
+		0x00053683, // ld   a3, 0(a0)
+		0x00168713, // addi a4, a3, 1
+		0x00100073, // ebreak
+	};
+	uint64_t zero = 0, stored = 0, a2 = 0, a3 = 0, a4 = 0;
+	
+	execute_line("initialize");
+	execute_line(ooo ? "setopt ooo 1" : "setopt ooo 0");
+	memory_load(program, 0, sizeof(program));
+	memory_load(&zero, 0x1000, sizeof(zero));
+	for(int i = 10; i <= 14; i++){
+		register_write(i, 0);
+	}
+	execute_line("run 10000");
+	
+	register_read(12, 13, &a2, &a3);
+	register_read(14, 14, &a4, &a4);
+	memory_dump(&stored, 0x1000, sizeof(stored));
+	bool pass = a2 == 15 && a3 == 15 && a4 == 16 && stored == 15 && get_pc() == 0x24;
+	printf("ebreak %s: %s (a2 %" PRIu64 ", a3 %" PRIu64 ", a4 %" PRIu64 ", memory %" PRIu64 ", pc 0x%" PRIx64 ")\n",
+	       ooo ? "out-of-order" : "in-order", pass ? "passed" : "FAILED", a2, a3, a4, stored, get_pc());
+	return pass;
+}
 
+/*
+	unit_tests mainly handles the "-u" option of the simulator
+*/
+void unit_tests(){
+	bool pass = unit_test_ebreak(false);
+	pass = unit_test_ebreak(true) && pass;
+	if(!pass){
+		exit(1);
+	}
 }
\ No newline at end of file
@@ -14,6 +14,12 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+/*
+ * Every hart runs on its own host thread.  State marked HART_LOCAL, such as the
+ * pipeline stage registers, exists once per hart.
+ */
+#define HART_LOCAL  __thread
+
 /*
  * These pipeline stage registers are loaded at the end of the cycle with whatever
  * values were filled in by the relevant pipeline stage.
@@ -31,11 +37,21 @@ struct stage_reg_d {
     uint32_t    stalled;
 	bool        stall;
 	uint64_t    new_pc;
+	uint64_t    seq_pc;  // pc + 2 after a compressed instruction, else pc + 4
 	struct      stage_reg_d  *ptr;
 	bool        branch_prediction;
+	bool        ras_predicted;
+	int         ras_top;
+	uint64_t    ras_top_value;
 	bool        fixed;
 	bool        i_cache_stall;
+	bool        i_cache_fill;
 	bool        first_cache_stall;
+	bool        bubble;  // nothing fetched, e.g. while the ITLB walks
+	uint64_t    paddr;   // physical address of pc
+	bool        pair;    // instruction at pc + 4 issues with this one
+	uint32_t    pair_instruction;
+	int         pair_rule; // why it did not pair, see PAIR_*
 };
 
 struct stage_reg_x {
@@ -44,14 +60,30 @@ struct stage_reg_x {
     uint8_t     flags;
 	bool        stall;
 	uint64_t    new_pc;
+	uint64_t    seq_pc;
 	uint64_t    e[11];
 	int         funct;
 	struct      stage_reg_x  *ptr;
 	bool        branch_prediction;
+	bool        ras_predicted;
+	int         ras_top;
+	uint64_t    ras_top_value;
+	bool        early_resolved;
+	bool        i_cache_fill;
 	bool        fixed;
 	uint64_t    rs1;
 	uint64_t    rs2;
 	bool        i_cache_stall;
+	bool        pair;    // second lane, ALU only
+	uint32_t    pair_instruction;
+	int         pair_rule;
+	int         pair_funct;
+	uint64_t    pair_rd;
+	uint64_t    pair_rs1_reg;
+	uint64_t    pair_rs2_reg;
+	uint64_t    pair_rs1;
+	uint64_t    pair_rs2;
+	uint64_t    pair_imm;
 };
 
 struct stage_reg_m {
@@ -61,7 +93,6 @@ struct stage_reg_m {
 	bool        memoryRead;
 	bool        memoryWrite;
 	bool        writeRun;
-	bool        forwardTag;
 	bool        branch;
 	uint64_t    forwardingValue;
 	int         funct;
@@ -75,6 +106,9 @@ struct stage_reg_m {
 	bool        branch_prediction;
 	bool        wrong_prediction;
 	bool        i_cache_stall;
+	bool        pair;
+	uint64_t    pair_rd;
+	uint64_t    pair_result;
 };
 
 struct stage_reg_w {
@@ -94,7 +128,15 @@ struct stage_reg_w {
 	bool        branch_prediction;
 	bool        wrong_prediction;
 	bool        d_cache_stall;
+	bool        store_buffer_stall;
+	bool        tlb_stall;
+	bool        vector_stall; // a vector load/store has more elements to go
+	bool        atomic_stall; // an LR/SC/AMO waits for memory
+	bool        coherence_stall; // the access waits for other harts' d-caches
 	bool        read_again;
 	bool        first_cache_stall;
 	bool        i_cache_stall;
+	bool        pair;
+	uint64_t    pair_rd;
+	uint64_t    pair_result;
 };
@@ -18,6 +18,7 @@
 
 #include <ctype.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -40,6 +41,7 @@ const int           MEMORY_OP_NONE = 0;             /* Slot is free */
 const int           MEMORY_OP_READ = 1;
 const int           MEMORY_OP_WRITE = 2;
 const int           MEMORY_OP_COMPLETED = 3;        /* Used to free up slot at end of cycle */
+const int           MEMORY_OP_ATOMIC = 4;           /* Read-modify-write, nothing to copy out */
 
 #define             MEMORY_MAX_PENDING 4            /* No more than 4 pending, 2 instruction & 2 data */
 #define             MEMORY_MAX_READ_BYTES 16        /* Maximum read size is 16 bytes per operation */
@@ -52,17 +54,18 @@ typedef struct {
 } memory_pending_t;
 
 
+/* Memory is shared by all harts, everything marked HART_LOCAL is per hart */
 static uint8_t *    riscv_mem;
 static uint64_t     riscv_mem_size = 0ULL;
-static uint64_t     program_counter = 0ULL;
-static uint64_t     ptbr = 0ULL;
+static HART_LOCAL uint64_t  program_counter = 0ULL;
+static HART_LOCAL uint64_t  ptbr = 0ULL;
 static uint64_t     memory_read_latency = 0;
 static uint64_t     memory_write_latency = 0;
-static uint64_t     cycle_counter = 0ULL;
-static uint64_t     read_counter = 0ULL;
-static uint64_t     read_bytes = 0ULL;
-static uint64_t     write_counter = 0ULL;
-static uint64_t     write_bytes = 0ULL;
+static HART_LOCAL uint64_t  cycle_counter = 0ULL;
+static HART_LOCAL uint64_t  read_counter = 0ULL;
+static HART_LOCAL uint64_t  read_bytes = 0ULL;
+static HART_LOCAL uint64_t  write_counter = 0ULL;
+static HART_LOCAL uint64_t  write_bytes = 0ULL;
 
 #define STAGE_F_BIT (1ULL << 0ULL)
 #define STAGE_D_BIT (1ULL << 1ULL)
@@ -70,10 +73,40 @@ static uint64_t     write_bytes = 0ULL;
 #define STAGE_M_BIT (1ULL << 3ULL)
 #define STAGE_W_BIT (1ULL << 4ULL)
 
-static memory_pending_t     memory_pending[MEMORY_MAX_PENDING];
+static HART_LOCAL memory_pending_t  memory_pending[MEMORY_MAX_PENDING];
 
 
-static uint64_t             current_stage = 0ULL;
+static HART_LOCAL uint64_t  current_stage = 0ULL;
+
+/*
+ * Harts
+ *
+ * Hart 0 runs on the main thread, harts 1 and up on threads of their own that start
+ * at the first run after "setopt harts".  Every hart runs hart_quantum cycles and
+ * then waits at a barrier for the others, so no hart gets more than one quantum
+ * ahead of another.  The memory stages of the harts take turns under hart_lock, so
+ * LR/SC/AMO, the stores that break reservations, and the caches of one hart looking at
+ * those of another never see a memory access of another hart half done.  Which hart
+ * gets hart_lock first is up to the host, so results and cycle counts of a run that
+ * has harts racing for memory can change from run to run.  "setopt lockstep 1" makes
+ * the turns go in hart-id order, one round per cycle: the harts then see each other's
+ * memory accesses in the same order every time and a run is reproducible, but they
+ * wait for each other every cycle instead of running in parallel.  Only fetch reads
+ * memory outside of the turns, code that another hart writes is not ordered.
+ */
+static HART_LOCAL uint64_t  hart_id = 0ULL;
+static uint64_t     hart_count = 1;                 /* Harts asked for */
+static uint64_t     harts_running = 1;              /* Harts whose thread is up */
+static uint64_t     hart_quantum = 1000;            /* Cycles between synchronizations */
+static uint64_t     hart_quanta = 0ULL;
+static bool         hart_halted[HART_MAX];          /* Reached an ebreak in this run */
+static bool         reservation_valid[HART_MAX];    /* LR reservation, an 8-byte granule */
+static uint64_t     reservation_address[HART_MAX];
+static pthread_mutex_t  hart_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   hart_turn_passed[HART_MAX] = { [0 ... HART_MAX - 1] = PTHREAD_COND_INITIALIZER };
+static bool         hart_lockstep = false;          /* Memory stages in hart-id order */
+static uint64_t     hart_turn = 0;                  /* Hart whose memory stage is next */
+static bool         hart_turn_left[HART_MAX];       /* Stopped in this run, no turns */
 /******************************************************************************************
  *
  * memory_initialize
@@ -143,6 +176,12 @@ get_cycle_counter (void)
     return cycle_counter;
 }
 
+uint64_t
+get_hart_id (void)
+{
+    return hart_id;
+}
+
 /******************************************************************************************
  *
  * memory_load
@@ -151,8 +190,6 @@ get_cycle_counter (void)
  * Functions to load values into memory or dump values out of memory.
  *
  *****************************************************************************************/
-static
-inline
 bool memory_load (const void * region, uint64_t base, uint64_t size)
 {
 	if (base + size > riscv_mem_size) {
@@ -162,8 +199,6 @@ bool memory_load (const void * region, uint64_t base, uint64_t size)
 	return (true);
 }
 
-static
-inline
 bool memory_dump (void * region, uint64_t base, uint64_t size)
 {
 	if (base + size > riscv_mem_size) {
@@ -185,6 +220,9 @@ memory_add_pending (uint64_t address, uint64_t size_in_bytes, int op)
             pnd->op = op;
             pnd->end_cycle = cycle_counter;
             pnd->end_cycle += (op == MEMORY_OP_WRITE) ? memory_write_latency : memory_read_latency;
+            if (op == MEMORY_OP_ATOMIC) {
+                pnd->end_cycle += memory_write_latency;
+            }
             return true;
         }
     }
@@ -228,7 +266,7 @@ static void memory_reset_cycle ()
 
 
 /* Memory accesses issued during which stages so far */
-static uint64_t             memory_accesses_issued = 0ULL;
+static HART_LOCAL uint64_t  memory_accesses_issued = 0ULL;
 
 bool
 memory_read (uint64_t address, void *value, uint64_t size_in_bytes)
@@ -266,6 +304,17 @@ memory_read (uint64_t address, void *value, uint64_t size_in_bytes)
     return false;
 }
 
+/* A store to the granule of another hart's reservation breaks it, only call it in M stage */
+static void
+memory_break_reservations (uint64_t address)
+{
+    for (uint64_t h = 0; h < harts_running; ++h) {
+        if (h != hart_id && reservation_address[h] == (address & ~0x7ULL)) {
+            reservation_valid[h] = false;
+        }
+    }
+}
+
 /******************************************************************************************
  *
  * memory_write
@@ -282,7 +331,8 @@ memory_read (uint64_t address, void *value, uint64_t size_in_bytes)
  * Returns:
  *      bool            : true if write is finished (successfully or otherwise), false if not
  *                        NOTE: if the write is disallowed, the function returns true but
- *                              no write is done.
+ *                              no write is done.  After false, memory_write_status tells
+ *                              when the write is done.
  *
  *****************************************************************************************/
 bool memory_write (uint64_t address, uint64_t value, uint64_t size_in_bytes)
@@ -307,6 +357,9 @@ bool memory_write (uint64_t address, uint64_t value, uint64_t size_in_bytes)
     /* Write value immediately, even if there's latency */
     /* this only works on little-endian systems */
     memory_load (&value, address, size_in_bytes);
+    if (harts_running > 1) {
+        memory_break_reservations (address);
+    }
     write_counter += 1;
     write_bytes += size_in_bytes;
     if (memory_write_latency == 0ULL) {
@@ -318,20 +371,125 @@ bool memory_write (uint64_t address, uint64_t value, uint64_t size_in_bytes)
 
 bool memory_status (uint64_t address, void * value)
 {
+    memory_pending_t *  pnd = NULL;
+
+    /*
+     * Writes are left to memory_write_status.  A read or atomic still under way beats
+     * an old slot that had the same address.
+     */
     for (int i = 0; i < MEMORY_MAX_PENDING; ++i) {
-        if (memory_pending[i].address == address) {
-            if (memory_pending[i].end_cycle <= cycle_counter) {
-                if (memory_pending[i].op == MEMORY_OP_READ) {
-                    memory_dump (value, address, memory_pending[i].n_bytes);
-                }
-                memory_pending[i].op = MEMORY_OP_COMPLETED;
-                return true;
-            } else {
-                return false;
-            }
+        int op = memory_pending[i].op;
+        if (memory_pending[i].address != address || op == MEMORY_OP_WRITE) {
+            continue;
+        }
+        if (pnd == NULL || ((op == MEMORY_OP_READ || op == MEMORY_OP_ATOMIC) &&
+                            pnd->op != MEMORY_OP_READ && pnd->op != MEMORY_OP_ATOMIC)) {
+            pnd = &memory_pending[i];
+        }
+    }
+    if (pnd == NULL) {
+        /* Not found, so return false */
+        return false;
+    }
+    if (pnd->end_cycle > cycle_counter) {
+        return false;
+    }
+    if (pnd->op == MEMORY_OP_READ) {
+        memory_dump (value, address, pnd->n_bytes);
+    }
+    pnd->op = MEMORY_OP_COMPLETED;
+    return true;
+}
+
+/*
+ * A write frees its slot by itself once its latency is over, nobody has to poll it.
+ * Returns false while a write to the address is still under way.
+ */
+bool
+memory_write_status (uint64_t address)
+{
+    for (int i = 0; i < MEMORY_MAX_PENDING; ++i) {
+        if (memory_pending[i].op == MEMORY_OP_WRITE && memory_pending[i].address == address) {
+            return false;
         }
     }
-    /* Not found, so return false */
+    return true;
+}
+
+/******************************************************************************************
+ *
+ * memory_atomic
+ *
+ * Perform an LR, SC, or AMO on memory, see riscv_sim_framework.h.  Only words (4 bytes)
+ * and doublewords (8 bytes) are allowed.  The rules for stages are the ones of
+ * memory_write.  A reservation covers the aligned 8 bytes around the address.  Every
+ * store by another hart to them breaks it, and so does every SC of its own hart.
+ *
+ *****************************************************************************************/
+bool
+memory_atomic (uint64_t address, uint64_t * value, uint64_t * written, uint64_t size_in_bytes, int op)
+{
+    uint64_t    old = 0ULL, operand = *value, result;
+    int64_t     a, b;
+    bool        write = true;
+
+    *value = 0ULL;
+    *written = 0ULL;
+    if ((size_in_bytes != 4 && size_in_bytes != 8) || address + size_in_bytes > riscv_mem_size ||
+        address % size_in_bytes != 0) {
+        return true;
+    }
+    if (!(current_stage & STAGE_M_BIT) || (memory_accesses_issued & current_stage)) {
+        return true;
+    }
+    memory_accesses_issued |= current_stage;
+
+    memory_dump (&old, address, size_in_bytes);
+    /* Signed views of both operands for min and max */
+    a = (size_in_bytes == 4) ? (int64_t)(int32_t)old : (int64_t)old;
+    b = (size_in_bytes == 4) ? (int64_t)(int32_t)operand : (int64_t)operand;
+    result = operand;
+    switch (op) {
+    case AMO_LR:
+        reservation_valid[hart_id] = true;
+        reservation_address[hart_id] = address & ~0x7ULL;
+        write = false;
+        break;
+    case AMO_SC:
+        write = reservation_valid[hart_id] && reservation_address[hart_id] == (address & ~0x7ULL);
+        reservation_valid[hart_id] = false;
+        old = write ? 0ULL : 1ULL;
+        break;
+    case AMO_SWAP:  result = operand;                               break;
+    case AMO_ADD:   result = (uint64_t)a + (uint64_t)b;             break;
+    case AMO_XOR:   result = old ^ operand;                         break;
+    case AMO_AND:   result = old & operand;                         break;
+    case AMO_OR:    result = old | operand;                         break;
+    case AMO_MIN:   result = (a < b) ? (uint64_t)a : (uint64_t)b;   break;
+    case AMO_MAX:   result = (a > b) ? (uint64_t)a : (uint64_t)b;   break;
+    case AMO_MINU:  result = (old < operand) ? old : operand;       break;
+    case AMO_MAXU:  result = (old > operand) ? old : operand;       break;
+    default:
+        write = false;
+        break;
+    }
+    if (write) {
+        memory_load (&result, address, size_in_bytes);
+        memory_break_reservations (address);
+        *written = result;
+    }
+
+    *value = old;
+    read_counter += 1;
+    read_bytes += size_in_bytes;
+    if (write) {
+        write_counter += 1;
+        write_bytes += size_in_bytes;
+    }
+    if (memory_read_latency + memory_write_latency == 0ULL) {
+        return true;
+    }
+    memory_add_pending (address, size_in_bytes, MEMORY_OP_ATOMIC);
     return false;
 }
 
@@ -339,7 +497,8 @@ static void
 memory_retire_completed (void)
 {
     for (int i = 0; i < MEMORY_MAX_PENDING; ++i) {
-        if (memory_pending[i].op == MEMORY_OP_COMPLETED) {
+        if (memory_pending[i].op == MEMORY_OP_COMPLETED ||
+            (memory_pending[i].op == MEMORY_OP_WRITE && memory_pending[i].end_cycle <= cycle_counter)) {
             memory_pending[i].op = MEMORY_OP_NONE;
         }
     }
@@ -359,9 +518,9 @@ memory_retire_completed (void)
 
 #define RISCV_NUM_REGISTERS         32
 
-static uint64_t     register_file[RISCV_NUM_REGISTERS];
-static uint32_t     register_cycle_reads = 0;
-static uint32_t     register_cycle_writes = 0;
+static HART_LOCAL uint64_t  register_file[RISCV_NUM_REGISTERS];
+static HART_LOCAL uint32_t  register_cycle_reads = 0;
+static HART_LOCAL uint32_t  register_cycle_writes = 0;
 
 static inline
 uint64_t register_read_one (uint64_t reg)
@@ -418,6 +577,13 @@ static void register_reset_cycle ()
  * setpc    <program_counter>
  * getpc    [/x]
  * run      <steps>
+ * setopt   <option> <value>
+ * simstats
+ *
+ * "setopt harts <n>" simulates n harts that share memory, "setopt quantum <cycles>" sets
+ * how far they run between synchronizations.  The other commands act on hart 0.  The
+ * harts run in parallel and their timing is not reproducible, "setopt lockstep 1" runs
+ * their memory stages in hart-id order every cycle so that it is, at the cost of speed.
  *
  * File format defaults to direct binary.  If you want to read or write hex format,
  * append "/x" to the command with a space after it (e.g., load /x, read /x).  Addresses
@@ -427,6 +593,7 @@ static void register_reset_cycle ()
  *****************************************************************************************/
 
 #define             RISCV_INSTR_EBREAK      0x00100073
+#define             RISCV_INSTR_C_EBREAK    0x9002
 #define             SIM_MAX_LINE            4096
 
 static char         cmdsep[] = " \t\n\r";
@@ -438,20 +605,80 @@ static const char * prog_name;
  * This is done so we don't get undefined function and data structure
  * errors.
  */
-struct stage_reg_d cur_d_reg;
-struct stage_reg_x cur_x_reg;
-struct stage_reg_m cur_m_reg;
-struct stage_reg_w cur_w_reg;
+HART_LOCAL struct stage_reg_d cur_d_reg;
+HART_LOCAL struct stage_reg_x cur_x_reg;
+HART_LOCAL struct stage_reg_m cur_m_reg;
+HART_LOCAL struct stage_reg_w cur_w_reg;
 
-struct stage_reg_d * current_stage_d_register = &cur_d_reg;
-struct stage_reg_x * current_stage_x_register = &cur_x_reg;
-struct stage_reg_m * current_stage_m_register = &cur_m_reg;
-struct stage_reg_w * current_stage_w_register = &cur_w_reg;
+/* Set by initialize_state, a thread-local address is not a constant */
+HART_LOCAL struct stage_reg_d * current_stage_d_register;
+HART_LOCAL struct stage_reg_x * current_stage_x_register;
+HART_LOCAL struct stage_reg_m * current_stage_m_register;
+HART_LOCAL struct stage_reg_w * current_stage_w_register;
 
 
-#ifndef SIM_NO_PIPELINE
+/* True once the pipeline code has finished everything before the ebreak at the PC */
+extern bool sim_drained (void);
+/* True once the pipeline code cannot go on, it has printed why */
+extern bool sim_stopped (void);
+
+/* Hand the turn to the next hart still running, only call it with hart_lock held */
 static
 void
+hart_turn_pass (void)
+{
+    for (uint64_t i = 0; i < harts_running; ++i) {
+        hart_turn = (hart_turn + 1) % harts_running;
+        if (!hart_turn_left[hart_turn]) {
+            break;
+        }
+    }
+    pthread_cond_signal (&hart_turn_passed[hart_turn]);
+}
+
+/* Wait for the turn of this hart to run its memory stage, see "Harts" above */
+static
+void
+hart_turn_take (void)
+{
+    pthread_mutex_lock (&hart_lock);
+    while (hart_lockstep && hart_turn != hart_id) {
+        pthread_cond_wait (&hart_turn_passed[hart_id], &hart_lock);
+    }
+}
+
+static
+void
+hart_turn_give (void)
+{
+    if (hart_lockstep) {
+        hart_turn_pass ();
+    }
+    pthread_mutex_unlock (&hart_lock);
+}
+
+/* This hart stopped at an ebreak, the others stop waiting for it */
+static
+void
+hart_turn_leave (void)
+{
+    if (harts_running > 1 && hart_lockstep) {
+        pthread_mutex_lock (&hart_lock);
+        hart_turn_left[hart_id] = true;
+        if (hart_turn == hart_id) {
+            hart_turn_pass ();
+        }
+        pthread_mutex_unlock (&hart_lock);
+    }
+}
+
+/*
+ * Returns true if the hart stopped at an ebreak, after the instructions before it, or
+ * because the pipeline code cannot go on
+ */
+#ifndef SIM_NO_PIPELINE
+static
+bool
 simulator_execute_instructions (uint64_t n_steps)
 {
     uint32_t            inst;
@@ -460,16 +687,30 @@ simulator_execute_instructions (uint64_t n_steps)
     struct stage_reg_m  new_m_reg;
     struct stage_reg_w  new_w_reg;
 
+    /* A stage that holds its register this cycle leaves it unchanged */
+    memcpy (&new_d_reg, &cur_d_reg, sizeof (new_d_reg));
+    memcpy (&new_x_reg, &cur_x_reg, sizeof (new_x_reg));
+    memcpy (&new_m_reg, &cur_m_reg, sizeof (new_m_reg));
+    memcpy (&new_w_reg, &cur_w_reg, sizeof (new_w_reg));
+
     for (uint64_t i = 0; i < n_steps; ++i) {
         memory_dump (&inst, get_pc_internal(), sizeof (inst));
-        if (inst == RISCV_INSTR_EBREAK) {
-            break;
+        if (((inst == RISCV_INSTR_EBREAK || (inst & 0xFFFF) == RISCV_INSTR_C_EBREAK) && sim_drained ()) ||
+            sim_stopped ()) {
+            hart_turn_leave ();
+            return true;
         }
         register_reset_cycle ();
         current_stage = STAGE_W_BIT;
         stage_writeback ();
         current_stage = STAGE_M_BIT;
-        stage_memory (&new_w_reg);
+        if (harts_running > 1) {
+            hart_turn_take ();
+            stage_memory (&new_w_reg);
+            hart_turn_give ();
+        } else {
+            stage_memory (&new_w_reg);
+        }
         current_stage = STAGE_X_BIT;
         stage_execute (&new_m_reg);
         current_stage = STAGE_D_BIT;
@@ -485,11 +726,12 @@ simulator_execute_instructions (uint64_t n_steps)
         cycle_counter += 1;
         memory_retire_completed ();
     }
+    return false;
 }
 #else
 
 static
-void
+bool
 simulator_execute_instructions (uint64_t n_steps)
 {
     uint64_t    new_pc;
@@ -497,14 +739,22 @@ simulator_execute_instructions (uint64_t n_steps)
 
     for (uint64_t i = 0; i < n_steps; ++i) {
         memory_dump (&inst, get_pc_internal (), sizeof (inst));
-        if (inst == RISCV_INSTR_EBREAK) {
-            break;
+        if (inst == RISCV_INSTR_EBREAK || (inst & 0xFFFF) == RISCV_INSTR_C_EBREAK) {
+            hart_turn_leave ();
+            return true;
         }
         memory_reset_cycle ();
         register_reset_cycle ();
-        execute_single_instruction (get_pc_internal (), &new_pc);
+        if (harts_running > 1) {
+            hart_turn_take ();
+            execute_single_instruction (get_pc_internal (), &new_pc);
+            hart_turn_give ();
+        } else {
+            execute_single_instruction (get_pc_internal (), &new_pc);
+        }
         set_pc_internal (new_pc);
     }
+    return false;
 }
 
 #endif
@@ -659,6 +909,10 @@ initialize_state (void)
     memset (&cur_x_reg, 0, sizeof (cur_x_reg));
     memset (&cur_m_reg, 0, sizeof (cur_m_reg));
     memset (&cur_w_reg, 0, sizeof (cur_w_reg));
+    current_stage_d_register = &cur_d_reg;
+    current_stage_x_register = &cur_x_reg;
+    current_stage_m_register = &cur_m_reg;
+    current_stage_w_register = &cur_w_reg;
     cycle_counter = 0ULL;
     read_counter = 0ULL;
     write_counter = 0ULL;
@@ -678,10 +932,225 @@ check_for_hex (const char *sep, char **ctx, char **token)
     return false;
 }
 
+/* Model options and statistics supplied by the pipeline code */
+extern bool sim_set_option (const char * name, uint64_t value);
+extern void sim_print_stats (void);
+
+/******************************************************************************************
+ *
+ * Hart threads
+ *
+ * The main thread (hart 0) hands the other harts a job at a time through hart_jobs and
+ * waits until the hart is done with it.  Options set with setopt are recorded, so that a
+ * hart whose thread starts later sets up its model the same way.  A new hart starts from
+ * a copy of the registers, PC, and cycle count of hart 0.
+ *
+ *****************************************************************************************/
+#define HART_JOB_NONE       0
+#define HART_JOB_BOOT       1
+#define HART_JOB_RUN        2
+#define HART_JOB_SETOPT     3
+#define HART_JOB_STATS      4
+#define HART_MAX_OPTIONS    256
+
+typedef struct {
+    int         job;
+    uint64_t    value;
+    char        name[64];
+} hart_job_t;
+
+static hart_job_t           hart_jobs[HART_MAX];
+static hart_job_t           hart_options[HART_MAX_OPTIONS];
+static uint64_t             hart_option_count = 0;
+static pthread_t            hart_threads[HART_MAX];
+static pthread_mutex_t      hart_job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t       hart_job_posted = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t       hart_job_done = PTHREAD_COND_INITIALIZER;
+static pthread_barrier_t    hart_barrier;
+static uint64_t             hart_boot_registers[RISCV_NUM_REGISTERS];
+static uint64_t             hart_boot_pc, hart_boot_ptbr, hart_boot_cycle;
+
 /*
- * Need to rewrite this using flex and bison.  That'll happen soon....
+ * Run up to n_steps cycles in quanta.  Every hart calls this, and all of them leave it
+ * after the same quantum: the one after which every hart has reached an ebreak, or the
+ * last one.
  */
 static
+void
+hart_run (uint64_t n_steps)
+{
+    bool        all_halted = false;
+    uint64_t    q;
+
+    for (uint64_t done = 0; done < n_steps && !all_halted; done += hart_quantum) {
+        q = (n_steps - done < hart_quantum) ? n_steps - done : hart_quantum;
+        if (!hart_halted[hart_id]) {
+            hart_halted[hart_id] = simulator_execute_instructions (q);
+        }
+        pthread_barrier_wait (&hart_barrier);
+        /* hart_halted only changes before the first barrier, so all harts agree */
+        all_halted = true;
+        for (uint64_t h = 0; h < harts_running; ++h) {
+            all_halted = all_halted && hart_halted[h];
+        }
+        if (hart_id == 0) {
+            hart_quanta += 1;
+        }
+        pthread_barrier_wait (&hart_barrier);
+    }
+}
+
+static
+void *
+hart_thread (void * arg)
+{
+    hart_job_t  job;
+
+    hart_id = (uint64_t)(uintptr_t)arg;
+    initialize_state ();
+    memcpy (register_file, hart_boot_registers, sizeof (register_file));
+    set_pc_internal (hart_boot_pc);
+    ptbr = hart_boot_ptbr;
+    cycle_counter = hart_boot_cycle;
+    for (uint64_t i = 0; i < hart_option_count; ++i) {
+        sim_set_option (hart_options[i].name, hart_options[i].value);
+    }
+
+    pthread_mutex_lock (&hart_job_lock);
+    while (1) {
+        hart_jobs[hart_id].job = HART_JOB_NONE;
+        pthread_cond_broadcast (&hart_job_done);
+        while (hart_jobs[hart_id].job == HART_JOB_NONE) {
+            pthread_cond_wait (&hart_job_posted, &hart_job_lock);
+        }
+        job = hart_jobs[hart_id];
+        pthread_mutex_unlock (&hart_job_lock);
+        if (job.job == HART_JOB_RUN) {
+            hart_run (job.value);
+        } else if (job.job == HART_JOB_SETOPT) {
+            sim_set_option (job.name, job.value);
+        } else if (job.job == HART_JOB_STATS) {
+            sim_print_stats ();
+        }
+        fflush (stdout);
+        pthread_mutex_lock (&hart_job_lock);
+    }
+    return NULL;
+}
+
+static
+void
+hart_post (uint64_t h, int job, uint64_t value, const char * name)
+{
+    pthread_mutex_lock (&hart_job_lock);
+    hart_jobs[h].value = value;
+    if (name != NULL) {
+        snprintf (hart_jobs[h].name, sizeof (hart_jobs[h].name), "%s", name);
+    }
+    hart_jobs[h].job = job;
+    pthread_cond_broadcast (&hart_job_posted);
+    pthread_mutex_unlock (&hart_job_lock);
+}
+
+static
+void
+hart_wait (uint64_t h)
+{
+    pthread_mutex_lock (&hart_job_lock);
+    while (hart_jobs[h].job != HART_JOB_NONE) {
+        pthread_cond_wait (&hart_job_done, &hart_job_lock);
+    }
+    pthread_mutex_unlock (&hart_job_lock);
+}
+
+/* Start the threads of harts harts_running to hart_count - 1 */
+static
+void
+harts_start (void)
+{
+    if (harts_running > 1) {
+        pthread_barrier_destroy (&hart_barrier);
+    }
+    pthread_barrier_init (&hart_barrier, NULL, hart_count);
+    memcpy (hart_boot_registers, register_file, sizeof (hart_boot_registers));
+    hart_boot_pc = get_pc_internal ();
+    hart_boot_ptbr = ptbr;
+    hart_boot_cycle = cycle_counter;
+    for (uint64_t h = harts_running; h < hart_count; ++h) {
+        hart_jobs[h].job = HART_JOB_BOOT;
+        if (pthread_create (&hart_threads[h], NULL, hart_thread, (void *)(uintptr_t)h) != 0) {
+            fprintf (stderr, "run: failed to start the thread of hart %llu\n", (ull)h);
+            exit (1);
+        }
+        hart_wait (h);
+    }
+    harts_running = hart_count;
+}
+
+static
+void
+harts_execute_instructions (uint64_t n_steps)
+{
+    if (hart_count == 1) {
+        simulator_execute_instructions (n_steps);
+        return;
+    }
+    if (harts_running < hart_count) {
+        harts_start ();
+    }
+    memset (hart_halted, 0, sizeof (hart_halted));
+    memset (hart_turn_left, 0, sizeof (hart_turn_left));
+    hart_turn = 0;
+    for (uint64_t h = 1; h < harts_running; ++h) {
+        hart_post (h, HART_JOB_RUN, n_steps, NULL);
+    }
+    hart_run (n_steps);
+    for (uint64_t h = 1; h < harts_running; ++h) {
+        hart_wait (h);
+    }
+}
+
+/* Record an option hart 0 took, and hand it to the harts already running */
+static
+void
+harts_set_option (const char * name, uint64_t value)
+{
+    if (hart_option_count < HART_MAX_OPTIONS) {
+        snprintf (hart_options[hart_option_count].name, sizeof (hart_options[0].name), "%s", name);
+        hart_options[hart_option_count].value = value;
+        hart_option_count += 1;
+    } else {
+        fprintf (stderr, "setopt: too many options, harts started later will not get %s\n", name);
+    }
+    for (uint64_t h = 1; h < harts_running; ++h) {
+        hart_post (h, HART_JOB_SETOPT, value, name);
+        hart_wait (h);
+    }
+}
+
+static
+void
+harts_print_stats (void)
+{
+    if (harts_running == 1) {
+        sim_print_stats ();
+        return;
+    }
+    printf ("Harts: %llu, quantum %llu cycles, %llu quanta run\n", (ull)harts_running,
+            (ull)hart_quantum, (ull)hart_quanta);
+    printf ("Hart 0:\n");
+    sim_print_stats ();
+    for (uint64_t h = 1; h < harts_running; ++h) {
+        printf ("Hart %llu:\n", (ull)h);
+        fflush (stdout);
+        hart_post (h, HART_JOB_STATS, 0, NULL);
+        hart_wait (h);
+    }
+}
+
+/*
+ * Need to rewrite this using flex and bison.  That'll happen soon....
+ */
 bool
 execute_line (const char * l)
 {
@@ -787,7 +1256,7 @@ execute_line (const char * l)
                 fprintf (stderr, "run: steps must be between 1-100000000, not %llu\n", (ull)n_steps);
                 break;
             }
-            simulator_execute_instructions (n_steps);
+            harts_execute_instructions (n_steps);
         } else if (!strcasecmp ("setpc", cmd)) {
             token = strtok_r (NULL, cmdsep, &ctx);
             if (token == NULL) {
@@ -834,6 +1303,42 @@ execute_line (const char * l)
             printf ("Read bytes: %llu\n", (ull)read_bytes);
             printf ("Write operations: %llu\n", (ull)write_counter);
             printf ("Write bytes: %llu\n", (ull)write_bytes);
+        } else if (!strcasecmp ("setopt", cmd)) {
+            char *  opt_name = strtok_r (NULL, cmdsep, &ctx);
+            token = strtok_r (NULL, cmdsep, &ctx);
+            if (opt_name == NULL || token == NULL) {
+                fprintf (stderr, "Usage: setopt <option> <value>\n");
+                break;
+            }
+            value = strtoull (token, NULL, 0);
+            if (!strcmp (opt_name, "harts")) {
+                if (value < harts_running || value > HART_MAX) {
+                    fprintf (stderr, "setopt: harts must be between %llu-%d, not %llu\n",
+                             (ull)harts_running, HART_MAX, (ull)value);
+                    break;
+                }
+                hart_count = value;
+                break;
+            }
+            if (!strcmp (opt_name, "lockstep")) {
+                hart_lockstep = value != 0;
+                break;
+            }
+            if (!strcmp (opt_name, "quantum")) {
+                if (value < 1) {
+                    fprintf (stderr, "setopt: quantum must be at least 1 cycle\n");
+                    break;
+                }
+                hart_quantum = value;
+                break;
+            }
+            if (! sim_set_option (opt_name, value)) {
+                fprintf (stderr, "setopt: unknown option or bad value: %s %llu\n", opt_name, (ull)value);
+                break;
+            }
+            harts_set_option (opt_name, value);
+        } else if (!strcasecmp ("simstats", cmd)) {
+            harts_print_stats ();
         } else if (!strcasecmp ("exit", cmd)) {
             fflush (stdout);
             return false;
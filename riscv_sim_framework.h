@@ -16,6 +16,29 @@
 extern bool memory_read (uint64_t address, void * value, uint64_t size_in_bytes);
 extern bool memory_write (uint64_t address, uint64_t value, uint64_t size_in_bytes);
 extern bool memory_status (uint64_t address, void *value);
+extern bool memory_write_status (uint64_t address);
+
+/*
+ * Atomic memory operations (RV64A).  The op is the funct5 field of the instruction.
+ * memory_atomic reads, modifies, and writes memory in one step that no other hart
+ * can split.  value holds the rs2 operand on the way in.  On the way out it holds
+ * the old memory value, or, for SC, 0 on success and 1 on failure.  written gets
+ * the value stored, if the op stored one (every AMO and a successful SC).  The timing
+ * works like memory_read: if this returns false, poll memory_status for the address.
+ */
+#define AMO_ADD     0x00
+#define AMO_SWAP    0x01
+#define AMO_LR      0x02
+#define AMO_SC      0x03
+#define AMO_XOR     0x04
+#define AMO_OR      0x08
+#define AMO_AND     0x0C
+#define AMO_MIN     0x10
+#define AMO_MAX     0x14
+#define AMO_MINU    0x18
+#define AMO_MAXU    0x1C
+
+extern bool memory_atomic (uint64_t address, uint64_t * value, uint64_t * written, uint64_t size_in_bytes, int op);
 
 extern void register_read (uint64_t register_a, uint64_t register_b, uint64_t * value_a, uint64_t * value_b);
 extern void register_write (uint64_t register_d, uint64_t value_d);
@@ -24,6 +47,18 @@ extern void     set_pc (uint64_t pc);
 extern uint64_t get_pc (void);
 extern uint64_t get_ptbr (void);
 
+#define HART_MAX    8               /* Most harts "setopt harts" allows */
+
+extern uint64_t get_hart_id (void);
+
+/*
+ * For unit_tests: load and dump memory without any timing, and run one line of
+ * simulator commands as if it came from the command file.
+ */
+extern bool memory_load (const void * region, uint64_t base, uint64_t size);
+extern bool memory_dump (void * region, uint64_t base, uint64_t size);
+extern bool execute_line (const char * l);
+
 /*
  * These are the functions students need to implement for Assignment 2.
  * Each of your functions must fill in the fields for the stage register